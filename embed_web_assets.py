@@ -0,0 +1,101 @@
+"""Embed the web UI assets from web/ as gzipped arrays into the firmware
+
+Generates src/web_assets.hpp. Each asset is served from flash at a URL
+containing a hash of its content, e.g. /static/style.0123abcd.css, so
+browsers can cache it forever and a changed asset gets a new URL.
+
+Runs as PlatformIO pre-build script (extra_scripts = pre:embed_web_assets.py)
+or standalone: python3 embed_web_assets.py
+"""
+import gzip
+import hashlib
+import os
+
+content_types = {
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".html": "text/html",
+    ".svg": "image/svg+xml",
+}
+static_prefix = "/static/"
+
+
+def c_identifier(filename):
+    return "".join(c if c.isalnum() else "_" for c in filename)
+
+
+def render_asset(filename, content):
+    stem, ext = os.path.splitext(filename)
+    digest = hashlib.sha256(content).hexdigest()[:8]
+    url = "%s%s.%s%s" % (static_prefix, stem, digest, ext)
+    # mtime 0 and no file name: same input, same output
+    compressed = gzip.compress(content, compresslevel=9, mtime=0)
+    name = c_identifier(filename)
+    lines = ["// %s: %d bytes, %d gzipped" % (filename, len(content), len(compressed)),
+             "#define WEB_ASSET_%s_URL \"%s\"" % (name.upper(), url),
+             "constexpr uint8_t %s_gz[] = {" % name]
+    for i in range(0, len(compressed), 16):
+        lines.append("    " + ", ".join("0x%02x" % b for b in compressed[i:i + 16]) + ",")
+    lines.append("};")
+    entry = "    {WEB_ASSET_%s_URL, \"%s\", %s_gz, sizeof(%s_gz)}," % (
+        name.upper(), content_types[ext], name, name)
+    return "\n".join(lines), entry
+
+
+def generate(project_dir):
+    web_dir = os.path.join(project_dir, "web")
+    header_path = os.path.join(project_dir, "src", "web_assets.hpp")
+    filenames = sorted(f for f in os.listdir(web_dir)
+                       if os.path.splitext(f)[1] in content_types)
+    arrays = []
+    entries = []
+    for filename in filenames:
+        with open(os.path.join(web_dir, filename), "rb") as f:
+            array, entry = render_asset(filename, f.read())
+        arrays.append(array)
+        entries.append(entry)
+    header = "\n".join([
+        "// Generated by embed_web_assets.py from web/, do not edit",
+        "#ifndef WEB_ASSETS_HPP__",
+        "#define WEB_ASSETS_HPP__",
+        "",
+        "#include <cstddef>",
+        "#include <cstdint>",
+        "",
+        "namespace web_assets {",
+        "",
+        "struct Asset",
+        "{",
+        "    const char* url;",
+        "    const char* content_type;",
+        "    const uint8_t* gz;",
+        "    size_t gz_size;",
+        "};",
+        "",
+        "\n\n".join(arrays),
+        "",
+        "constexpr Asset assets[] = {",
+        "\n".join(entries),
+        "};",
+        "",
+        "} // namespace web_assets",
+        "",
+        "#endif",
+        "",
+    ])
+    # Only touch the header when it changes, avoids needless rebuilds
+    if os.path.exists(header_path):
+        with open(header_path) as f:
+            if f.read() == header:
+                return
+    with open(header_path, "w") as f:
+        f.write(header)
+    print("embed_web_assets.py: Generated", header_path)
+
+
+try:
+    Import("env")
+    project_dir = env.subst("$PROJECT_DIR")
+except NameError:
+    project_dir = os.path.dirname(os.path.abspath(__file__))
+generate(project_dir)
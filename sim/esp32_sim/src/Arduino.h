@@ -0,0 +1,41 @@
+/* Simulation shim: Arduino-ESP32 core API subset
+ */
+#ifndef ESP32_SIM_ARDUINO_H__
+#define ESP32_SIM_ARDUINO_H__
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include "WString.h"
+#include "HardwareSerial.h"
+#include "esp32-hal.h"
+#include "esp_timer.h"
+
+#define ARDUINO 10805
+
+#define PROGMEM
+#define IRAM_ATTR
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+class EspClass
+{
+public:
+    uint32_t getFreeHeap();
+    uint32_t getHeapSize();
+    uint32_t getFreeSketchSpace();
+    uint32_t getCpuFreqMHz() { return 240; }
+    void restart();
+};
+
+extern EspClass ESP;
+
+#endif
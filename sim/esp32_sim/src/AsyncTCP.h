@@ -0,0 +1,8 @@
+/* Simulation shim: AsyncTCP, no network in the simulation
+ */
+#ifndef ESP32_SIM_ASYNCTCP_H__
+#define ESP32_SIM_ASYNCTCP_H__
+
+class AsyncClient;
+
+#endif
@@ -0,0 +1,490 @@
+/* Simulation shim: ESPAsyncWebServer subset
+ *
+ * There is no network. Requests are injected by the simulation with
+ * AsyncWebServer::sim_request(), the response which the handlers send
+ * is recorded in the request object and can be inspected afterwards.
+ * Server-Sent Events and WebSocket clients are attached with
+ * AsyncEventSource::sim_connect() and AsyncWebSocket::sim_connect().
+ */
+#ifndef ESP32_SIM_ESPASYNCWEBSERVER_H__
+#define ESP32_SIM_ESPASYNCWEBSERVER_H__
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "Arduino.h"
+#include "FS.h"
+
+typedef enum {
+    HTTP_GET     = 0b00000001,
+    HTTP_POST    = 0b00000010,
+    HTTP_DELETE  = 0b00000100,
+    HTTP_PUT     = 0b00001000,
+    HTTP_PATCH   = 0b00010000,
+    HTTP_HEAD    = 0b00100000,
+    HTTP_OPTIONS = 0b01000000,
+    HTTP_ANY     = 0b01111111,
+} WebRequestMethod;
+
+typedef uint8_t WebRequestMethodComposite;
+
+class AsyncWebServer;
+class AsyncWebServerRequest;
+class AsyncWebServerResponse;
+
+typedef std::function<String(const String&)> AwsTemplateProcessor;
+typedef std::function<size_t(uint8_t* buffer, size_t maxLen, size_t index)> AwsResponseFiller;
+typedef std::function<void(AsyncWebServerRequest* request)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest* request, const String& filename,
+                           size_t index, uint8_t* data, size_t len, bool final)>
+    ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest* request, uint8_t* data,
+                           size_t len, size_t index, size_t total)>
+    ArBodyHandlerFunction;
+
+class AsyncWebParameter
+{
+public:
+    AsyncWebParameter(const String& name, const String& value,
+                      bool form = false, bool file = false, size_t size = 0)
+        : _name{name}, _value{value}, _size{size}, _isForm{form}, _isFile{file} {}
+    const String& name() const { return _name; }
+    const String& value() const { return _value; }
+    size_t size() const { return _size; }
+    bool isPost() const { return _isForm; }
+    bool isFile() const { return _isFile; }
+
+private:
+    String _name;
+    String _value;
+    size_t _size;
+    bool _isForm;
+    bool _isFile;
+};
+
+class AsyncWebHeader
+{
+public:
+    AsyncWebHeader(const String& name, const String& value)
+        : _name{name}, _value{value} {}
+    const String& name() const { return _name; }
+    const String& value() const { return _value; }
+
+private:
+    String _name;
+    String _value;
+};
+
+class AsyncWebServerResponse
+{
+public:
+    AsyncWebServerResponse(int code, const String& contentType, String content)
+        : _code{code}, _contentType{contentType}, _content{std::move(content)} {}
+    virtual ~AsyncWebServerResponse() = default;
+    void setCode(int code) { _code = code; }
+    void setContentType(const String& type) { _contentType = type; }
+    void addHeader(const String& name, const String& value) { _headers.emplace_back(name, value); }
+
+    // Simulation accessors
+    int code() const { return _code; }
+    const String& contentType() const { return _contentType; }
+    virtual const String& content() const { return _content; }
+    const String* header(const char* name) const;
+
+protected:
+    int _code;
+    String _contentType;
+    String _content;
+    std::vector<std::pair<String, String>> _headers;
+};
+
+// Content produced by a filler callback. The library calls it while the
+// response is sent, the simulation when the content is accessed.
+class AsyncCallbackResponse : public AsyncWebServerResponse
+{
+public:
+    AsyncCallbackResponse(const String& contentType, size_t len, AwsResponseFiller callback)
+        : AsyncWebServerResponse{200, contentType, String{}}
+        , _length{len}, _filler{std::move(callback)}, _filled{false} {}
+    const String& content() const override;
+
+private:
+    size_t _length;
+    AwsResponseFiller _filler;
+    mutable bool _filled;
+};
+
+// Content read from memory while the response is sent, the memory must
+// stay valid until then. The simulation reads it when it is accessed.
+class AsyncProgmemResponse : public AsyncWebServerResponse
+{
+public:
+    AsyncProgmemResponse(int code, const String& contentType,
+                         const uint8_t* content, size_t len)
+        : AsyncWebServerResponse{code, contentType, String{}}
+        , _data{content}, _length{len}, _filled{false} {}
+    const String& content() const override;
+
+private:
+    const uint8_t* _data;
+    size_t _length;
+    mutable bool _filled;
+};
+
+class AsyncResponseStream : public AsyncWebServerResponse, public Print
+{
+public:
+    AsyncResponseStream(const String& contentType)
+        : AsyncWebServerResponse{200, contentType, String{}} {}
+    using Print::write;
+    size_t write(uint8_t c) override { _content += static_cast<char>(c); return 1; }
+};
+
+class AsyncWebServerRequest
+{
+public:
+    // Handler scratch storage, released with free() with the request
+    void* _tempObject;
+    // Handler scratch file, closed with the request
+    File _tempFile;
+
+    AsyncWebServerRequest(AsyncWebServer* server, WebRequestMethod method,
+                          const String& url);
+    ~AsyncWebServerRequest();
+
+    WebRequestMethodComposite method() const { return _method; }
+    const String& url() const { return _url; }
+    const String& host() const { return _host; }
+    size_t contentLength() const { return _contentLength; }
+
+    size_t params() const { return _params.size(); }
+    const AsyncWebParameter* getParam(size_t num) const;
+    bool hasParam(const String& name, bool post = false, bool file = false) const;
+    const AsyncWebParameter* getParam(const String& name, bool post = false, bool file = false) const;
+
+    size_t headers() const { return _headers.size(); }
+    bool hasHeader(const String& name) const { return getHeader(name) != nullptr; }
+    const AsyncWebHeader* getHeader(const String& name) const;
+    void addHeader(const String& name, const String& value);
+
+    void send(AsyncWebServerResponse* response);
+    void send(int code, const String& contentType = String(), const String& content = String());
+    void send_P(int code, const String& contentType, const uint8_t* content, size_t len,
+                AwsTemplateProcessor callback = nullptr);
+    void send_P(int code, const String& contentType, const char* content,
+                AwsTemplateProcessor callback = nullptr);
+
+    AsyncWebServerResponse* beginResponse(int code, const String& contentType = String(),
+                                          const String& content = String());
+    AsyncWebServerResponse* beginResponse_P(int code, const String& contentType,
+                                            const uint8_t* content, size_t len,
+                                            AwsTemplateProcessor callback = nullptr);
+    AsyncWebServerResponse* beginResponse_P(int code, const String& contentType,
+                                            const char* content,
+                                            AwsTemplateProcessor callback = nullptr);
+    AsyncWebServerResponse* beginResponse(const String& contentType, size_t len,
+                                          AwsResponseFiller callback);
+    AsyncResponseStream* beginResponseStream(const String& contentType,
+                                             size_t bufferSize = 1460);
+
+    bool authenticate(const char* username, const char* password) const { return true; }
+    void requestAuthentication() { send(401); }
+
+    // Simulation accessor, nullptr when no response was sent
+    const AsyncWebServerResponse* sim_response() const { return _response; }
+    void sim_set_content_length(size_t length) { _contentLength = length; }
+
+private:
+    AsyncWebServer* _server;
+    WebRequestMethodComposite _method;
+    String _url;
+    String _host;
+    size_t _contentLength;
+    std::vector<AsyncWebParameter*> _params;
+    std::vector<AsyncWebHeader*> _headers;
+    AsyncWebServerResponse* _response;
+};
+
+class AsyncWebHandler
+{
+public:
+    virtual ~AsyncWebHandler() = default;
+    AsyncWebHandler& setAuthentication(const char* username, const char* password) {
+        _username = username; _password = password; return *this;
+    }
+    virtual bool canHandle(AsyncWebServerRequest* request) { return false; }
+    virtual void handleRequest(AsyncWebServerRequest* request) {}
+    virtual void handleUpload(AsyncWebServerRequest* request, const String& filename,
+                              size_t index, uint8_t* data, size_t len, bool final) {}
+    virtual void handleBody(AsyncWebServerRequest* request, uint8_t* data,
+                            size_t len, size_t index, size_t total) {}
+
+protected:
+    String _username;
+    String _password;
+};
+
+class AsyncCallbackWebHandler : public AsyncWebHandler
+{
+public:
+    AsyncCallbackWebHandler(const String& uri, WebRequestMethodComposite method,
+                            ArRequestHandlerFunction onRequest,
+                            ArUploadHandlerFunction onUpload,
+                            ArBodyHandlerFunction onBody)
+        : _uri{uri}, _method{method}, _onRequest{onRequest}
+        , _onUpload{onUpload}, _onBody{onBody} {}
+    bool canHandle(AsyncWebServerRequest* request) override;
+    void handleRequest(AsyncWebServerRequest* request) override;
+    void handleUpload(AsyncWebServerRequest* request, const String& filename,
+                      size_t index, uint8_t* data, size_t len, bool final) override;
+    void handleBody(AsyncWebServerRequest* request, uint8_t* data,
+                    size_t len, size_t index, size_t total) override;
+
+private:
+    String _uri;
+    WebRequestMethodComposite _method;
+    ArRequestHandlerFunction _onRequest;
+    ArUploadHandlerFunction _onUpload;
+    ArBodyHandlerFunction _onBody;
+};
+
+class AsyncStaticWebHandler : public AsyncWebHandler
+{
+public:
+    AsyncStaticWebHandler(const char* uri, fs::FS& fs, const char* path,
+                          const char* cache_control)
+        : _fs{&fs}, _uri{uri}, _path{path}
+        , _cache_control{cache_control ? cache_control : ""} {}
+    AsyncStaticWebHandler& setDefaultFile(const char* filename) { _default_file = filename; return *this; }
+    AsyncStaticWebHandler& setCacheControl(const char* cache_control) { _cache_control = cache_control; return *this; }
+    AsyncStaticWebHandler& setTemplateProcessor(AwsTemplateProcessor newCallback) {
+        _callback = newCallback; return *this;
+    }
+    AsyncStaticWebHandler& setAuthentication(const char* username, const char* password) {
+        AsyncWebHandler::setAuthentication(username, password); return *this;
+    }
+    bool canHandle(AsyncWebServerRequest* request) override;
+    void handleRequest(AsyncWebServerRequest* request) override;
+
+private:
+    fs::FS* _fs;
+    String _uri;
+    String _path;
+    String _default_file{"index.htm"};
+    String _cache_control;
+    AwsTemplateProcessor _callback;
+};
+
+class AsyncEventSource;
+
+class AsyncEventSourceClient
+{
+public:
+    AsyncEventSourceClient(AsyncEventSource* server, uint32_t lastId)
+        : _server{server}, _lastId{lastId} {}
+    void close();
+    void write(const char* message, size_t len);
+    void send(const char* message, const char* event = nullptr,
+              uint32_t id = 0, uint32_t reconnect = 0);
+    bool connected() const { return _connected; }
+    uint32_t lastId() const { return _lastId; }
+    size_t packetsWaiting() const { return _queued; }
+
+    // Simulation accessors. Messages and bytes count what was sent,
+    // including messages still waiting in the queue.
+    uint64_t sim_messages() const { return _messages; }
+    uint64_t sim_bytes() const { return _bytes; }
+    const String& sim_last_message() const { return _last_message; }
+    // Simulation: A stalled client does not acknowledge, all messages
+    // stay queued. Unstalling delivers the queue.
+    void sim_set_stalled(bool stalled);
+    size_t sim_queued_bytes() const { return _queued_bytes; }
+    size_t sim_peak_queued_bytes() const { return _peak_queued_bytes; }
+
+private:
+    AsyncEventSource* _server;
+    uint32_t _lastId;
+    bool _connected = true;
+    uint64_t _messages = 0;
+    uint64_t _bytes = 0;
+    String _last_message;
+    bool _stalled = false;
+    size_t _queued = 0;
+    size_t _queued_bytes = 0;
+    size_t _peak_queued_bytes = 0;
+
+    friend class AsyncEventSource;
+};
+
+typedef std::function<void(AsyncEventSourceClient* client)> ArEventHandlerFunction;
+
+class AsyncEventSource : public AsyncWebHandler
+{
+public:
+    AsyncEventSource(const String& url) : _url{url} {}
+    ~AsyncEventSource() override;
+    const char* url() const { return _url.c_str(); }
+    void close();
+    void onConnect(ArEventHandlerFunction cb) { _connectcb = cb; }
+    // Called when a client has gone, before it is deleted
+    void onDisconnect(ArEventHandlerFunction cb) { _disconnectcb = cb; }
+    void send(const char* message, const char* event = nullptr,
+              uint32_t id = 0, uint32_t reconnect = 0);
+    size_t count() const;
+    size_t avgPacketsWaiting() const { return 0; }
+
+    // Simulation: attach a new client, like a browser opening the stream
+    AsyncEventSourceClient* sim_connect(uint32_t lastId = 0);
+    // Simulation: a client goes away
+    void sim_disconnect(AsyncEventSourceClient* client);
+
+private:
+    String _url;
+    std::list<std::unique_ptr<AsyncEventSourceClient>> _clients;
+    ArEventHandlerFunction _connectcb;
+    ArEventHandlerFunction _disconnectcb;
+
+    friend class AsyncEventSourceClient;
+};
+
+typedef enum { WS_EVT_CONNECT, WS_EVT_DISCONNECT, WS_EVT_PONG, WS_EVT_ERROR,
+               WS_EVT_DATA } AwsEventType;
+typedef enum { WS_CONTINUATION, WS_TEXT, WS_BINARY, WS_DISCONNECT = 0x08,
+               WS_PING, WS_PONG } AwsFrameType;
+
+typedef struct {
+    uint8_t message_opcode;
+    uint32_t num;
+    uint8_t final;
+    uint8_t masked;
+    uint8_t opcode;
+    uint64_t len;
+    uint8_t mask[4];
+    uint64_t index;
+} AwsFrameInfo;
+
+class AsyncWebSocket;
+
+class AsyncWebSocketClient
+{
+public:
+    AsyncWebSocketClient(AsyncWebSocket* server, uint32_t id)
+        : _server{server}, _id{id} {}
+    uint32_t id() const { return _id; }
+    bool canSend() const { return _connected; }
+    void close(uint16_t code = 0, const char* message = nullptr);
+    void text(const char* message, size_t len);
+    void text(const String& message) { text(message.c_str(), message.length()); }
+    void binary(const uint8_t* message, size_t len);
+    void binary(const char* message, size_t len) {
+        binary(reinterpret_cast<const uint8_t*>(message), len);
+    }
+
+    // Simulation accessors
+    bool sim_connected() const { return _connected; }
+    uint64_t sim_messages() const { return _messages; }
+    const String& sim_last_message() const { return _last_message; }
+
+private:
+    AsyncWebSocket* _server;
+    uint32_t _id;
+    bool _connected = true;
+    uint64_t _messages = 0;
+    String _last_message;
+};
+
+typedef std::function<void(AsyncWebSocket* server, AsyncWebSocketClient* client,
+                           AwsEventType type, void* arg, uint8_t* data,
+                           size_t len)> AwsEventHandler;
+
+class AsyncWebSocket : public AsyncWebHandler
+{
+public:
+    explicit AsyncWebSocket(const String& url) : _url{url} { _rx_buffer.reserve(1460); }
+    ~AsyncWebSocket() override;
+    const char* url() const { return _url.c_str(); }
+    void onEvent(AwsEventHandler handler) { _eventHandler = handler; }
+    size_t count() const;
+    void cleanupClients(uint16_t maxClients = 8) {}
+    void textAll(const char* message, size_t len);
+    void binaryAll(const uint8_t* message, size_t len);
+
+    // Simulation: attach a new client
+    AsyncWebSocketClient* sim_connect();
+    // Simulation: a complete, unfragmented message from the client
+    void sim_receive(AsyncWebSocketClient* client, const uint8_t* data,
+                     size_t len, bool binary = true);
+    // Simulation: a client goes away
+    void sim_disconnect(AsyncWebSocketClient* client);
+
+private:
+    String _url;
+    std::list<std::unique_ptr<AsyncWebSocketClient>> _clients;
+    AwsEventHandler _eventHandler;
+    uint32_t _next_id = 1;
+    // Reused like the receive buffer of the TCP connection
+    std::vector<uint8_t> _rx_buffer;
+
+    friend class AsyncWebSocketClient;
+};
+
+class AsyncWebServer
+{
+public:
+    AsyncWebServer(uint16_t port) : _port{port} {}
+    ~AsyncWebServer();
+    void begin() {}
+    void end() {}
+    void reset();
+
+    AsyncWebHandler& addHandler(AsyncWebHandler* handler);
+    bool removeHandler(AsyncWebHandler* handler);
+
+    AsyncCallbackWebHandler& on(const char* uri, ArRequestHandlerFunction onRequest);
+    AsyncCallbackWebHandler& on(const char* uri, WebRequestMethodComposite method,
+                                ArRequestHandlerFunction onRequest);
+    AsyncCallbackWebHandler& on(const char* uri, WebRequestMethodComposite method,
+                                ArRequestHandlerFunction onRequest,
+                                ArUploadHandlerFunction onUpload);
+    AsyncCallbackWebHandler& on(const char* uri, WebRequestMethodComposite method,
+                                ArRequestHandlerFunction onRequest,
+                                ArUploadHandlerFunction onUpload,
+                                ArBodyHandlerFunction onBody);
+
+    AsyncStaticWebHandler& serveStatic(const char* uri, fs::FS& fs, const char* path,
+                                       const char* cache_control = nullptr);
+
+    void onNotFound(ArRequestHandlerFunction fn) { _catchAllHandler_onRequest = fn; }
+    void onFileUpload(ArUploadHandlerFunction fn) { _catchAllHandler_onUpload = fn; }
+    void onRequestBody(ArBodyHandlerFunction fn) { _catchAllHandler_onBody = fn; }
+
+    /* Simulation: inject a request. The URL may contain a query string.
+     * When body is given, it is delivered in chunks of body_chunk bytes
+     * to the handler body callback, then the request handler is run.
+     * The returned request holds the recorded response.
+     */
+    std::unique_ptr<AsyncWebServerRequest> sim_request(
+        WebRequestMethod method, const char* url,
+        std::vector<std::pair<String, String>> headers = {},
+        const uint8_t* body = nullptr, size_t body_len = 0,
+        size_t body_chunk = 1460);
+    // Simulation: multipart file upload, delivered in chunks
+    std::unique_ptr<AsyncWebServerRequest> sim_upload(
+        const char* url, const char* filename,
+        const uint8_t* data, size_t len, size_t chunk = 1460);
+
+private:
+    uint16_t _port;
+    std::vector<AsyncWebHandler*> _handlers;
+    std::vector<std::unique_ptr<AsyncWebHandler>> _owned_handlers;
+    ArRequestHandlerFunction _catchAllHandler_onRequest;
+    ArUploadHandlerFunction _catchAllHandler_onUpload;
+    ArBodyHandlerFunction _catchAllHandler_onBody;
+
+    AsyncWebHandler* find_handler(AsyncWebServerRequest* request);
+};
+
+#endif
@@ -0,0 +1,82 @@
+/* Simulation shim: Arduino-ESP32 file system API
+ *
+ * Files live in memory, keyed by their absolute path.
+ */
+#ifndef ESP32_SIM_FS_H__
+#define ESP32_SIM_FS_H__
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "WString.h"
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode {
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+};
+
+using FileDataT = std::vector<uint8_t>;
+
+class File
+{
+public:
+    File() = default;
+    File(std::shared_ptr<FileDataT> data, const String& path, bool writable)
+        : _data{std::move(data)}, _path{path}, _writable{writable} {}
+
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const uint8_t* buf, size_t size);
+    int available() { return _data ? static_cast<int>(_data->size() - _pos) : 0; }
+    int read();
+    size_t read(uint8_t* buf, size_t size);
+    bool seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t position() const { return _pos; }
+    size_t size() const { return _data ? _data->size() : 0; }
+    void flush() {}
+    void close() { _data.reset(); }
+    const char* name() const { return _path.c_str(); }
+    bool isDirectory() const { return false; }
+    operator bool() const { return static_cast<bool>(_data); }
+
+private:
+    std::shared_ptr<FileDataT> _data;
+    String _path;
+    bool _writable = false;
+    size_t _pos = 0;
+};
+
+class FS
+{
+public:
+    virtual ~FS() = default;
+    File open(const char* path, const char* mode = FILE_READ);
+    File open(const String& path, const char* mode = FILE_READ) { return open(path.c_str(), mode); }
+    bool exists(const char* path) const { return _files.count(path) > 0; }
+    bool exists(const String& path) const { return exists(path.c_str()); }
+    bool remove(const char* path) { return _files.erase(path) > 0; }
+    bool remove(const String& path) { return remove(path.c_str()); }
+    bool rename(const char* path_from, const char* path_to);
+
+protected:
+    std::map<std::string, std::shared_ptr<FileDataT>> _files;
+};
+
+} // namespace fs
+
+using fs::FS;
+using fs::File;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+
+#endif
@@ -0,0 +1,67 @@
+/* Simulation shim: Arduino Print and HardwareSerial
+ *
+ * Output goes to stdout unless silenced with sim::serial_set_quiet().
+ */
+#ifndef ESP32_SIM_HARDWARESERIAL_H__
+#define ESP32_SIM_HARDWARESERIAL_H__
+
+#include <cstddef>
+#include <cstdint>
+#include "WString.h"
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class Print
+{
+public:
+    virtual ~Print() = default;
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    size_t write(const char* str) {
+        return str ? write(reinterpret_cast<const uint8_t*>(str), std::strlen(str)) : 0;
+    }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+    size_t print(const char* str) { return write(str); }
+    size_t print(const String& str) { return write(str.c_str()); }
+    size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+    size_t print(unsigned char value, int base = DEC) { return print(static_cast<unsigned long long>(value), base); }
+    size_t print(int value, int base = DEC) { return print(static_cast<long long>(value), base); }
+    size_t print(unsigned int value, int base = DEC) { return print(static_cast<unsigned long long>(value), base); }
+    size_t print(long value, int base = DEC) { return print(static_cast<long long>(value), base); }
+    size_t print(unsigned long value, int base = DEC) { return print(static_cast<unsigned long long>(value), base); }
+    size_t print(long long value, int base = DEC);
+    size_t print(unsigned long long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+
+    size_t println() { return write("\r\n"); }
+    template<typename T>
+    size_t println(const T& value) { size_t n = print(value); return n + println(); }
+    template<typename T>
+    size_t println(const T& value, int format) { size_t n = print(value, format); return n + println(); }
+};
+
+class HardwareSerial : public Print
+{
+public:
+    explicit HardwareSerial(int uart_nr) : _uart_nr{uart_nr} {}
+    void begin(unsigned long baud) { (void)baud; }
+    void end() {}
+    int available() { return 0; }
+    int read() { return -1; }
+    void flush() {}
+    using Print::write;
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+
+private:
+    int _uart_nr;
+};
+
+extern HardwareSerial Serial;
+
+#endif
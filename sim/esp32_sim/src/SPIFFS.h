@@ -0,0 +1,28 @@
+/* Simulation shim: SPIFFS file system, kept in memory
+ */
+#ifndef ESP32_SIM_SPIFFS_H__
+#define ESP32_SIM_SPIFFS_H__
+
+#include "FS.h"
+
+namespace fs {
+
+class SPIFFSFS : public FS
+{
+public:
+    bool begin(bool formatOnFail = false, const char* basePath = "/spiffs",
+               uint8_t maxOpenFiles = 10) { _mounted = true; return true; }
+    bool format() { _files.clear(); return true; }
+    size_t totalBytes() const { return 1378241; }
+    size_t usedBytes() const;
+    void end() { _mounted = false; }
+
+private:
+    bool _mounted = false;
+};
+
+} // namespace fs
+
+extern fs::SPIFFSFS SPIFFS;
+
+#endif
@@ -0,0 +1,54 @@
+#include <cstdlib>
+#include <cxxabi.h>
+
+#include "Ticker.h"
+
+std::string sim_ticker_name(const char* mangled_arg_type) {
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(mangled_arg_type, nullptr, nullptr, &status);
+    std::string name = "Ticker(";
+    name += status == 0 ? demangled : mangled_arg_type;
+    name += ")";
+    std::free(demangled);
+    return name;
+}
+
+Ticker::Ticker()
+    : _timer{nullptr}
+{}
+
+Ticker::~Ticker() {
+    detach();
+}
+
+void Ticker::_attach_ms(uint32_t milliseconds, bool repeat,
+                        callback_with_arg_t callback, void* arg,
+                        const char* name) {
+    esp_timer_create_args_t _timerConfig;
+    _timerConfig.arg = arg;
+    _timerConfig.callback = callback;
+    _timerConfig.dispatch_method = ESP_TIMER_TASK;
+    _timerConfig.name = name;
+    if (_timer) {
+        esp_timer_stop(_timer);
+        esp_timer_delete(_timer);
+    }
+    esp_timer_create(&_timerConfig, &_timer);
+    if (repeat) {
+        esp_timer_start_periodic(_timer, milliseconds * 1000ULL);
+    } else {
+        esp_timer_start_once(_timer, milliseconds * 1000ULL);
+    }
+}
+
+void Ticker::detach() {
+    if (_timer) {
+        esp_timer_stop(_timer);
+        esp_timer_delete(_timer);
+        _timer = nullptr;
+    }
+}
+
+bool Ticker::active() {
+    return _timer != nullptr;
+}
@@ -0,0 +1,83 @@
+/* Simulation shim: Arduino-ESP32 Ticker library
+ *
+ * Same interface as the ESP32 core library. Like the original, every
+ * attach() re-creates the underlying esp_timer.
+ */
+#ifndef ESP32_SIM_TICKER_H__
+#define ESP32_SIM_TICKER_H__
+
+#include <cstdint>
+#include <string>
+#include <typeinfo>
+#include "esp_timer.h"
+
+// Simulation: Readable timer name from the callback argument type,
+// e.g. "Ticker(MelodyPlayer*)", used in sim::timer_stats()
+std::string sim_ticker_name(const char* mangled_arg_type);
+
+class Ticker
+{
+public:
+    Ticker();
+    ~Ticker();
+    typedef void (*callback_t)(void);
+    typedef void (*callback_with_arg_t)(void*);
+
+    void attach(float seconds, callback_t callback) {
+        _attach_ms(seconds * 1000, true, reinterpret_cast<callback_with_arg_t>(callback), nullptr, "Ticker");
+    }
+
+    void attach_ms(uint32_t milliseconds, callback_t callback) {
+        _attach_ms(milliseconds, true, reinterpret_cast<callback_with_arg_t>(callback), nullptr, "Ticker");
+    }
+
+    template<typename TArg>
+    void attach(float seconds, void (*callback)(TArg), TArg arg) {
+        static_assert(sizeof(TArg) <= sizeof(void*), "attach() callback argument size must be <= pointer size");
+        _attach_ms(seconds * 1000, true, reinterpret_cast<callback_with_arg_t>(callback), (void*)arg, timer_name<TArg>());
+    }
+
+    template<typename TArg>
+    void attach_ms(uint32_t milliseconds, void (*callback)(TArg), TArg arg) {
+        static_assert(sizeof(TArg) <= sizeof(void*), "attach_ms() callback argument size must be <= pointer size");
+        _attach_ms(milliseconds, true, reinterpret_cast<callback_with_arg_t>(callback), (void*)arg, timer_name<TArg>());
+    }
+
+    void once(float seconds, callback_t callback) {
+        _attach_ms(seconds * 1000, false, reinterpret_cast<callback_with_arg_t>(callback), nullptr, "Ticker");
+    }
+
+    void once_ms(uint32_t milliseconds, callback_t callback) {
+        _attach_ms(milliseconds, false, reinterpret_cast<callback_with_arg_t>(callback), nullptr, "Ticker");
+    }
+
+    template<typename TArg>
+    void once(float seconds, void (*callback)(TArg), TArg arg) {
+        static_assert(sizeof(TArg) <= sizeof(void*), "once() callback argument size must be <= pointer size");
+        _attach_ms(seconds * 1000, false, reinterpret_cast<callback_with_arg_t>(callback), (void*)arg, timer_name<TArg>());
+    }
+
+    template<typename TArg>
+    void once_ms(uint32_t milliseconds, void (*callback)(TArg), TArg arg) {
+        static_assert(sizeof(TArg) <= sizeof(void*), "once_ms() callback argument size must be <= pointer size");
+        _attach_ms(milliseconds, false, reinterpret_cast<callback_with_arg_t>(callback), (void*)arg, timer_name<TArg>());
+    }
+
+    void detach();
+    bool active();
+
+protected:
+    void _attach_ms(uint32_t milliseconds, bool repeat, callback_with_arg_t callback, void* arg,
+                    const char* name);
+
+    template<typename TArg>
+    static const char* timer_name() {
+        static const std::string name = sim_ticker_name(typeid(TArg).name());
+        return name.c_str();
+    }
+
+protected:
+    esp_timer_handle_t _timer;
+};
+
+#endif
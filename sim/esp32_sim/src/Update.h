@@ -0,0 +1,30 @@
+/* Simulation shim: OTA firmware update, the image is discarded
+ */
+#ifndef ESP32_SIM_UPDATE_H__
+#define ESP32_SIM_UPDATE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include "HardwareSerial.h"
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+
+class UpdateClass
+{
+public:
+    bool begin(size_t size = UPDATE_SIZE_UNKNOWN) { _size = size; _progress = 0; _error = false; return true; }
+    size_t write(uint8_t* data, size_t len) { _progress += len; return len; }
+    bool end(bool evenIfRemaining = false) { return !_error; }
+    bool hasError() const { return _error; }
+    void printError(Print& out) { out.println(_error ? "Update error" : "No Error"); }
+    size_t progress() const { return _progress; }
+
+private:
+    size_t _size = 0;
+    size_t _progress = 0;
+    bool _error = false;
+};
+
+extern UpdateClass Update;
+
+#endif
@@ -0,0 +1,94 @@
+/* Simulation shim: Arduino String class
+ *
+ * Backed by std::string. Only the subset of the Arduino API used by this
+ * project is provided.
+ */
+#ifndef ESP32_SIM_WSTRING_H__
+#define ESP32_SIM_WSTRING_H__
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+class String
+{
+public:
+    String() = default;
+    String(const char* cstr) : s{cstr ? cstr : ""} {}
+    String(const char* cstr, size_t len) : s{cstr, len} {}
+    String(const std::string& str) : s{str} {}
+    explicit String(char c) : s(1, c) {}
+    explicit String(int value, unsigned char base = 10) : s{format(value, base)} {}
+    explicit String(unsigned int value, unsigned char base = 10) : s{format(value, base)} {}
+    explicit String(long value, unsigned char base = 10) : s{format(value, base)} {}
+    explicit String(unsigned long value, unsigned char base = 10) : s{format(value, base)} {}
+    explicit String(float value, unsigned char decimal_places = 2)
+        : s{format(static_cast<double>(value), decimal_places)} {}
+    explicit String(double value, unsigned char decimal_places = 2)
+        : s{format(value, decimal_places)} {}
+
+    const char* c_str() const { return s.c_str(); }
+    unsigned int length() const { return s.length(); }
+    bool reserve(unsigned int size) { s.reserve(size); return true; }
+    bool isEmpty() const { return s.empty(); }
+
+    char charAt(unsigned int index) const { return index < s.length() ? s[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+
+    bool concat(const String& str) { s += str.s; return true; }
+    bool concat(const char* cstr) { s += cstr ? cstr : ""; return true; }
+    bool concat(const char* cstr, unsigned int length) { s.append(cstr, length); return true; }
+    bool concat(char c) { s += c; return true; }
+    String& operator+=(const String& rhs) { concat(rhs); return *this; }
+    String& operator+=(const char* rhs) { concat(rhs); return *this; }
+    String& operator+=(char rhs) { concat(rhs); return *this; }
+
+    bool equals(const String& rhs) const { return s == rhs.s; }
+    bool equals(const char* cstr) const { return s == (cstr ? cstr : ""); }
+    bool operator==(const String& rhs) const { return s == rhs.s; }
+    bool operator==(const char* cstr) const { return equals(cstr); }
+    bool operator!=(const String& rhs) const { return s != rhs.s; }
+    bool operator!=(const char* cstr) const { return !equals(cstr); }
+    bool operator<(const String& rhs) const { return s < rhs.s; }
+    bool startsWith(const String& prefix) const { return s.compare(0, prefix.s.length(), prefix.s) == 0; }
+    bool endsWith(const String& suffix) const {
+        return s.length() >= suffix.s.length()
+               && s.compare(s.length() - suffix.s.length(), suffix.s.length(), suffix.s) == 0;
+    }
+
+    int indexOf(char c, unsigned int from = 0) const { return npos_to_int(s.find(c, from)); }
+    int indexOf(const String& str, unsigned int from = 0) const { return npos_to_int(s.find(str.s, from)); }
+    String substring(unsigned int from) const { return from < s.length() ? String{s.substr(from)} : String{}; }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to) { unsigned int tmp = from; from = to; to = tmp; }
+        return from < s.length() ? String{s.substr(from, to - from)} : String{};
+    }
+
+    long toInt() const { return std::strtol(s.c_str(), nullptr, 10); }
+    float toFloat() const { return std::strtof(s.c_str(), nullptr); }
+    double toDouble() const { return std::strtod(s.c_str(), nullptr); }
+
+    friend String operator+(const String& lhs, const String& rhs) { return String{lhs.s + rhs.s}; }
+    friend String operator+(const String& lhs, const char* rhs) { return String{lhs.s + (rhs ? rhs : "")}; }
+    friend String operator+(const char* lhs, const String& rhs) { return String{(lhs ? lhs : "") + rhs.s}; }
+
+private:
+    std::string s;
+
+    static int npos_to_int(size_t pos) { return pos == std::string::npos ? -1 : static_cast<int>(pos); }
+    static std::string format(long value, unsigned char base);
+    static std::string format(unsigned long value, unsigned char base);
+    static std::string format(int value, unsigned char base) { return format(static_cast<long>(value), base); }
+    static std::string format(unsigned int value, unsigned char base) {
+        return format(static_cast<unsigned long>(value), base);
+    }
+    static std::string format(double value, unsigned char decimal_places);
+};
+
+// Arduino "flash string" helpers, RAM and flash share one address space here
+class __FlashStringHelper;
+#define F(string_literal) (string_literal)
+#define PSTR(s) (s)
+#define FPSTR(p) (p)
+
+#endif
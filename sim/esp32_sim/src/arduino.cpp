@@ -0,0 +1,249 @@
+/* Host simulation: Arduino core, Serial console and heap accounting
+ */
+#include <cstdarg>
+#include <cstdio>
+#include <new>
+#include <random>
+#include <malloc.h>
+
+#include "Arduino.h"
+#include "sim.hpp"
+
+namespace {
+
+bool s_serial_quiet = false;
+uint64_t s_serial_bytes = 0;
+bool s_restart_requested = false;
+std::minstd_rand s_random{1};
+// See sim::preempt_micros_call()
+uint32_t s_micros_calls_to_preemption = 0;
+uint64_t s_preemption_us = 0;
+
+uint64_t s_heap_alloc_count = 0;
+uint64_t s_heap_alloc_bytes = 0;
+size_t s_heap_live_bytes = 0;
+size_t s_heap_peak_bytes = 0;
+
+void* counted_alloc(size_t size) {
+    void* p = std::malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc{};
+    }
+    s_heap_alloc_count++;
+    s_heap_alloc_bytes += size;
+    s_heap_live_bytes += malloc_usable_size(p);
+    s_heap_peak_bytes = std::max(s_heap_peak_bytes, s_heap_live_bytes);
+    return p;
+}
+
+void counted_free(void* p) {
+    if (p != nullptr) {
+        s_heap_live_bytes -= malloc_usable_size(p);
+        std::free(p);
+    }
+}
+
+} // namespace
+
+/////////// Heap accounting
+
+void* operator new(size_t size) { return counted_alloc(size); }
+void* operator new[](size_t size) { return counted_alloc(size); }
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete[](void* p) noexcept { counted_free(p); }
+void operator delete(void* p, size_t) noexcept { counted_free(p); }
+void operator delete[](void* p, size_t) noexcept { counted_free(p); }
+
+/////////// Arduino core
+
+HardwareSerial Serial{0};
+EspClass ESP;
+
+unsigned long millis() {
+    return static_cast<unsigned long>(sim::now_us() / 1000);
+}
+
+unsigned long micros() {
+    if (s_micros_calls_to_preemption > 0 && --s_micros_calls_to_preemption == 0) {
+        sim::block_for(s_preemption_us);
+    }
+    return static_cast<unsigned long>(sim::now_us());
+}
+
+void delay(uint32_t ms) {
+    sim::block_for(ms * 1000ULL);
+}
+
+void delayMicroseconds(uint32_t us) {
+    sim::block_for(us);
+}
+
+long random(long howbig) {
+    if (howbig <= 0) {
+        return 0;
+    }
+    return static_cast<long>(s_random() % static_cast<unsigned long>(howbig));
+}
+
+long random(long howsmall, long howbig) {
+    if (howsmall >= howbig) {
+        return howsmall;
+    }
+    return howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long seed) {
+    s_random.seed(seed);
+}
+
+uint32_t EspClass::getFreeHeap() {
+    return static_cast<uint32_t>(sim::heap_size - std::min(sim::heap_size, s_heap_live_bytes));
+}
+
+uint32_t EspClass::getHeapSize() {
+    return static_cast<uint32_t>(sim::heap_size);
+}
+
+uint32_t EspClass::getFreeSketchSpace() {
+    return 0x1E0000;
+}
+
+void EspClass::restart() {
+    s_restart_requested = true;
+}
+
+/////////// String
+
+std::string String::format(long value, unsigned char base) {
+    if (value < 0 && base == 10) {
+        return "-" + format(static_cast<unsigned long>(-value), base);
+    }
+    return format(static_cast<unsigned long>(value), base);
+}
+
+std::string String::format(unsigned long value, unsigned char base) {
+    if (base < 2 || base > 36) {
+        base = 10;
+    }
+    char buf[8 * sizeof(value) + 1];
+    char* p = buf + sizeof(buf);
+    do {
+        const unsigned digit = value % base;
+        *--p = static_cast<char>(digit < 10 ? '0' + digit : 'A' + digit - 10);
+        value /= base;
+    } while (value);
+    return std::string(p, buf + sizeof(buf) - p);
+}
+
+std::string String::format(double value, unsigned char decimal_places) {
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%.*f", decimal_places, value);
+    return buf;
+}
+
+/////////// Print, Serial
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) {
+        n += write(*buffer++);
+    }
+    return n;
+}
+
+size_t Print::printf(const char* format, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    const int len = std::vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len <= 0) {
+        return 0;
+    }
+    return write(reinterpret_cast<const uint8_t*>(buf),
+                 std::min(static_cast<size_t>(len), sizeof(buf) - 1));
+}
+
+size_t Print::print(long long value, int base) {
+    if (value < 0 && base == DEC) {
+        return print('-') + print(static_cast<unsigned long long>(-value), base);
+    }
+    return print(static_cast<unsigned long long>(value), base);
+}
+
+// Formats into a stack buffer, printing numbers never allocates
+size_t Print::print(unsigned long long value, int base) {
+    if (base < 2 || base > 36) {
+        base = DEC;
+    }
+    char buf[8 * sizeof(value) + 1];
+    char* p = buf + sizeof(buf);
+    *--p = '\0';
+    do {
+        const unsigned digit = value % base;
+        *--p = static_cast<char>(digit < 10 ? '0' + digit : 'A' + digit - 10);
+        value /= base;
+    } while (value);
+    return write(p);
+}
+
+size_t Print::print(double value, int digits) {
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%.*f", digits, value);
+    return write(buf);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+    s_serial_bytes += size;
+    if (!s_serial_quiet) {
+        std::fwrite(buffer, 1, size, stdout);
+    }
+    return size;
+}
+
+/////////// Simulation control
+
+namespace sim {
+
+uint64_t heap_alloc_count() {
+    return s_heap_alloc_count;
+}
+
+uint64_t heap_alloc_bytes() {
+    return s_heap_alloc_bytes;
+}
+
+size_t heap_live_bytes() {
+    return s_heap_live_bytes;
+}
+
+size_t heap_peak_bytes() {
+    return s_heap_peak_bytes;
+}
+
+void reset_heap_peak() {
+    s_heap_peak_bytes = s_heap_live_bytes;
+}
+
+void serial_set_quiet(bool quiet) {
+    s_serial_quiet = quiet;
+}
+
+uint64_t serial_bytes_written() {
+    return s_serial_bytes;
+}
+
+bool restart_requested() {
+    return s_restart_requested;
+}
+
+void preempt_micros_call(uint32_t n_calls, uint64_t duration_us) {
+    s_micros_calls_to_preemption = n_calls;
+    s_preemption_us = duration_us;
+}
+
+} // namespace sim
@@ -0,0 +1,614 @@
+/* Host simulation: request dispatch, responses and Server-Sent Events
+ */
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "ESPAsyncWebServer.h"
+#include "Update.h"
+
+UpdateClass Update;
+
+namespace {
+
+// Same placeholder rules as the library: %NAME% with NAME up to
+// 32 characters, "%%" yields a literal percent sign.
+constexpr size_t template_placeholder_max_size = 32;
+
+String process_template(const char* content, size_t len,
+                        const AwsTemplateProcessor& callback) {
+    String result;
+    result.reserve(len);
+    size_t pos = 0;
+    while (pos < len) {
+        const char* start = static_cast<const char*>(
+            std::memchr(content + pos, '%', len - pos));
+        if (start == nullptr) {
+            result.concat(String{content + pos, len - pos});
+            break;
+        }
+        const size_t start_pos = start - content;
+        result.concat(String{content + pos, start_pos - pos});
+        const size_t search_len = std::min(len - start_pos - 1,
+                                           template_placeholder_max_size + 1);
+        const char* end = static_cast<const char*>(
+            std::memchr(start + 1, '%', search_len));
+        if (end == nullptr) {
+            result.concat('%');
+            pos = start_pos + 1;
+        } else if (end == start + 1) {
+            result.concat('%');
+            pos = start_pos + 2;
+        } else {
+            result.concat(callback(String{start + 1,
+                                          static_cast<size_t>(end - start - 1)}));
+            pos = end - content + 1;
+        }
+    }
+    return result;
+}
+
+void parse_query(const String& query,
+                 std::vector<AsyncWebParameter*>& params) {
+    size_t pos = 0;
+    const size_t len = query.length();
+    while (pos < len) {
+        int amp = query.indexOf('&', pos);
+        const size_t end = amp < 0 ? len : static_cast<size_t>(amp);
+        const String pair = query.substring(pos, end);
+        if (pair.length() > 0) {
+            const int eq = pair.indexOf('=');
+            if (eq < 0) {
+                params.push_back(new AsyncWebParameter{pair, String{}});
+            } else {
+                params.push_back(new AsyncWebParameter{
+                    pair.substring(0, eq), pair.substring(eq + 1)});
+            }
+        }
+        pos = end + 1;
+    }
+}
+
+} // namespace
+
+/////////// AsyncWebServerResponse
+
+const String& AsyncProgmemResponse::content() const {
+    if (!_filled) {
+        _filled = true;
+        const_cast<String&>(_content).concat(reinterpret_cast<const char*>(_data),
+                                             _length);
+    }
+    return _content;
+}
+
+// Filled in TCP segment sized chunks, like by the library
+const String& AsyncCallbackResponse::content() const {
+    if (!_filled) {
+        _filled = true;
+        auto& content = const_cast<String&>(_content);
+        uint8_t buffer[1460];
+        size_t index = 0;
+        while (index < _length) {
+            const size_t n = _filler(buffer, std::min(sizeof(buffer), _length - index), index);
+            if (n == 0) {
+                break;
+            }
+            content.concat(reinterpret_cast<const char*>(buffer), n);
+            index += n;
+        }
+    }
+    return _content;
+}
+
+const String* AsyncWebServerResponse::header(const char* name) const {
+    for (const auto& h : _headers) {
+        if (h.first == name) {
+            return &h.second;
+        }
+    }
+    return nullptr;
+}
+
+/////////// AsyncWebServerRequest
+
+AsyncWebServerRequest::AsyncWebServerRequest(AsyncWebServer* server,
+                                             WebRequestMethod method,
+                                             const String& url)
+    : _tempObject{nullptr}
+    , _server{server}
+    , _method{static_cast<WebRequestMethodComposite>(method)}
+    , _host{"192.168.4.1"}
+    , _contentLength{0}
+    , _response{nullptr}
+{
+    const int query_start = url.indexOf('?');
+    if (query_start < 0) {
+        _url = url;
+    } else {
+        _url = url.substring(0, query_start);
+        parse_query(url.substring(query_start + 1), _params);
+    }
+}
+
+AsyncWebServerRequest::~AsyncWebServerRequest() {
+    for (auto p : _params) {
+        delete p;
+    }
+    for (auto h : _headers) {
+        delete h;
+    }
+    delete _response;
+    free(_tempObject);
+}
+
+const AsyncWebParameter* AsyncWebServerRequest::getParam(size_t num) const {
+    return num < _params.size() ? _params[num] : nullptr;
+}
+
+bool AsyncWebServerRequest::hasParam(const String& name, bool post, bool file) const {
+    return getParam(name, post, file) != nullptr;
+}
+
+const AsyncWebParameter* AsyncWebServerRequest::getParam(const String& name,
+                                                         bool post, bool file) const {
+    for (auto p : _params) {
+        if (p->name() == name && p->isPost() == post && p->isFile() == file) {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+const AsyncWebHeader* AsyncWebServerRequest::getHeader(const String& name) const {
+    for (auto h : _headers) {
+        if (strcasecmp(h->name().c_str(), name.c_str()) == 0) {
+            return h;
+        }
+    }
+    return nullptr;
+}
+
+void AsyncWebServerRequest::addHeader(const String& name, const String& value) {
+    _headers.push_back(new AsyncWebHeader{name, value});
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse* response) {
+    delete _response;
+    _response = response;
+}
+
+void AsyncWebServerRequest::send(int code, const String& contentType,
+                                 const String& content) {
+    send(beginResponse(code, contentType, content));
+}
+
+void AsyncWebServerRequest::send_P(int code, const String& contentType,
+                                   const uint8_t* content, size_t len,
+                                   AwsTemplateProcessor callback) {
+    send(beginResponse_P(code, contentType, content, len, callback));
+}
+
+void AsyncWebServerRequest::send_P(int code, const String& contentType,
+                                   const char* content,
+                                   AwsTemplateProcessor callback) {
+    send(beginResponse_P(code, contentType, content, callback));
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse(
+        int code, const String& contentType, const String& content) {
+    return new AsyncWebServerResponse{code, contentType, content};
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse_P(
+        int code, const String& contentType, const uint8_t* content,
+        size_t len, AwsTemplateProcessor callback) {
+    if (!callback) {
+        return new AsyncProgmemResponse{code, contentType, content, len};
+    }
+    const char* text = reinterpret_cast<const char*>(content);
+    return new AsyncWebServerResponse{code, contentType,
+                                      process_template(text, len, callback)};
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse_P(
+        int code, const String& contentType, const char* content,
+        AwsTemplateProcessor callback) {
+    return beginResponse_P(code, contentType,
+                           reinterpret_cast<const uint8_t*>(content),
+                           std::strlen(content), callback);
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse(
+        const String& contentType, size_t len, AwsResponseFiller callback) {
+    return new AsyncCallbackResponse{contentType, len, std::move(callback)};
+}
+
+AsyncResponseStream* AsyncWebServerRequest::beginResponseStream(
+        const String& contentType, size_t bufferSize) {
+    return new AsyncResponseStream{contentType};
+}
+
+/////////// Handlers
+
+bool AsyncCallbackWebHandler::canHandle(AsyncWebServerRequest* request) {
+    if (!_onRequest || !(_method & request->method())) {
+        return false;
+    }
+    if (_uri.length() && _uri.endsWith("*")) {
+        return request->url().startsWith(_uri.substring(0, _uri.length() - 1));
+    }
+    return _uri.length() == 0 || request->url() == _uri;
+}
+
+void AsyncCallbackWebHandler::handleRequest(AsyncWebServerRequest* request) {
+    if (_onRequest) {
+        _onRequest(request);
+    } else {
+        request->send(500);
+    }
+}
+
+void AsyncCallbackWebHandler::handleUpload(AsyncWebServerRequest* request,
+        const String& filename, size_t index, uint8_t* data, size_t len,
+        bool final) {
+    if (_onUpload) {
+        _onUpload(request, filename, index, data, len, final);
+    }
+}
+
+void AsyncCallbackWebHandler::handleBody(AsyncWebServerRequest* request,
+        uint8_t* data, size_t len, size_t index, size_t total) {
+    if (_onBody) {
+        _onBody(request, data, len, index, total);
+    }
+}
+
+bool AsyncStaticWebHandler::canHandle(AsyncWebServerRequest* request) {
+    return (request->method() & HTTP_GET) && request->url().startsWith(_uri);
+}
+
+void AsyncStaticWebHandler::handleRequest(AsyncWebServerRequest* request) {
+    String path = _path + request->url().substring(_uri.length());
+    if (path.endsWith("/")) {
+        path += _default_file;
+    }
+    File file = _fs->open(path);
+    if (!file) {
+        request->send(404);
+        return;
+    }
+    std::vector<uint8_t> content(file.size());
+    file.read(content.data(), content.size());
+    AsyncWebServerResponse* response = request->beginResponse_P(
+        200, "text/html", content.data(), content.size(), _callback);
+    if (_cache_control.length()) {
+        response->addHeader("Cache-Control", _cache_control);
+    }
+    request->send(response);
+}
+
+/////////// Server-Sent Events
+
+// The client object stays until sim_disconnect(), for inspection
+void AsyncEventSourceClient::close() {
+    if (!_connected) {
+        return;
+    }
+    _connected = false;
+    _queued = 0;
+    _queued_bytes = 0;
+    if (_server->_disconnectcb) {
+        _server->_disconnectcb(this);
+    }
+}
+
+void AsyncEventSourceClient::write(const char* message, size_t len) {
+    if (!_connected) {
+        return;
+    }
+    _messages++;
+    _bytes += len;
+    _last_message = String{message, len};
+    if (_stalled) {
+        ++_queued;
+        _queued_bytes += len;
+        _peak_queued_bytes = std::max(_peak_queued_bytes, _queued_bytes);
+    }
+}
+
+void AsyncEventSourceClient::sim_set_stalled(bool stalled) {
+    _stalled = stalled;
+    if (!stalled) {
+        _queued = 0;
+        _queued_bytes = 0;
+    }
+}
+
+void AsyncEventSourceClient::send(const char* message, const char* event,
+                                  uint32_t id, uint32_t reconnect) {
+    // Wire format as generated by the library
+    String ev;
+    if (reconnect) {
+        ev += "retry: ";
+        ev += String(reconnect);
+        ev += "\r\n";
+    }
+    if (id) {
+        ev += "id: ";
+        ev += String(id);
+        ev += "\r\n";
+    }
+    if (event != nullptr) {
+        ev += "event: ";
+        ev += event;
+        ev += "\r\n";
+    }
+    if (message != nullptr) {
+        ev += "data: ";
+        ev += message;
+        ev += "\r\n";
+    }
+    ev += "\r\n";
+    write(ev.c_str(), ev.length());
+}
+
+AsyncEventSource::~AsyncEventSource() {
+    // The owner of the callbacks may be gone already
+    _disconnectcb = nullptr;
+    close();
+}
+
+void AsyncEventSource::close() {
+    for (auto& client : _clients) {
+        client->close();
+    }
+}
+
+void AsyncEventSource::send(const char* message, const char* event,
+                            uint32_t id, uint32_t reconnect) {
+    for (auto& client : _clients) {
+        if (client->connected()) {
+            client->send(message, event, id, reconnect);
+        }
+    }
+}
+
+size_t AsyncEventSource::count() const {
+    size_t n = 0;
+    for (const auto& client : _clients) {
+        n += client->connected() ? 1 : 0;
+    }
+    return n;
+}
+
+AsyncEventSourceClient* AsyncEventSource::sim_connect(uint32_t lastId) {
+    _clients.emplace_back(new AsyncEventSourceClient{this, lastId});
+    AsyncEventSourceClient* client = _clients.back().get();
+    if (_connectcb) {
+        _connectcb(client);
+    }
+    return client;
+}
+
+void AsyncEventSource::sim_disconnect(AsyncEventSourceClient* client) {
+    client->close();
+    _clients.remove_if([client](const std::unique_ptr<AsyncEventSourceClient>& c) {
+        return c.get() == client;
+    });
+}
+
+/////////// WebSocket
+
+void AsyncWebSocketClient::close(uint16_t code, const char* message) {
+    if (!_connected) {
+        return;
+    }
+    _connected = false;
+    if (_server->_eventHandler) {
+        _server->_eventHandler(_server, this, WS_EVT_DISCONNECT, nullptr, nullptr, 0);
+    }
+}
+
+void AsyncWebSocketClient::text(const char* message, size_t len) {
+    if (!_connected) {
+        return;
+    }
+    _messages++;
+    _last_message = String{message, len};
+}
+
+void AsyncWebSocketClient::binary(const uint8_t* message, size_t len) {
+    text(reinterpret_cast<const char*>(message), len);
+}
+
+AsyncWebSocket::~AsyncWebSocket() {
+    // The owner of the handler may be gone already
+    _eventHandler = nullptr;
+    for (auto& client : _clients) {
+        client->close();
+    }
+}
+
+size_t AsyncWebSocket::count() const {
+    size_t n = 0;
+    for (const auto& client : _clients) {
+        n += client->sim_connected() ? 1 : 0;
+    }
+    return n;
+}
+
+void AsyncWebSocket::textAll(const char* message, size_t len) {
+    for (auto& client : _clients) {
+        client->text(message, len);
+    }
+}
+
+void AsyncWebSocket::binaryAll(const uint8_t* message, size_t len) {
+    for (auto& client : _clients) {
+        client->binary(message, len);
+    }
+}
+
+AsyncWebSocketClient* AsyncWebSocket::sim_connect() {
+    _clients.emplace_back(new AsyncWebSocketClient{this, _next_id++});
+    AsyncWebSocketClient* client = _clients.back().get();
+    if (_eventHandler) {
+        _eventHandler(this, client, WS_EVT_CONNECT, nullptr, nullptr, 0);
+    }
+    return client;
+}
+
+void AsyncWebSocket::sim_receive(AsyncWebSocketClient* client, const uint8_t* data,
+                                 size_t len, bool binary) {
+    if (!client->sim_connected() || !_eventHandler) {
+        return;
+    }
+    AwsFrameInfo info{};
+    info.message_opcode = binary ? WS_BINARY : WS_TEXT;
+    info.opcode = info.message_opcode;
+    info.final = 1;
+    info.len = len;
+    info.index = 0;
+    // The library passes its receive buffer, which handlers may modify
+    _rx_buffer.assign(data, data + len);
+    _eventHandler(this, client, WS_EVT_DATA, &info, _rx_buffer.data(), len);
+}
+
+void AsyncWebSocket::sim_disconnect(AsyncWebSocketClient* client) {
+    client->close();
+    _clients.remove_if([client](const std::unique_ptr<AsyncWebSocketClient>& c) {
+        return c.get() == client;
+    });
+}
+
+/////////// AsyncWebServer
+
+AsyncWebServer::~AsyncWebServer() {
+    reset();
+}
+
+void AsyncWebServer::reset() {
+    _handlers.clear();
+    _owned_handlers.clear();
+    _catchAllHandler_onRequest = nullptr;
+    _catchAllHandler_onUpload = nullptr;
+    _catchAllHandler_onBody = nullptr;
+}
+
+AsyncWebHandler& AsyncWebServer::addHandler(AsyncWebHandler* handler) {
+    _handlers.push_back(handler);
+    return *handler;
+}
+
+bool AsyncWebServer::removeHandler(AsyncWebHandler* handler) {
+    for (auto it = _handlers.begin(); it != _handlers.end(); ++it) {
+        if (*it == handler) {
+            _handlers.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+AsyncCallbackWebHandler& AsyncWebServer::on(const char* uri,
+        ArRequestHandlerFunction onRequest) {
+    return on(uri, HTTP_ANY, onRequest);
+}
+
+AsyncCallbackWebHandler& AsyncWebServer::on(const char* uri,
+        WebRequestMethodComposite method, ArRequestHandlerFunction onRequest) {
+    return on(uri, method, onRequest, nullptr, nullptr);
+}
+
+AsyncCallbackWebHandler& AsyncWebServer::on(const char* uri,
+        WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+        ArUploadHandlerFunction onUpload) {
+    return on(uri, method, onRequest, onUpload, nullptr);
+}
+
+AsyncCallbackWebHandler& AsyncWebServer::on(const char* uri,
+        WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+        ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody) {
+    auto handler = new AsyncCallbackWebHandler{uri, method, onRequest,
+                                               onUpload, onBody};
+    _owned_handlers.emplace_back(handler);
+    addHandler(handler);
+    return *handler;
+}
+
+AsyncStaticWebHandler& AsyncWebServer::serveStatic(const char* uri, fs::FS& fs,
+        const char* path, const char* cache_control) {
+    auto handler = new AsyncStaticWebHandler{uri, fs, path, cache_control};
+    _owned_handlers.emplace_back(handler);
+    addHandler(handler);
+    return *handler;
+}
+
+AsyncWebHandler* AsyncWebServer::find_handler(AsyncWebServerRequest* request) {
+    for (auto handler : _handlers) {
+        if (handler->canHandle(request)) {
+            return handler;
+        }
+    }
+    return nullptr;
+}
+
+std::unique_ptr<AsyncWebServerRequest> AsyncWebServer::sim_request(
+        WebRequestMethod method, const char* url,
+        std::vector<std::pair<String, String>> headers,
+        const uint8_t* body, size_t body_len, size_t body_chunk) {
+    std::unique_ptr<AsyncWebServerRequest> request{
+        new AsyncWebServerRequest{this, method, url}};
+    for (const auto& h : headers) {
+        request->addHeader(h.first, h.second);
+    }
+    request->sim_set_content_length(body_len);
+    AsyncWebHandler* handler = find_handler(request.get());
+    for (size_t index = 0; index < body_len; index += body_chunk) {
+        const size_t len = std::min(body_chunk, body_len - index);
+        uint8_t* data = const_cast<uint8_t*>(body + index);
+        if (handler) {
+            handler->handleBody(request.get(), data, len, index, body_len);
+        } else if (_catchAllHandler_onBody) {
+            _catchAllHandler_onBody(request.get(), data, len, index, body_len);
+        }
+    }
+    if (handler) {
+        handler->handleRequest(request.get());
+    } else if (_catchAllHandler_onRequest) {
+        _catchAllHandler_onRequest(request.get());
+    } else {
+        request->send(404);
+    }
+    return request;
+}
+
+std::unique_ptr<AsyncWebServerRequest> AsyncWebServer::sim_upload(
+        const char* url, const char* filename,
+        const uint8_t* data, size_t len, size_t chunk) {
+    std::unique_ptr<AsyncWebServerRequest> request{
+        new AsyncWebServerRequest{this, HTTP_POST, url}};
+    AsyncWebHandler* handler = find_handler(request.get());
+    const String name{filename};
+    size_t index = 0;
+    do {
+        const size_t n = std::min(chunk, len - index);
+        uint8_t* chunk_data = const_cast<uint8_t*>(data + index);
+        const bool final = index + n >= len;
+        if (handler) {
+            handler->handleUpload(request.get(), name, index, chunk_data, n, final);
+        } else if (_catchAllHandler_onUpload) {
+            _catchAllHandler_onUpload(request.get(), name, index, chunk_data, n, final);
+        }
+        index += n;
+    } while (index < len);
+    if (handler) {
+        handler->handleRequest(request.get());
+    } else if (_catchAllHandler_onRequest) {
+        _catchAllHandler_onRequest(request.get());
+    } else {
+        request->send(404);
+    }
+    return request;
+}
@@ -0,0 +1,71 @@
+/* Simulation shim: ESP-IDF touch pad driver
+ *
+ * Filtered values are set by the simulation via sim::touch_set_value().
+ */
+#ifndef ESP32_SIM_DRIVER_TOUCH_PAD_H__
+#define ESP32_SIM_DRIVER_TOUCH_PAD_H__
+
+#include <cstdint>
+#include "esp_err.h"
+
+typedef enum {
+    TOUCH_PAD_NUM0 = 0,
+    TOUCH_PAD_NUM1,
+    TOUCH_PAD_NUM2,
+    TOUCH_PAD_NUM3,
+    TOUCH_PAD_NUM4,
+    TOUCH_PAD_NUM5,
+    TOUCH_PAD_NUM6,
+    TOUCH_PAD_NUM7,
+    TOUCH_PAD_NUM8,
+    TOUCH_PAD_NUM9,
+    TOUCH_PAD_MAX,
+} touch_pad_t;
+
+typedef enum {
+    TOUCH_HVOLT_KEEP = -1,
+    TOUCH_HVOLT_2V4 = 0,
+    TOUCH_HVOLT_2V5,
+    TOUCH_HVOLT_2V6,
+    TOUCH_HVOLT_2V7,
+    TOUCH_HVOLT_MAX,
+} touch_high_volt_t;
+
+typedef enum {
+    TOUCH_LVOLT_KEEP = -1,
+    TOUCH_LVOLT_0V5 = 0,
+    TOUCH_LVOLT_0V6,
+    TOUCH_LVOLT_0V7,
+    TOUCH_LVOLT_0V8,
+    TOUCH_LVOLT_MAX,
+} touch_low_volt_t;
+
+typedef enum {
+    TOUCH_HVOLT_ATTEN_KEEP = -1,
+    TOUCH_HVOLT_ATTEN_1V5 = 0,
+    TOUCH_HVOLT_ATTEN_1V,
+    TOUCH_HVOLT_ATTEN_0V5,
+    TOUCH_HVOLT_ATTEN_0V,
+    TOUCH_HVOLT_ATTEN_MAX,
+} touch_volt_atten_t;
+
+typedef enum {
+    TOUCH_FSM_MODE_TIMER = 0,
+    TOUCH_FSM_MODE_SW,
+    TOUCH_FSM_MODE_MAX,
+} touch_fsm_mode_t;
+
+typedef void (*filter_cb_t)(uint16_t* raw_value, uint16_t* filtered_value);
+
+esp_err_t touch_pad_init();
+esp_err_t touch_pad_deinit();
+esp_err_t touch_pad_set_fsm_mode(touch_fsm_mode_t mode);
+esp_err_t touch_pad_set_voltage(touch_high_volt_t refh, touch_low_volt_t refl,
+                                touch_volt_atten_t atten);
+esp_err_t touch_pad_config(touch_pad_t touch_num, uint16_t threshold);
+esp_err_t touch_pad_filter_start(uint32_t filter_period_ms);
+esp_err_t touch_pad_filter_stop();
+esp_err_t touch_pad_set_filter_read_cb(filter_cb_t read_cb);
+esp_err_t touch_pad_read_filtered(touch_pad_t touch_num, uint16_t* touch_value);
+
+#endif
@@ -0,0 +1,25 @@
+/* Simulation shim: Arduino-ESP32 LEDC (PWM) HAL
+ *
+ * The channel and GPIO matrix state is kept in a model which can be
+ * inspected through sim::ledc_channel() and sim::ledc_pin_channel().
+ */
+#ifndef ESP32_SIM_HAL_LEDC_H__
+#define ESP32_SIM_HAL_LEDC_H__
+
+#include <cstdint>
+#include "esp32-hal.h"
+
+typedef enum {
+    NOTE_C, NOTE_Cs, NOTE_D, NOTE_Eb, NOTE_E, NOTE_F, NOTE_Fs, NOTE_G, NOTE_Gs, NOTE_A, NOTE_Bb, NOTE_B, NOTE_MAX
+} note_t;
+
+double ledcSetup(uint8_t channel, double freq, uint8_t resolution_bits);
+void ledcWrite(uint8_t channel, uint32_t duty);
+double ledcWriteTone(uint8_t channel, double freq);
+double ledcWriteNote(uint8_t channel, note_t note, uint8_t octave);
+uint32_t ledcRead(uint8_t channel);
+double ledcReadFreq(uint8_t channel);
+void ledcAttachPin(uint8_t pin, uint8_t channel);
+void ledcDetachPin(uint8_t pin);
+
+#endif
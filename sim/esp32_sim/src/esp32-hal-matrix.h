@@ -0,0 +1,17 @@
+/* Simulation shim: Arduino-ESP32 GPIO matrix HAL
+ *
+ * Only peripheral output signals of the LEDC are modelled, routing any
+ * other signal to a pin detaches it from the LEDC.
+ */
+#ifndef ESP32_SIM_HAL_MATRIX_H__
+#define ESP32_SIM_HAL_MATRIX_H__
+
+#include <cstdint>
+#include "soc/gpio_sig_map.h"
+
+// function: Signal index, wider than uint8_t like the ROM gpio_matrix_out(),
+// SIG_GPIO_OUT_IDX is 256
+void pinMatrixOutAttach(uint8_t pin, uint32_t function, bool invertOut, bool invertEnable);
+void pinMatrixOutDetach(uint8_t pin, bool invertOut, bool invertEnable);
+
+#endif
@@ -0,0 +1,17 @@
+/* Simulation shim: Arduino-ESP32 HAL common declarations
+ */
+#ifndef ESP32_SIM_HAL_H__
+#define ESP32_SIM_HAL_H__
+
+#include <cstdint>
+
+unsigned long millis();
+unsigned long micros();
+// Blocks the calling context: advances the virtual clock, dispatches nothing
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+#include "esp32-hal-ledc.h"
+#include "esp32-hal-matrix.h"
+
+#endif
@@ -0,0 +1,243 @@
+/* Virtual clock and esp_timer scheduler of the host simulation
+ *
+ * Simulated FreeRTOS tasks (see task.cpp) are scheduled on the same
+ * clock, a task due at the same time as a timer runs after the timer.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "esp_timer.h"
+#include "sim.hpp"
+#include "sim_tasks.hpp"
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    const char* name;
+    uint64_t alarm_us;
+    uint64_t period_us;
+    bool armed;
+    // Started or stopped from outside the esp_timer task
+    uint64_t outside_calls;
+};
+
+namespace {
+
+using StatsKeyT = std::pair<void*, void*>;
+
+uint64_t s_now_us = 0;
+std::vector<esp_timer*> s_timers;
+std::map<StatsKeyT, sim::TimerStats> s_stats;
+bool s_in_timer_callback = false;
+
+void count_outside_call(esp_timer* t) {
+    if (!s_in_timer_callback || sim::tasks::in_task()) {
+        ++t->outside_calls;
+    }
+}
+
+esp_timer* next_due(uint64_t until_us) {
+    esp_timer* next = nullptr;
+    for (auto t : s_timers) {
+        if (t->armed && t->alarm_us <= until_us
+                && (next == nullptr || t->alarm_us < next->alarm_us)) {
+            next = t;
+        }
+    }
+    return next;
+}
+
+template<typename RunT>
+void run_measured(const char* name, void* callback, void* arg, uint64_t due_us,
+                  RunT run) {
+    const StatsKeyT key{callback, arg};
+    auto& stats = s_stats[key];
+    stats.name = name;
+    stats.callback = callback;
+    stats.arg = arg;
+    stats.calls++;
+    const uint64_t late_us = s_now_us - due_us;
+    stats.late_us_sum += late_us;
+    stats.late_us_max = std::max(stats.late_us_max, late_us);
+
+    const auto t_start = std::chrono::steady_clock::now();
+    run();
+    const auto t_end = std::chrono::steady_clock::now();
+
+    const uint64_t host_ns = std::chrono::duration_cast<
+        std::chrono::nanoseconds>(t_end - t_start).count();
+    auto& stats_after = s_stats[key];
+    stats_after.host_ns_sum += host_ns;
+    stats_after.host_ns_max = std::max(stats_after.host_ns_max, host_ns);
+}
+
+} // namespace
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args,
+                           esp_timer_handle_t* out_handle) {
+    if (create_args == nullptr || create_args->callback == nullptr
+            || out_handle == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    auto t = new esp_timer{create_args->callback, create_args->arg,
+                           create_args->name, 0, 0, false, 0};
+    s_timers.push_back(t);
+    // The stats entry is created here, so the first run does not allocate
+    s_stats[StatsKeyT{reinterpret_cast<void*>(t->callback), t->arg}];
+    *out_handle = t;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    if (timer == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    count_outside_call(timer);
+    if (timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->alarm_us = s_now_us + timeout_us;
+    timer->period_us = 0;
+    timer->armed = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    if (timer == nullptr || period == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    count_outside_call(timer);
+    if (timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->alarm_us = s_now_us + period;
+    timer->period_us = period;
+    timer->armed = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (timer == nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    count_outside_call(timer);
+    if (!timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->armed = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (timer == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_timers.erase(std::remove(s_timers.begin(), s_timers.end(), timer),
+                   s_timers.end());
+    delete timer;
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time() {
+    return static_cast<int64_t>(s_now_us);
+}
+
+namespace sim {
+
+uint64_t now_us() {
+    return s_now_us;
+}
+
+void run_for(uint64_t duration_us) {
+    const uint64_t end_us = s_now_us + duration_us;
+    for (;;) {
+        esp_timer* t = next_due(end_us);
+        const uint64_t task_wake_us = tasks::next_wake_us();
+        if (task_wake_us <= end_us && (t == nullptr || task_wake_us < t->alarm_us)) {
+            s_now_us = std::max(s_now_us, task_wake_us);
+            const tasks::RunInfo info = tasks::next_info();
+            run_measured(info.name, info.task_code, info.parameters, task_wake_us,
+                         [](){ tasks::run_next(); });
+            continue;
+        }
+        if (t == nullptr) {
+            break;
+        }
+        const uint64_t due_us = t->alarm_us;
+        s_now_us = std::max(s_now_us, due_us);
+        if (t->period_us > 0) {
+            // Same as the IDF: Next alarm is relative to the previous one,
+            // a late periodic timer catches up.
+            t->alarm_us += t->period_us;
+        } else {
+            t->armed = false;
+        }
+        // The callback may delete its own timer, copy what is needed
+        const esp_timer_cb_t callback = t->callback;
+        void* const arg = t->arg;
+        run_measured(t->name, reinterpret_cast<void*>(callback), arg, due_us,
+                     [callback, arg](){
+                         s_in_timer_callback = true;
+                         callback(arg);
+                         s_in_timer_callback = false;
+                     });
+    }
+    s_now_us = std::max(s_now_us, end_us);
+}
+
+// A task hands the CPU back instead, it is resumed by run_for().
+// Timers and the simulation driver block only the timers, tasks run
+// meanwhile like on the chip, where the caller sleeps in vTaskDelay().
+void block_for(uint64_t duration_us) {
+    const uint64_t end_us = s_now_us + duration_us;
+    if (tasks::in_task()) {
+        tasks::block_until(end_us);
+        return;
+    }
+    for (uint64_t wake_us = tasks::next_wake_us(); wake_us <= end_us;
+            wake_us = tasks::next_wake_us()) {
+        s_now_us = std::max(s_now_us, wake_us);
+        tasks::run_next();
+    }
+    s_now_us = end_us;
+}
+
+bool in_timer_callback() {
+    return s_in_timer_callback && !tasks::in_task();
+}
+
+uint64_t timer_calls_outside_timers(const char* name) {
+    uint64_t calls = 0;
+    for (const auto t : s_timers) {
+        if (t->name && std::strcmp(t->name, name) == 0) {
+            calls += t->outside_calls;
+        }
+    }
+    return calls;
+}
+
+std::vector<TimerStats> timer_stats() {
+    std::vector<TimerStats> result;
+    for (const auto& entry : s_stats) {
+        if (entry.second.calls > 0) {
+            result.push_back(entry.second);
+        }
+    }
+    return result;
+}
+
+// Entries are kept, so timers running after a reset do not allocate
+void reset_timer_stats() {
+    for (auto& entry : s_stats) {
+        entry.second = sim::TimerStats{};
+    }
+}
+
+} // namespace sim
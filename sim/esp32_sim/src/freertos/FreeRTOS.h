@@ -0,0 +1,22 @@
+/* Simulation shim: FreeRTOS base types
+ *
+ * One tick is one millisecond (CONFIG_FREERTOS_HZ=1000).
+ */
+#ifndef ESP32_SIM_FREERTOS_H__
+#define ESP32_SIM_FREERTOS_H__
+
+#include <cstdint>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define portMAX_DELAY (TickType_t)0xffffffffUL
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#endif
@@ -0,0 +1,32 @@
+/* Simulation shim: FreeRTOS task API subset
+ *
+ * Tasks run on host threads, but only one thread runs at a time: The
+ * simulation driver hands the CPU to a task when its wake-up time has
+ * come on the virtual clock, and the task hands it back when it blocks
+ * (vTaskDelay(), blocking driver calls). The core affinity is ignored,
+ * a task just does not block any timer while it waits.
+ */
+#ifndef ESP32_SIM_FREERTOS_TASK_H__
+#define ESP32_SIM_FREERTOS_TASK_H__
+
+#include <cstdint>
+#include "FreeRTOS.h"
+
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+typedef void (*TaskFunction_t)(void*);
+typedef struct sim_task* TaskHandle_t;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char* name,
+                                   uint32_t stack_depth, void* parameters,
+                                   UBaseType_t priority, TaskHandle_t* created_task,
+                                   BaseType_t core_id);
+// nullptr deletes the calling task
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+// Direct to task notification used as a counting semaphore. Only
+// simulated tasks can wait, any context can give.
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks_to_wait);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+#endif
@@ -0,0 +1,111 @@
+/* Host simulation: in-memory file system
+ */
+#include <algorithm>
+#include <cstring>
+
+#include "FS.h"
+#include "SPIFFS.h"
+#include "sim.hpp"
+
+fs::SPIFFSFS SPIFFS;
+
+namespace {
+
+uint64_t s_reads_in_timers = 0;
+
+} // namespace
+
+namespace fs {
+
+size_t File::write(const uint8_t* buf, size_t size) {
+    if (!_data || !_writable) {
+        return 0;
+    }
+    if (_pos + size > _data->size()) {
+        _data->resize(_pos + size);
+    }
+    std::memcpy(_data->data() + _pos, buf, size);
+    _pos += size;
+    return size;
+}
+
+int File::read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+size_t File::read(uint8_t* buf, size_t size) {
+    if (!_data) {
+        return 0;
+    }
+    if (sim::in_timer_callback()) {
+        ++s_reads_in_timers;
+    }
+    const size_t n = std::min(size, _data->size() - _pos);
+    std::memcpy(buf, _data->data() + _pos, n);
+    _pos += n;
+    return n;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+    if (!_data) {
+        return false;
+    }
+    size_t new_pos = pos;
+    if (mode == SeekCur) {
+        new_pos = _pos + pos;
+    } else if (mode == SeekEnd) {
+        new_pos = _data->size() - pos;
+    }
+    if (new_pos > _data->size()) {
+        return false;
+    }
+    _pos = new_pos;
+    return true;
+}
+
+File FS::open(const char* path, const char* mode) {
+    const bool writable = mode[0] == 'w' || mode[0] == 'a';
+    auto it = _files.find(path);
+    if (it == _files.end()) {
+        if (!writable) {
+            return File{};
+        }
+        it = _files.emplace(path, std::make_shared<FileDataT>()).first;
+    } else if (mode[0] == 'w') {
+        it->second->clear();
+    }
+    File file{it->second, path, writable};
+    if (mode[0] == 'a') {
+        file.seek(0, SeekEnd);
+    }
+    return file;
+}
+
+bool FS::rename(const char* path_from, const char* path_to) {
+    auto it = _files.find(path_from);
+    if (it == _files.end()) {
+        return false;
+    }
+    _files[path_to] = it->second;
+    _files.erase(it);
+    return true;
+}
+
+size_t SPIFFSFS::usedBytes() const {
+    size_t used = 0;
+    for (const auto& entry : _files) {
+        used += entry.second->size();
+    }
+    return used;
+}
+
+} // namespace fs
+
+namespace sim {
+
+uint64_t fs_reads_in_timers() {
+    return s_reads_in_timers;
+}
+
+} // namespace sim
@@ -0,0 +1,292 @@
+/* Host simulation: I2S peripheral and DMA ring model, built-in ADC
+ */
+#include <algorithm>
+#include <utility>
+
+#include "driver/i2s.h"
+#include "sim.hpp"
+
+namespace {
+
+// Captured output is limited, long-running streams keep only the start
+constexpr size_t capture_limit = 1024 * 1024;
+
+struct I2sPort {
+    bool installed;
+    i2s_config_t config;
+    int data_out_gpio;
+    // DMA ring fill level at the time of the last update
+    size_t ring_capacity;
+    size_t ring_queued;
+    uint64_t updated_us;
+    uint64_t tx_bytes;
+    sim::CaptureT capture;
+    // Play time of the captured writes: Capture offset of each write and
+    // the time when its first byte leaves the DMA ring
+    std::vector<std::pair<size_t, uint64_t>,
+                sim::UncountedAllocator<std::pair<size_t, uint64_t>>> capture_times;
+    // Receive direction, built-in ADC: Samples taken since rx_start_us
+    // and samples handed out by i2s_read()
+    bool adc_enabled;
+    uint64_t rx_start_us;
+    uint64_t rx_read_samples;
+    uint64_t rx_overflows;
+};
+
+I2sPort s_ports[I2S_NUM_MAX];
+
+// Signal at the ADC input, see sim::adc_set_input()
+struct AdcInput {
+    int gpio;
+    const int16_t* pcm;
+    size_t n_samples;
+    uint32_t sample_rate;
+    uint64_t start_us;
+};
+
+constexpr int adc1_channel_gpios[ADC1_CHANNEL_MAX] = {36, 37, 38, 39, 32, 33, 34, 35};
+adc1_channel_t s_adc_channel = ADC1_CHANNEL_0;
+AdcInput s_adc_input{-1, nullptr, 0, 1, 0};
+
+size_t bytes_per_second(const I2sPort& port) {
+    const int n_channels = port.config.channel_format == I2S_CHANNEL_FMT_RIGHT_LEFT
+                           ? 2 : 1;
+    return static_cast<size_t>(port.config.sample_rate)
+           * port.config.bits_per_sample / 8 * n_channels;
+}
+
+// Drain the DMA ring up to the current virtual time
+void update(I2sPort& port) {
+    const uint64_t now_us = sim::now_us();
+    const uint64_t drained = (now_us - port.updated_us) * bytes_per_second(port)
+                             / 1000000;
+    port.ring_queued -= std::min<uint64_t>(drained, port.ring_queued);
+    port.updated_us = now_us;
+}
+
+uint64_t rx_samples_taken(const I2sPort& port) {
+    return (sim::now_us() - port.rx_start_us) * port.config.sample_rate / 1000000;
+}
+
+// 12-bit ADC conversion of the input signal at the time of a sample
+uint16_t adc_sample(const I2sPort& port, uint64_t sample) {
+    int32_t value = 0;
+    if (s_adc_input.gpio == adc1_channel_gpios[s_adc_channel]) {
+        const uint64_t t_us = port.rx_start_us
+                              + sample * 1000000 / port.config.sample_rate;
+        if (t_us >= s_adc_input.start_us) {
+            const uint64_t index = (t_us - s_adc_input.start_us)
+                                   * s_adc_input.sample_rate / 1000000;
+            if (index < s_adc_input.n_samples) {
+                value = s_adc_input.pcm[index];
+            }
+        }
+    }
+    const int32_t code = std::min(4095, std::max(0, (value >> 4) + 2048));
+    return static_cast<uint16_t>(s_adc_channel << 12 | code);
+}
+
+} // namespace
+
+esp_err_t i2s_driver_install(i2s_port_t i2s_num, const i2s_config_t* i2s_config,
+                             int queue_size, void* i2s_queue) {
+    if (i2s_num >= I2S_NUM_MAX || !i2s_config || i2s_config->sample_rate <= 0
+            || i2s_config->dma_buf_count < 2 || i2s_config->dma_buf_count > 128
+            || i2s_config->dma_buf_len < 8 || i2s_config->dma_buf_len > 1024) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    I2sPort& port = s_ports[i2s_num];
+    if (port.installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    port = I2sPort{};
+    port.installed = true;
+    port.config = *i2s_config;
+    port.data_out_gpio = -1;
+    const int n_channels = i2s_config->channel_format == I2S_CHANNEL_FMT_RIGHT_LEFT
+                           ? 2 : 1;
+    port.ring_capacity = static_cast<size_t>(i2s_config->dma_buf_count)
+                         * i2s_config->dma_buf_len
+                         * i2s_config->bits_per_sample / 8 * n_channels;
+    port.updated_us = sim::now_us();
+    // Growing the capture would show up in the host time of the writer
+    port.capture.reserve(capture_limit);
+    port.capture_times.reserve(capture_limit / 128);
+    return ESP_OK;
+}
+
+esp_err_t i2s_driver_uninstall(i2s_port_t i2s_num) {
+    if (i2s_num >= I2S_NUM_MAX || !s_ports[i2s_num].installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_ports[i2s_num].installed = false;
+    return ESP_OK;
+}
+
+esp_err_t i2s_set_pin(i2s_port_t i2s_num, const i2s_pin_config_t* pin) {
+    if (i2s_num >= I2S_NUM_MAX || !s_ports[i2s_num].installed || !pin) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (pin->data_out_num != I2S_PIN_NO_CHANGE) {
+        s_ports[i2s_num].data_out_gpio = pin->data_out_num;
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2s_write(i2s_port_t i2s_num, const void* src, size_t size,
+                    size_t* bytes_written, TickType_t ticks_to_wait) {
+    *bytes_written = 0;
+    if (i2s_num >= I2S_NUM_MAX || !s_ports[i2s_num].installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    I2sPort& port = s_ports[i2s_num];
+    update(port);
+    size_t space = port.ring_capacity - port.ring_queued;
+    if (space < size && ticks_to_wait > 0) {
+        // Block until the DMA has made room, or until the timeout
+        const uint64_t wait_us = std::min<uint64_t>(
+            (size - space) * 1000000ULL / bytes_per_second(port) + 1,
+            static_cast<uint64_t>(ticks_to_wait) * portTICK_PERIOD_MS * 1000);
+        sim::block_for(wait_us);
+        update(port);
+        space = port.ring_capacity - port.ring_queued;
+    }
+    const size_t n = std::min(size, space);
+    port.ring_queued += n;
+    port.tx_bytes += n;
+    const auto* bytes = static_cast<const uint8_t*>(src);
+    const size_t n_capture = std::min(n, capture_limit - port.capture.size());
+    if (n_capture > 0) {
+        port.capture_times.emplace_back(
+            port.capture.size(),
+            sim::now_us() + (port.ring_queued - n) * 1000000 / bytes_per_second(port));
+    }
+    port.capture.insert(port.capture.end(), bytes, bytes + n_capture);
+    *bytes_written = n;
+    // Same as the IDF: A timeout is not an error, see bytes_written
+    return ESP_OK;
+}
+
+esp_err_t i2s_read(i2s_port_t i2s_num, void* dest, size_t size,
+                   size_t* bytes_read, TickType_t ticks_to_wait) {
+    *bytes_read = 0;
+    if (i2s_num >= I2S_NUM_MAX || !s_ports[i2s_num].installed
+            || !s_ports[i2s_num].adc_enabled) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    I2sPort& port = s_ports[i2s_num];
+    const uint64_t ring_samples = static_cast<uint64_t>(port.config.dma_buf_count)
+                                  * port.config.dma_buf_len;
+    const uint64_t n_wanted = size / sizeof(uint16_t);
+    uint64_t n_taken = rx_samples_taken(port);
+    if (n_taken - port.rx_read_samples < n_wanted && ticks_to_wait > 0) {
+        // Block until the DMA has received enough samples, or until the timeout
+        const uint64_t ready_us = port.rx_start_us
+            + ((port.rx_read_samples + n_wanted) * 1000000 + port.config.sample_rate - 1)
+              / port.config.sample_rate;
+        sim::block_for(std::min<uint64_t>(
+            ready_us - sim::now_us(),
+            static_cast<uint64_t>(ticks_to_wait) * portTICK_PERIOD_MS * 1000));
+        n_taken = rx_samples_taken(port);
+    }
+    // Samples which did not fit into the DMA ring are lost
+    if (n_taken - port.rx_read_samples > ring_samples) {
+        port.rx_overflows += n_taken - port.rx_read_samples - ring_samples;
+        port.rx_read_samples = n_taken - ring_samples;
+    }
+    const uint64_t n = std::min(n_wanted, n_taken - port.rx_read_samples);
+    auto* samples = static_cast<uint16_t*>(dest);
+    for (uint64_t i = 0; i < n; ++i) {
+        samples[i] = adc_sample(port, port.rx_read_samples + i);
+    }
+    port.rx_read_samples += n;
+    *bytes_read = n * sizeof(uint16_t);
+    return ESP_OK;
+}
+
+esp_err_t i2s_set_adc_mode(adc_unit_t adc_unit, adc1_channel_t adc_channel) {
+    if (adc_unit != ADC_UNIT_1 || adc_channel >= ADC1_CHANNEL_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_adc_channel = adc_channel;
+    return ESP_OK;
+}
+
+esp_err_t i2s_adc_enable(i2s_port_t i2s_num) {
+    if (i2s_num != I2S_NUM_0 || !s_ports[i2s_num].installed
+            || !(s_ports[i2s_num].config.mode & I2S_MODE_ADC_BUILT_IN)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    I2sPort& port = s_ports[i2s_num];
+    port.adc_enabled = true;
+    port.rx_start_us = sim::now_us();
+    port.rx_read_samples = 0;
+    return ESP_OK;
+}
+
+esp_err_t i2s_adc_disable(i2s_port_t i2s_num) {
+    if (i2s_num != I2S_NUM_0 || !s_ports[i2s_num].installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_ports[i2s_num].adc_enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t adc1_config_width(adc_bits_width_t width_bit) {
+    return ESP_OK;
+}
+
+esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t atten) {
+    return channel < ADC1_CHANNEL_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t i2s_zero_dma_buffer(i2s_port_t i2s_num) {
+    if (i2s_num >= I2S_NUM_MAX || !s_ports[i2s_num].installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return ESP_OK;
+}
+
+namespace sim {
+
+int i2s_data_out_gpio(int port) {
+    return s_ports[port % I2S_NUM_MAX].data_out_gpio;
+}
+
+uint64_t i2s_tx_bytes(int port) {
+    return s_ports[port % I2S_NUM_MAX].tx_bytes;
+}
+
+const CaptureT& i2s_capture(int port) {
+    return s_ports[port % I2S_NUM_MAX].capture;
+}
+
+void i2s_reset_capture(int port) {
+    s_ports[port % I2S_NUM_MAX].capture.clear();
+    s_ports[port % I2S_NUM_MAX].capture_times.clear();
+}
+
+uint64_t i2s_capture_play_us(int port, size_t offset) {
+    const I2sPort& p = s_ports[port % I2S_NUM_MAX];
+    const auto after = std::upper_bound(
+        p.capture_times.begin(), p.capture_times.end(), offset,
+        [](size_t value, const std::pair<size_t, uint64_t>& write) {
+            return value < write.first;
+        });
+    if (after == p.capture_times.begin()) {
+        return 0;
+    }
+    const auto& write = *(after - 1);
+    return write.second + (offset - write.first) * 1000000 / bytes_per_second(p);
+}
+
+uint64_t i2s_rx_overflows(int port) {
+    return s_ports[port % I2S_NUM_MAX].rx_overflows;
+}
+
+void adc_set_input(int gpio, const int16_t* pcm, size_t n_samples,
+                   uint32_t sample_rate) {
+    s_adc_input = AdcInput{gpio, pcm, n_samples, sample_rate, now_us()};
+}
+
+} // namespace sim
@@ -0,0 +1,250 @@
+/* Host simulation: LEDC peripheral and GPIO matrix model
+ */
+#include <cmath>
+
+#include "driver/ledc.h"
+#include "esp32-hal-ledc.h"
+#include "sim.hpp"
+
+namespace {
+
+constexpr int n_gpios = 40;
+
+sim::LedcChannelState s_channels[sim::ledc_n_channels];
+int s_pin_channel[n_gpios] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+uint64_t s_write_count = 0;
+uint64_t s_fade_count = 0;
+uint64_t s_attach_count = 0;
+uint64_t s_route_count = 0;
+bool s_fade_func_installed = false;
+// Fade configured by ledc_set_fade_with_time(), started by ledc_fade_start()
+uint32_t s_fade_target[sim::ledc_n_channels];
+uint32_t s_fade_time_ms[sim::ledc_n_channels];
+
+uint8_t arduino_channel(ledc_mode_t speed_mode, ledc_channel_t channel) {
+    return speed_mode * LEDC_CHANNEL_MAX + channel;
+}
+
+bool is_valid(ledc_mode_t speed_mode, ledc_channel_t channel) {
+    return speed_mode < LEDC_SPEED_MODE_MAX && channel < LEDC_CHANNEL_MAX;
+}
+
+} // namespace
+
+double ledcSetup(uint8_t chan, double freq, uint8_t bit_num) {
+    if (chan >= sim::ledc_n_channels || bit_num > 20) {
+        return 0;
+    }
+    s_channels[chan].freq = freq;
+    s_channels[chan].resolution_bits = bit_num;
+    return freq;
+}
+
+void ledcWrite(uint8_t chan, uint32_t duty) {
+    if (chan >= sim::ledc_n_channels) {
+        return;
+    }
+    s_channels[chan].duty = duty;
+    s_channels[chan].fade_end_us = 0;
+    s_channels[chan].writes++;
+    s_write_count++;
+}
+
+double ledcWriteTone(uint8_t chan, double freq) {
+    if (chan >= sim::ledc_n_channels) {
+        return 0;
+    }
+    if (!freq) {
+        ledcWrite(chan, 0);
+        return 0;
+    }
+    const double res_freq = ledcSetup(chan, freq, 10);
+    ledcWrite(chan, 0x1FF);
+    return res_freq;
+}
+
+double ledcWriteNote(uint8_t chan, note_t note, uint8_t octave) {
+    static const uint16_t noteFrequencyBase[12] = {
+    //   C        C#       D        Eb       E        F       F#        G       G#        A       Bb        B
+        4186,    4435,    4699,    4978,    5274,    5588,    5920,    6272,    6645,    7040,    7459,    7902
+    };
+    if (octave > 8 || note >= NOTE_MAX) {
+        return 0;
+    }
+    const double noteFreq = static_cast<double>(noteFrequencyBase[note])
+                            / static_cast<double>(1 << (8 - octave));
+    return ledcWriteTone(chan, noteFreq);
+}
+
+uint32_t ledcRead(uint8_t chan) {
+    return chan < sim::ledc_n_channels ? s_channels[chan].duty : 0;
+}
+
+double ledcReadFreq(uint8_t chan) {
+    return chan < sim::ledc_n_channels && ledcRead(chan) ? s_channels[chan].freq : 0;
+}
+
+void ledcAttachPin(uint8_t pin, uint8_t chan) {
+    if (pin >= n_gpios || chan >= sim::ledc_n_channels) {
+        return;
+    }
+    s_attach_count++;
+    const uint8_t signal = chan < LEDC_CHANNEL_MAX
+                           ? LEDC_HS_SIG_OUT0_IDX + chan
+                           : LEDC_LS_SIG_OUT0_IDX + chan - LEDC_CHANNEL_MAX;
+    pinMatrixOutAttach(pin, signal, false, false);
+}
+
+void ledcDetachPin(uint8_t pin) {
+    pinMatrixOutDetach(pin, false, false);
+}
+
+void pinMatrixOutAttach(uint8_t pin, uint32_t function, bool invertOut, bool invertEnable) {
+    if (pin >= n_gpios) {
+        return;
+    }
+    s_route_count++;
+    if (function >= LEDC_HS_SIG_OUT0_IDX && function < LEDC_LS_SIG_OUT0_IDX) {
+        s_pin_channel[pin] = function - LEDC_HS_SIG_OUT0_IDX;
+    } else if (function >= LEDC_LS_SIG_OUT0_IDX
+               && function < LEDC_LS_SIG_OUT0_IDX + LEDC_CHANNEL_MAX) {
+        s_pin_channel[pin] = function - LEDC_LS_SIG_OUT0_IDX + LEDC_CHANNEL_MAX;
+    } else {
+        s_pin_channel[pin] = -1;
+    }
+}
+
+// Routes the pin back to its GPIO output register, SIG_GPIO_OUT_IDX
+void pinMatrixOutDetach(uint8_t pin, bool invertOut, bool invertEnable) {
+    if (pin >= n_gpios) {
+        return;
+    }
+    s_route_count++;
+    s_pin_channel[pin] = -1;
+}
+
+esp_err_t ledc_fade_func_install(int intr_alloc_flags) {
+    if (s_fade_func_installed) {
+        return ESP_FAIL;
+    }
+    s_fade_func_installed = true;
+    return ESP_OK;
+}
+
+void ledc_fade_func_uninstall() {
+    s_fade_func_installed = false;
+}
+
+esp_err_t ledc_set_fade_with_time(ledc_mode_t speed_mode, ledc_channel_t channel,
+                                  uint32_t target_duty, int max_fade_time_ms) {
+    if (!is_valid(speed_mode, channel) || max_fade_time_ms < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_fade_func_installed) {
+        return ESP_FAIL;
+    }
+    const uint8_t chan = arduino_channel(speed_mode, channel);
+    s_fade_target[chan] = target_duty;
+    s_fade_time_ms[chan] = max_fade_time_ms;
+    return ESP_OK;
+}
+
+esp_err_t ledc_fade_start(ledc_mode_t speed_mode, ledc_channel_t channel,
+                          ledc_fade_mode_t fade_mode) {
+    if (!is_valid(speed_mode, channel) || fade_mode >= LEDC_FADE_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_fade_func_installed) {
+        return ESP_FAIL;
+    }
+    const uint8_t chan = arduino_channel(speed_mode, channel);
+    auto& state = s_channels[chan];
+    state.fade_from = sim::ledc_output_duty(chan);
+    state.duty = s_fade_target[chan];
+    state.fade_start_us = sim::now_us();
+    state.fade_end_us = state.fade_start_us + s_fade_time_ms[chan] * 1000ULL;
+    state.fades++;
+    s_fade_count++;
+    if (fade_mode == LEDC_FADE_WAIT_DONE) {
+        sim::block_for(s_fade_time_ms[chan] * 1000ULL);
+    }
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty) {
+    if (!is_valid(speed_mode, channel)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_fade_target[arduino_channel(speed_mode, channel)] = duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel) {
+    if (!is_valid(speed_mode, channel)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const uint8_t chan = arduino_channel(speed_mode, channel);
+    ledcWrite(chan, s_fade_target[chan]);
+    return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel) {
+    if (!is_valid(speed_mode, channel)) {
+        return 0;
+    }
+    return sim::ledc_output_duty(arduino_channel(speed_mode, channel));
+}
+
+namespace sim {
+
+uint32_t ledc_output_duty(uint8_t channel) {
+    const auto& state = s_channels[channel % ledc_n_channels];
+    const uint64_t now = now_us();
+    if (now >= state.fade_end_us) {
+        return state.duty;
+    }
+    const double progress = static_cast<double>(now - state.fade_start_us)
+                            / (state.fade_end_us - state.fade_start_us);
+    return static_cast<uint32_t>(
+        state.fade_from + progress * (static_cast<double>(state.duty) - state.fade_from));
+}
+
+uint64_t ledc_fade_count() {
+    return s_fade_count;
+}
+
+const LedcChannelState& ledc_channel(uint8_t channel) {
+    return s_channels[channel % ledc_n_channels];
+}
+
+int ledc_pin_channel(uint8_t pin) {
+    return pin < n_gpios ? s_pin_channel[pin] : -1;
+}
+
+uint64_t ledc_write_count() {
+    return s_write_count;
+}
+
+uint64_t ledc_attach_count() {
+    return s_attach_count;
+}
+
+uint64_t gpio_matrix_route_count() {
+    return s_route_count;
+}
+
+void reset_ledc_counters() {
+    s_write_count = 0;
+    s_fade_count = 0;
+    s_attach_count = 0;
+    s_route_count = 0;
+    for (auto& channel : s_channels) {
+        channel.writes = 0;
+        channel.fades = 0;
+    }
+}
+
+} // namespace sim
@@ -0,0 +1,157 @@
+/* Host simulation control interface
+ *
+ * The simulation replaces the ESP32 hardware and the Arduino core with
+ * a single-threaded model driven by a virtual clock. Nothing happens
+ * on its own: timers (esp_timer and Ticker), the touch pad filter,
+ * FreeRTOS tasks etc. only run while the simulation driver calls
+ * sim::run_for().
+ *
+ * A blocking delay() inside a timer callback advances the virtual clock
+ * without dispatching other timers, just like it blocks the esp_timer
+ * task on the real chip. The resulting lateness is recorded per timer.
+ * FreeRTOS tasks which become due meanwhile do run.
+ */
+#ifndef ESP32_SIM_HPP__
+#define ESP32_SIM_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace sim {
+
+// Allocator for simulation bookkeeping, which is not counted as
+// application heap use (see heap_live_bytes())
+template<typename T>
+struct UncountedAllocator
+{
+    using value_type = T;
+    UncountedAllocator() = default;
+    template<typename U>
+    UncountedAllocator(const UncountedAllocator<U>&) {}
+    T* allocate(size_t n) {
+        void* p = std::malloc(n * sizeof(T));
+        if (!p) {
+            throw std::bad_alloc{};
+        }
+        return static_cast<T*>(p);
+    }
+    void deallocate(T* p, size_t) { std::free(p); }
+};
+template<typename T, typename U>
+bool operator==(const UncountedAllocator<T>&, const UncountedAllocator<U>&) { return true; }
+template<typename T, typename U>
+bool operator!=(const UncountedAllocator<T>&, const UncountedAllocator<U>&) { return false; }
+
+using CaptureT = std::vector<uint8_t, UncountedAllocator<uint8_t>>;
+
+// Per-timer statistics, aggregated by (callback, arg) so that timers
+// which are re-created on every Ticker::attach() still accumulate.
+struct TimerStats {
+    const char* name;
+    void* callback;
+    void* arg;
+    uint64_t calls;
+    // Dispatch lateness against the programmed alarm time (virtual clock)
+    uint64_t late_us_sum;
+    uint64_t late_us_max;
+    // Host CPU time spent inside the callback
+    uint64_t host_ns_sum;
+    uint64_t host_ns_max;
+};
+
+// Virtual clock in microseconds since simulated boot
+uint64_t now_us();
+// Run all timers which become due within the next duration_us
+void run_for(uint64_t duration_us);
+// Advance the virtual clock without dispatching timers (blocking),
+// simulated tasks run meanwhile
+void block_for(uint64_t duration_us);
+// True while an esp_timer callback runs, i.e. in the esp_timer task
+bool in_timer_callback();
+// esp_timer start and stop calls for the timers of that name from outside
+// the esp_timer task, i.e. from tasks or the simulation driver
+uint64_t timer_calls_outside_timers(const char* name);
+
+std::vector<TimerStats> timer_stats();
+void reset_timer_stats();
+
+// LEDC peripheral model
+struct LedcChannelState {
+    double freq;
+    uint8_t resolution_bits;
+    uint32_t duty;
+    uint64_t writes;
+    // Hardware fade engine: duty ramps from fade_from to duty
+    // between fade_start_us and fade_end_us
+    uint32_t fade_from;
+    uint64_t fade_start_us;
+    uint64_t fade_end_us;
+    uint64_t fades;
+};
+constexpr uint8_t ledc_n_channels = 16;
+const LedcChannelState& ledc_channel(uint8_t channel);
+// Channel driving a GPIO via the GPIO matrix, -1 when detached
+int ledc_pin_channel(uint8_t pin);
+// Momentary duty cycle, follows running hardware fades
+uint32_t ledc_output_duty(uint8_t channel);
+// Duty cycle updates via ledcWrite() or the IDF driver
+uint64_t ledc_write_count();
+// Hardware fades started
+uint64_t ledc_fade_count();
+uint64_t ledc_attach_count();
+// GPIO matrix output routings, including those done by ledcAttachPin()
+uint64_t gpio_matrix_route_count();
+void reset_ledc_counters();
+
+// I2S peripheral model, transmit direction
+int i2s_data_out_gpio(int port);
+uint64_t i2s_tx_bytes(int port);
+// Bytes written by i2s_write() since the last reset, the first 1 MiB only
+const CaptureT& i2s_capture(int port);
+void i2s_reset_capture(int port);
+// Virtual time when a captured byte is played by the DMA
+uint64_t i2s_capture_play_us(int port, size_t offset);
+// I2S receive direction: Samples lost because i2s_read() fell behind
+uint64_t i2s_rx_overflows(int port);
+
+// ADC input model: 16-bit PCM signal at an ADC1 pin from now on, silence
+// before and after. The data is not copied and must stay valid.
+void adc_set_input(int gpio, const int16_t* pcm, size_t n_samples,
+                   uint32_t sample_rate);
+
+// Touch pad model: filtered sensor values, lower value means touched
+constexpr uint16_t touch_value_released = 800;
+constexpr uint16_t touch_value_pressed = 400;
+void touch_set_value(int pad, uint16_t value);
+
+// Heap model: every operator new/delete on the host is counted
+constexpr size_t heap_size = 320 * 1024;
+uint64_t heap_alloc_count();
+// Bytes requested by all allocations
+uint64_t heap_alloc_bytes();
+size_t heap_live_bytes();
+size_t heap_peak_bytes();
+void reset_heap_peak();
+
+// SPIFFS model: File::read() calls from timer callbacks, which would
+// block the esp_timer task on flash access
+uint64_t fs_reads_in_timers();
+
+// Serial console
+void serial_set_quiet(bool quiet);
+uint64_t serial_bytes_written();
+
+// Set by ESP.restart()
+bool restart_requested();
+
+// Preemption model: The n_calls-th micros() call from now finds the clock
+// advanced by duration_us, as if the caller was preempted right before
+// it by a higher priority task. Timers are not dispatched meanwhile.
+void preempt_micros_call(uint32_t n_calls, uint64_t duration_us);
+
+} // namespace sim
+
+#endif
@@ -0,0 +1,35 @@
+/* Host simulation: FreeRTOS task scheduling, internal interface of the
+ * virtual clock scheduler (esp_timer.cpp)
+ */
+#ifndef ESP32_SIM_TASKS_HPP__
+#define ESP32_SIM_TASKS_HPP__
+
+#include <cstdint>
+
+namespace sim {
+namespace tasks {
+
+constexpr uint64_t never_us = UINT64_MAX;
+
+struct RunInfo {
+    const char* name;
+    void* task_code;
+    void* parameters;
+};
+
+// True on the thread of a simulated task
+bool in_task();
+// Earliest wake-up time of all tasks, never_us if none is waiting
+uint64_t next_wake_us();
+// The task with the earliest wake-up time
+RunInfo next_info();
+// Run that task until it blocks again
+void run_next();
+// Called by a task: Hand the CPU back until the virtual clock reaches
+// wake_us, never_us blocks until the task is deleted
+void block_until(uint64_t wake_us);
+
+} // namespace tasks
+} // namespace sim
+
+#endif
@@ -0,0 +1,10 @@
+/* Simulation shim: ESP32 GPIO matrix signal indexes (subset)
+ */
+#ifndef ESP32_SIM_SOC_GPIO_SIG_MAP_H__
+#define ESP32_SIM_SOC_GPIO_SIG_MAP_H__
+
+#define LEDC_HS_SIG_OUT0_IDX 71
+#define LEDC_LS_SIG_OUT0_IDX 79
+#define SIG_GPIO_OUT_IDX 256
+
+#endif
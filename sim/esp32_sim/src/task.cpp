@@ -0,0 +1,184 @@
+/* Host simulation: FreeRTOS tasks on host threads, one running at a time
+ */
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "freertos/task.h"
+#include "sim.hpp"
+#include "sim_tasks.hpp"
+
+struct sim_task {
+    TaskFunction_t task_code;
+    void* parameters;
+    const char* name;
+    uint64_t wake_us;
+    bool deleted;
+    bool finished;
+    uint32_t notify_count;
+    bool waiting_for_notify;
+    std::thread thread;
+};
+
+namespace {
+
+// Thrown into a task to unwind it when it is deleted
+struct TaskExit {};
+
+std::mutex s_mutex;
+std::condition_variable s_switch;
+// Task holding the CPU, nullptr for the simulation driver
+sim_task* s_running = nullptr;
+std::vector<sim_task*> s_tasks;
+thread_local sim_task* t_self = nullptr;
+
+// Hand the CPU to next and wait until it comes back to self
+void switch_to(sim_task* next, sim_task* self) {
+    std::unique_lock<std::mutex> lock{s_mutex};
+    s_running = next;
+    s_switch.notify_all();
+    s_switch.wait(lock, [self]{ return s_running == self; });
+}
+
+void task_main(sim_task* task) {
+    t_self = task;
+    {
+        std::unique_lock<std::mutex> lock{s_mutex};
+        s_switch.wait(lock, [task]{ return s_running == task; });
+    }
+    try {
+        if (!task->deleted) {
+            task->task_code(task->parameters);
+        }
+    } catch (const TaskExit&) {
+    }
+    std::lock_guard<std::mutex> lock{s_mutex};
+    task->finished = true;
+    task->wake_us = sim::tasks::never_us;
+    s_running = nullptr;
+    s_switch.notify_all();
+}
+
+sim_task* earliest() {
+    sim_task* next = nullptr;
+    for (auto task : s_tasks) {
+        if (next == nullptr || task->wake_us < next->wake_us) {
+            next = task;
+        }
+    }
+    return next;
+}
+
+void destroy(sim_task* task) {
+    task->thread.join();
+    s_tasks.erase(std::remove(s_tasks.begin(), s_tasks.end(), task), s_tasks.end());
+    delete task;
+}
+
+} // namespace
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task_code, const char* name,
+                                   uint32_t stack_depth, void* parameters,
+                                   UBaseType_t priority, TaskHandle_t* created_task,
+                                   BaseType_t core_id) {
+    auto task = new sim_task{task_code, parameters, name, sim::now_us(),
+                             false, false, 0, false, {}};
+    task->thread = std::thread{task_main, task};
+    s_tasks.push_back(task);
+    if (created_task) {
+        *created_task = task;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == nullptr || task == t_self) {
+        throw TaskExit{};
+    }
+    // Unwind the task from the point where it blocked
+    task->deleted = true;
+    if (!task->finished) {
+        switch_to(task, t_self);
+    }
+    destroy(task);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    sim::block_for(static_cast<uint64_t>(ticks) * portTICK_PERIOD_MS * 1000);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks_to_wait) {
+    sim_task* self = t_self;
+    if (self == nullptr) {
+        return 0;
+    }
+    if (self->notify_count == 0 && ticks_to_wait > 0) {
+        self->waiting_for_notify = true;
+        sim::tasks::block_until(ticks_to_wait == portMAX_DELAY
+            ? sim::tasks::never_us
+            : sim::now_us() + static_cast<uint64_t>(ticks_to_wait) * portTICK_PERIOD_MS * 1000);
+        self->waiting_for_notify = false;
+    }
+    const uint32_t count = self->notify_count;
+    if (count > 0) {
+        self->notify_count = clear_count_on_exit ? 0 : count - 1;
+    }
+    return count;
+}
+
+// The waiting task becomes due now, it runs when the giving context
+// hands back the CPU
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    ++task->notify_count;
+    if (task->waiting_for_notify) {
+        task->wake_us = std::min(task->wake_us, sim::now_us());
+    }
+    return pdPASS;
+}
+
+namespace sim {
+namespace tasks {
+
+bool in_task() {
+    return t_self != nullptr;
+}
+
+uint64_t next_wake_us() {
+    uint64_t wake_us = never_us;
+    for (auto task : s_tasks) {
+        wake_us = std::min(wake_us, task->wake_us);
+    }
+    return wake_us;
+}
+
+RunInfo next_info() {
+    const sim_task* next = earliest();
+    if (next == nullptr) {
+        return RunInfo{};
+    }
+    return RunInfo{next->name, reinterpret_cast<void*>(next->task_code),
+                   next->parameters};
+}
+
+void run_next() {
+    sim_task* next = earliest();
+    if (next == nullptr) {
+        return;
+    }
+    next->wake_us = never_us;
+    switch_to(next, nullptr);
+}
+
+void block_until(uint64_t wake_us) {
+    sim_task* self = t_self;
+    self->wake_us = wake_us;
+    switch_to(nullptr, self);
+    if (self->deleted) {
+        throw TaskExit{};
+    }
+}
+
+} // namespace tasks
+} // namespace sim
@@ -0,0 +1,100 @@
+/* Host simulation: touch pad driver model
+ *
+ * The software filter runs on its own esp_timer like in the IDF and
+ * reports the simulated sensor values to the registered read callback.
+ */
+#include "driver/touch_pad.h"
+#include "esp_timer.h"
+#include "sim.hpp"
+
+namespace {
+
+uint16_t s_value[TOUCH_PAD_MAX] = {
+    sim::touch_value_released, sim::touch_value_released,
+    sim::touch_value_released, sim::touch_value_released,
+    sim::touch_value_released, sim::touch_value_released,
+    sim::touch_value_released, sim::touch_value_released,
+    sim::touch_value_released, sim::touch_value_released,
+};
+filter_cb_t s_filter_cb = nullptr;
+esp_timer_handle_t s_filter_timer = nullptr;
+
+void filter_timer_cb(void*) {
+    if (s_filter_cb) {
+        uint16_t raw[TOUCH_PAD_MAX];
+        for (int i = 0; i < TOUCH_PAD_MAX; ++i) {
+            raw[i] = s_value[i];
+        }
+        s_filter_cb(raw, s_value);
+    }
+}
+
+} // namespace
+
+esp_err_t touch_pad_init() {
+    return ESP_OK;
+}
+
+esp_err_t touch_pad_deinit() {
+    touch_pad_filter_stop();
+    return ESP_OK;
+}
+
+esp_err_t touch_pad_set_fsm_mode(touch_fsm_mode_t mode) {
+    return mode < TOUCH_FSM_MODE_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t touch_pad_set_voltage(touch_high_volt_t, touch_low_volt_t,
+                                touch_volt_atten_t) {
+    return ESP_OK;
+}
+
+esp_err_t touch_pad_config(touch_pad_t touch_num, uint16_t) {
+    return touch_num < TOUCH_PAD_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t touch_pad_filter_start(uint32_t filter_period_ms) {
+    if (filter_period_ms == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_filter_timer != nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    const esp_timer_create_args_t args{filter_timer_cb, nullptr,
+                                       ESP_TIMER_TASK, "touch_filter"};
+    esp_timer_create(&args, &s_filter_timer);
+    return esp_timer_start_periodic(s_filter_timer, filter_period_ms * 1000ULL);
+}
+
+esp_err_t touch_pad_filter_stop() {
+    if (s_filter_timer == nullptr) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_timer_stop(s_filter_timer);
+    esp_timer_delete(s_filter_timer);
+    s_filter_timer = nullptr;
+    return ESP_OK;
+}
+
+esp_err_t touch_pad_set_filter_read_cb(filter_cb_t read_cb) {
+    s_filter_cb = read_cb;
+    return ESP_OK;
+}
+
+esp_err_t touch_pad_read_filtered(touch_pad_t touch_num, uint16_t* touch_value) {
+    if (touch_num >= TOUCH_PAD_MAX || touch_value == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *touch_value = s_value[touch_num];
+    return ESP_OK;
+}
+
+namespace sim {
+
+void touch_set_value(int pad, uint16_t value) {
+    if (pad >= 0 && pad < TOUCH_PAD_MAX) {
+        s_value[pad] = value;
+    }
+}
+
+} // namespace sim
@@ -3,6 +3,9 @@
  * Based on ESPAsyncWebServer, see:
  * https://github.com/me-no-dev/ESPAsyncWebServer
  */
+#include <algorithm>
+#include <cstring>
+
 #include <Update.h>
 #include <SPIFFS.h>
 #include <FS.h>
@@ -14,6 +17,79 @@
 #include "api_server.hpp"
 #include "api_server_config.hpp"
 #include "http_content.hpp"
+#include "page_template.hpp"
+
+namespace {
+
+// Static text and placeholder slots of the page
+constexpr size_t n_page_segments = page_template::count_segments(index_html);
+constexpr auto page_segments = page_template::split<n_page_segments>(index_html);
+// "/" and "/cmd" share the rendered page
+static_assert(api_return_html == index_html, "API page must be the index page");
+
+// Upper limit for the size of an event on the wire: Retry, id and event
+// name lines plus the data
+constexpr size_t max_event_size = APIServer::state_buffer_size + 64;
+
+// End of the member of a flat JSON object starting at member, which is
+// the next comma or closing brace outside of a string
+const char* member_end(const char* member) {
+    bool in_string = false;
+    for (const char* c = member; *c != '\0'; ++c) {
+        if (*c == '"' && (c == member || c[-1] != '\\')) {
+            in_string = !in_string;
+        } else if (!in_string && (*c == ',' || *c == '}')) {
+            return c;
+        }
+    }
+    return nullptr;
+}
+
+// Calls on_member(member, len) for each "key":value of a flat JSON object
+template<typename MemberFnT>
+void for_each_member(const char* object, MemberFnT on_member) {
+    if (*object != '{') {
+        return;
+    }
+    const char* member = object + 1;
+    while (*member == '"') {
+        const char* end = member_end(member);
+        if (end == nullptr) {
+            return;
+        }
+        on_member(member, static_cast<size_t>(end - member));
+        member = *end == ',' ? end + 1 : end;
+    }
+}
+
+// Writes the members of state which are not in old_state with the same
+// value as JSON object into delta, returns the number of these members.
+// The delta is never longer than state.
+size_t json_delta(const char* old_state, const char* state, char* delta) {
+    size_t n_changed = 0;
+    char* out = delta;
+    *out++ = '{';
+    for_each_member(state, [&](const char* member, size_t len) {
+        bool unchanged = false;
+        for_each_member(old_state, [&](const char* old_member, size_t old_len) {
+            unchanged = unchanged
+                || (old_len == len && std::memcmp(old_member, member, len) == 0);
+        });
+        if (unchanged) {
+            return;
+        }
+        if (n_changed++ > 0) {
+            *out++ = ',';
+        }
+        std::memcpy(out, member, len);
+        out += len;
+    });
+    *out++ = '}';
+    *out = '\0';
+    return n_changed;
+}
+
+} // namespace
 
 ///////////// APIServer:: public
 
@@ -21,19 +97,52 @@ APIServer::APIServer(AsyncWebServer* http_backend)
     // public
     : backend{http_backend}
     , event_source{nullptr}
+    , websocket{nullptr}
     , reboot_requested{false}
     , event_timer{}
+    , idle_ms{0}
+    , event_clients_lock{}
+    , event_clients{}
+    , n_events_coalesced{0}
+    , n_events_dropped{0}
+    , n_event_clients_closed{0}
+    , push_timer{nullptr}
+    , push_pending{false}
+    , pushed_state{}
+    , push_buffer{}
+    , delta_buffer{}
+    , page_body{}
+    , page_etag{}
+    , template_version{1}
+    , page_version{0}
+    , ws_callback{}
+    , n_ws_rejected{0}
+    , state_callback{}
 {   
-    if (mount_spiffs_requested) {
-        if (!SPIFFS.begin(true)) {
+    if (mount_spiffs_requested || file_uploads_activated
+            || melody_uploads_activated) {
+        if (!SPIFFS.begin(format_spiffs_on_fail)) {
             error_print("Error mounting SPI Flash File System");
         }
     }
-    event_timer.attach_ms(heartbeat_interval, on_timer_event, this);
+    event_timer.attach_ms(event_timer_interval, on_timer_event, this);
+    esp_timer_create_args_t timer_config{};
+    timer_config.callback = reinterpret_cast<esp_timer_cb_t>(on_push_event);
+    timer_config.arg = this;
+    timer_config.dispatch_method = ESP_TIMER_TASK;
+    timer_config.name = "state_push";
+    if (esp_timer_create(&timer_config, &push_timer) != ESP_OK) {
+        error_print("APIServer: esp_timer_create failed");
+        push_timer = nullptr;
+    }
 }
 
 APIServer::~APIServer() {
     event_timer.detach();
+    if (push_timer) {
+        esp_timer_stop(push_timer);
+        esp_timer_delete(push_timer);
+    }
     free(event_source);
 }
 
@@ -43,7 +152,11 @@ void APIServer::set_template(const char* placeholder, const char* replacement) {
         error_print("ERROR: template processing must be activated!");
         return;
     };
-    template_map[String(placeholder)] = String(replacement);
+    String& value = template_map[String(placeholder)];
+    if (value != replacement) {
+        value = replacement;
+        ++template_version;
+    }
 }
 
 void APIServer::activate_events_on(const char* endpoint) {
@@ -51,45 +164,106 @@ void APIServer::activate_events_on(const char* endpoint) {
     register_sse_callbacks();
 }
 
+void APIServer::activate_websocket_on(const char* endpoint) {
+    websocket = new AsyncWebSocket(endpoint);
+    websocket->onEvent([this](AsyncWebSocket *server, AsyncWebSocketClient *client,
+                              AwsEventType type, void *arg, uint8_t *data, size_t len) {
+            onWebSocketEvent(client, type, arg, data, len);
+        }
+    );
+    backend->addHandler(websocket);
+}
+
 void APIServer::register_api_cb(const char* cmd_name,
                                  CbStringT cmd_callback) {
-    cmd_map[cmd_name] = cmd_callback;
+    cmd_registry.add(cmd_name, cmd_callback);
     debug_print_sv("Registered String command: ", cmd_name);
 }
 
 void APIServer::register_api_cb(const char* cmd_name,
                                  CbFloatT cmd_callback) {
-    cmd_map[cmd_name] = [cmd_callback](const String& value) {
+    cmd_registry.add(cmd_name, [cmd_callback](const String& value) {
         // Arduino String.toFloat() defaults to zero for invalid string, hmm...
         cmd_callback(value.toFloat());
-    };
+    });
     debug_print_sv("Registered float command: ", cmd_name);
 }
 
 void APIServer::register_api_cb(const char* cmd_name,
                                  CbIntT cmd_callback) {
-    cmd_map[cmd_name] = [cmd_callback](const String& value) {
+    cmd_registry.add(cmd_name, [cmd_callback](const String& value) {
         // Arduino String.toFloat() defaults to zero for invalid string, hmm...
         cmd_callback(value.toInt());
-    };
+    });
     debug_print_sv("Registered int command: ", cmd_name);
 }
 
 void APIServer::register_api_cb(const char* cmd_name,
                                  CbVoidT cmd_callback) {
-    cmd_map[cmd_name] = [cmd_callback](const String& value) {
+    cmd_registry.add(cmd_name, [cmd_callback](const String& value) {
         cmd_callback();
-    };
+    });
     debug_print_sv("Registered void command:", cmd_name);
 }
 
+void APIServer::register_body_cb(const char* endpoint,
+                                 CbBodyT body_callback) {
+    body_map[endpoint] = body_callback;
+    backend->on(endpoint, HTTP_POST,
+        [this](AsyncWebServerRequest *request) {
+            onBodyRequest(request);
+        },
+        nullptr,
+        [this](AsyncWebServerRequest *request,
+               uint8_t *data, size_t len, size_t index, size_t total) {
+            onBody(request, data, len, index, total);
+        }
+    );
+    debug_print_sv("Registered body endpoint:", endpoint);
+}
+
 void APIServer::begin() {
     activate_default_callbacks();
     backend->begin();
 }
 
+void APIServer::register_state_cb(CbStateT state_callback) {
+    this->state_callback = state_callback;
+    backend->on(state_endpoint, HTTP_GET, [this](AsyncWebServerRequest *request) {
+            onStateRequest(request);
+        }
+    );
+}
+
+void APIServer::register_ws_cb(CbBodyT ws_callback) {
+    this->ws_callback = ws_callback;
+}
+
+void APIServer::send_ws(const uint8_t* data, size_t len) {
+    if (websocket != nullptr) {
+        websocket->binaryAll(data, len);
+    }
+}
+
+// Only the first change arms the timer, later ones are sent with it
+void APIServer::notify_state_changed() {
+    if (push_timer == nullptr || !state_callback) {
+        return;
+    }
+    if (!push_pending.exchange(true)) {
+        esp_timer_start_once(push_timer, state_push_delay_ms * 1000);
+    }
+}
+
 // Normal HTTP request handlers
 void APIServer::activate_default_callbacks() {
+    // Embedded web UI assets, registered before the static files handler
+    for (const auto& asset : web_assets::assets) {
+        backend->on(asset.url, HTTP_GET, [&asset](AsyncWebServerRequest *request) {
+                onAssetRequest(request, asset);
+            }
+        );
+    }
     // Serve static HTML and related files content
     if (mount_spiffs_requested) {
         auto handler = backend->serveStatic("/", SPIFFS, "/www/")
@@ -129,22 +303,69 @@ void APIServer::activate_default_callbacks() {
        },
        onUpdateUploadBody
     );
+    // File upload into SPIFFS
+    if (file_uploads_activated) {
+        auto& handler = backend->on(upload_endpoint, HTTP_POST,
+                                    onUploadRequest, onUpload);
+        if (http_auth_requested) {
+            handler.setAuthentication(http_user, http_pass);
+        }
+    }
+    // Melody file upload into SPIFFS, for /cmd?play
+    if (melody_uploads_activated) {
+        auto& handler = backend->on(melody_upload_endpoint, HTTP_POST,
+                                    onUploadRequest, onMelodyUpload);
+        if (http_auth_requested) {
+            handler.setAuthentication(http_user, http_pass);
+        }
+    }
     backend->onNotFound(onRequest);
-    backend->onFileUpload(onUpload);
-    backend->onRequestBody(onBody);
+    backend->onRequestBody([this](AsyncWebServerRequest *request,
+            uint8_t *data, size_t len, size_t index, size_t total) {
+            onBody(request, data, len, index, total);
+        }
+    );
     // Handler called when any DNS query is made via access point
     // addHandler(new CaptiveRequestHandler()).setFilter(ON_AP_FILTER);
+    cmd_registry.freeze();
     debug_print("Default callbacks set up");
 }
 
 
+uint32_t APIServer::events_coalesced() const {
+    return n_events_coalesced;
+}
+
+uint32_t APIServer::events_dropped() const {
+    return n_events_dropped;
+}
+
+uint32_t APIServer::event_clients_closed() const {
+    return n_event_clients_closed;
+}
+
+uint32_t APIServer::ws_messages_rejected() const {
+    return n_ws_rejected;
+}
+
+
 ///////// APIServer:: private
 
 // Timer update for heartbeats, reboot etc
 // Static function wraps member function to obtain C API callback
 void APIServer::on_timer_event(APIServer* self) {
+    if (self->event_source != nullptr) {
+        self->service_event_clients();
+    }
+    if (self->websocket != nullptr) {
+        self->websocket->cleanupClients();
+    }
     if (sending_heartbeats && self->event_source != nullptr) {
-        self->event_source->send("OK", "heartbeat");
+        self->idle_ms += event_timer_interval;
+        if (self->idle_ms >= heartbeat_interval) {
+            self->send_event("OK", "heartbeat", false);
+            self->idle_ms = 0;
+        }
     }
     if (self->reboot_requested) {
         debug_print("Rebooting...");
@@ -153,15 +374,132 @@ void APIServer::on_timer_event(APIServer* self) {
     }
 }
 
+// Sends the state changes since the last push, nothing when unchanged.
+// Without clients, only the last state is updated: New clients get the
+// complete state, later deltas are relative to it.
+void APIServer::push_state() {
+    push_pending = false;
+    const size_t len = state_callback(push_buffer, state_buffer_size);
+    if (len == 0 || len >= state_buffer_size) {
+        error_print("Error: State does not fit into the state buffer");
+        return;
+    }
+    if (json_delta(pushed_state, push_buffer, delta_buffer) == 0) {
+        return;
+    }
+    std::memcpy(pushed_state, push_buffer, len + 1);
+    if (event_source != nullptr && event_source->count() > 0) {
+        send_event(delta_buffer, "state", true);
+        idle_ms = 0;
+    }
+}
+
+void APIServer::add_event_client(AsyncEventSourceClient* client) {
+    std::lock_guard<std::recursive_mutex> lock{event_clients_lock};
+    for (auto& slot : event_clients) {
+        if (slot.client == nullptr) {
+            slot = EventClient{client, false, 0};
+            return;
+        }
+    }
+    error_print("Error: No event client slot left");
+    ++n_event_clients_closed;
+    client->close();
+}
+
+void APIServer::remove_event_client(AsyncEventSourceClient* client) {
+    std::lock_guard<std::recursive_mutex> lock{event_clients_lock};
+    for (auto& slot : event_clients) {
+        if (slot.client == client) {
+            slot.client = nullptr;
+        }
+    }
+}
+
+// Each waiting message is counted with the maximum event size, so the
+// budget holds whatever the library keeps per message
+void APIServer::send_event(const char* message, const char* event,
+                           bool is_state) {
+    std::lock_guard<std::recursive_mutex> lock{event_clients_lock};
+    size_t queued_bytes = 0;
+    for (const auto& slot : event_clients) {
+        if (slot.client != nullptr) {
+            queued_bytes += slot.client->packetsWaiting() * max_event_size;
+        }
+    }
+    const bool over_budget = queued_bytes + max_event_size > sse_queue_budget_bytes;
+    for (auto& slot : event_clients) {
+        if (slot.client == nullptr) {
+            continue;
+        }
+        if (slot.stale || over_budget
+                || slot.client->packetsWaiting() >= sse_max_queue_depth) {
+            if (is_state) {
+                slot.stale = true;
+                ++n_events_coalesced;
+            } else {
+                ++n_events_dropped;
+            }
+            continue;
+        }
+        slot.client->send(message, event);
+    }
+}
+
+void APIServer::service_event_clients() {
+    std::lock_guard<std::recursive_mutex> lock{event_clients_lock};
+    for (auto& slot : event_clients) {
+        AsyncEventSourceClient* client = slot.client;
+        if (client == nullptr) {
+            continue;
+        }
+        const size_t waiting = client->packetsWaiting();
+        if (slot.stale && waiting == 0 && pushed_state[0] != '\0') {
+            slot.stale = false;
+            client->send(pushed_state, "state");
+        }
+        // A stale client has not caught up until its queue is empty
+        const bool behind = waiting >= sse_max_queue_depth || (slot.stale && waiting > 0);
+        if (!behind) {
+            slot.behind_ms = 0;
+            continue;
+        }
+        slot.behind_ms += event_timer_interval;
+        if (slot.behind_ms >= sse_slow_client_timeout_ms) {
+            error_print("Error: Closing event client which is behind");
+            ++n_event_clients_closed;
+            slot.client = nullptr;
+            client->close();
+        }
+    }
+}
+
+void APIServer::on_push_event(APIServer* self) {
+    self->push_state();
+}
+
 // Sever-Sent Event Source
 void APIServer::register_sse_callbacks() {
-    event_source->onConnect([](AsyncEventSourceClient *client) {
+    event_source->onConnect([this](AsyncEventSourceClient *client) {
         if(client->lastId()){
             info_print_sv("Client connected! Last msg ID:", client->lastId());
         }
-        //send event with message "hello!", id current millis
+        add_event_client(client);
+        if (!client->connected()) {
+            return;
+        }
+        // The complete state as first event, id current millis
         // and set reconnect delay to 1 second
-        client->send("Hello Message from ESP32!", NULL, millis(), 1000);
+        char state[state_buffer_size];
+        const size_t len = state_callback ? state_callback(state, sizeof(state)) : 0;
+        if (len > 0 && len < sizeof(state)) {
+            client->send(state, "state", millis(), 1000);
+        } else {
+            client->send("Hello Message from ESP32!", NULL, millis(), 1000);
+        }
+    });
+    event_source->onDisconnect([this](AsyncEventSourceClient *client) {
+        remove_event_client(client);
     });
     // HTTP Basic Authentication
     //if (USE_AUTH) {
@@ -179,23 +517,76 @@ String APIServer::templateProcessor(const String& placeholder)
                            placeholder);
             return placeholder;
         } else {
-            return template_map[placeholder];
+            return template_iterator->second;
+        }
+}
+
+// Copies the static segments and looks up each placeholder once.
+// Unknown placeholders are kept as their name, same as templateProcessor().
+void APIServer::render_page() {
+    auto body = std::make_shared<String>();
+    if (template_processing_activated) {
+        body->reserve(sizeof(index_html));
+        for (const auto& segment : page_segments) {
+            const char* text = index_html + segment.offset;
+            if (!segment.is_placeholder) {
+                body->concat(text, segment.length);
+                continue;
+            }
+            const auto template_iterator = template_map.find(String{text, segment.length});
+            if (template_iterator == template_map.end()) {
+                body->concat(text, segment.length);
+            } else {
+                body->concat(template_iterator->second);
+            }
         }
+    } else {
+        *body = index_html;
+    }
+    // FNV-1a
+    uint32_t hash = 2166136261UL;
+    for (unsigned int i = 0; i < body->length(); ++i) {
+        hash ^= static_cast<uint8_t>((*body)[i]);
+        hash *= 16777619UL;
+    }
+    page_body = std::move(body);
+    char etag[11];
+    snprintf(etag, sizeof(etag), "\"%08x\"", static_cast<unsigned>(hash));
+    page_etag = etag;
+    page_version = template_version;
+}
+
+void APIServer::send_page(AsyncWebServerRequest *request) {
+    if (page_version != template_version) {
+        render_page();
+    }
+    const AsyncWebHeader* if_none_match = request->getHeader("If-None-Match");
+    AsyncWebServerResponse *response;
+    if (if_none_match != nullptr && if_none_match->value() == page_etag) {
+        response = request->beginResponse(304);
+    } else {
+        // Sent from the rendered page without a copy. The filler holds
+        // a reference, so the page stays valid until it has been sent.
+        std::shared_ptr<const String> page = page_body;
+        response = request->beginResponse("text/html", page->length(),
+            [page](uint8_t* buffer, size_t max_len, size_t index) -> size_t {
+                const size_t n = std::min<size_t>(max_len, page->length() - index);
+                memcpy(buffer, page->c_str() + index, n);
+                return n;
+            }
+        );
+    }
+    response->addHeader("ETag", page_etag);
+    // Revalidate on every load, the page changes with the application state
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
 }
 
 // on("/")
 void APIServer::onRootRequest(AsyncWebServerRequest *request) {
     if (!mount_spiffs_requested) {
         // Static content is handled by default handler for static content
-        if (template_processing_activated) {
-            request->send_P(200, "text/html", index_html,
-                            [this](const String& placeholder) {
-                                return templateProcessor(placeholder);
-                            }
-            );
-        } else {
-            request->send_P(200, "text/html", index_html);
-        }
+        send_page(request);
     }
 }
 
@@ -204,41 +595,90 @@ void APIServer::onCmdRequest(AsyncWebServerRequest *request) {
     int n_params = request->params();
     debug_print_sv("Number of parameters received:", n_params);
     for (int i = 0; i < n_params; ++i) {
-        AsyncWebParameter *p = request->getParam(i);
-        const String name = p->name();
-        const String value_str = p->value();
+        const AsyncWebParameter *p = request->getParam(i);
+        const String& name = p->name();
+        const String& value_str = p->value();
         debug_print_sv("-----\nParam name:", name);
         debug_print_sv("Param value:", value_str);
-        auto cb_iterator = cmd_map.find(name);
-        if (cb_iterator == cmd_map.end()) {
+        const CbStringT* cmd_callback = cmd_registry.find(
+            std::string_view{name.c_str(), name.length()});
+        if (cmd_callback == nullptr) {
             error_print_sv("Error: Not registered in command mapping:", name);
             continue;
         }
-        CbStringT cmd_callback = (*cb_iterator).second; // = cmd_map[name];
-        if (!cmd_callback) {
+        if (!*cmd_callback) {
             error_print_sv("Error: Not a callable object!", name);
             continue;
         }
-        // Finally call callback
-        cmd_callback(value_str);
+        // Finally call callback, by reference
+        (*cmd_callback)(value_str);
     }
     if (api_is_ajax) {
         // For AJAX interface: Return a plain string, default is empty string.
-        request->send(200, "text/plain", ajax_return_text);
+        if (*ajax_return_text == '\0') {
+            request->send(204);
+        } else {
+            request->send(200, "text/plain", ajax_return_text);
+        }
     } else if (!mount_spiffs_requested) {
         // Static content is handled by default handler for static content
-        if (template_processing_activated) {
-            request->send_P(200, "text/html", api_return_html,
-                            [this](const String& placeholder) {
-                                return templateProcessor(placeholder);
-                            }
-            );
-        } else {
-            request->send_P(200, "text/html", api_return_html);
+        send_page(request);
+    }
+}
+
+// WebSocket events. Messages are expected to fit into one frame, which
+// is the case for a few hundred bytes.
+void APIServer::onWebSocketEvent(AsyncWebSocketClient *client, AwsEventType type,
+                                 void *arg, uint8_t *data, size_t len) {
+    switch (type) {
+        case WS_EVT_CONNECT:
+            debug_print_sv("WebSocket client connected:", client->id());
+            break;
+        case WS_EVT_DISCONNECT:
+            debug_print_sv("WebSocket client disconnected:", client->id());
+            break;
+        case WS_EVT_DATA: {
+            const AwsFrameInfo *info = static_cast<const AwsFrameInfo*>(arg);
+            const bool complete = info->final && info->index == 0 && info->len == len;
+            if (!complete || info->opcode != WS_BINARY || !ws_callback
+                    || !ws_callback(data, len)) {
+                ++n_ws_rejected;
+            }
+            break;
         }
+        default:
+            break;
     }
 }
 
+// on(state_endpoint)
+// The response is sent after the handler has returned, when the TCP
+// window allows. It owns a copy of the JSON text, which is written into
+// a buffer on the stack.
+void APIServer::onStateRequest(AsyncWebServerRequest *request) {
+    char state[state_buffer_size];
+    const size_t len = state_callback(state, sizeof(state));
+    if (len == 0 || len >= sizeof(state)) {
+        error_print("Error: State does not fit into the state buffer");
+        request->send(500);
+        return;
+    }
+    AsyncWebServerResponse *response = request->beginResponse(
+        200, "application/json", String{state});
+    response->addHeader("Cache-Control", "no-store");
+    request->send(response);
+}
+
+// The URL changes with the content, so the browser never needs to ask again
+void APIServer::onAssetRequest(AsyncWebServerRequest *request,
+                               const web_assets::Asset& asset) {
+    AsyncWebServerResponse *response = request->beginResponse_P(
+        200, asset.content_type, asset.gz, asset.gz_size);
+    response->addHeader("Content-Encoding", "gzip");
+    response->addHeader("Cache-Control", asset_cache_control);
+    request->send(response);
+}
+
 // on("/update")
 // When update is initiated via GET
 void APIServer::onUpdateRequest(AsyncWebServerRequest *request) {
@@ -274,6 +714,19 @@ void APIServer::onUpdateUploadBody(
     }
 } // on("/update")
 
+// on() endpoints registered via register_body_cb()
+void APIServer::onBodyRequest(AsyncWebServerRequest *request) {
+    auto cb_iterator = body_map.find(request->url());
+    const size_t len = request->contentLength();
+    if (cb_iterator == body_map.end() || request->_tempObject == nullptr) {
+        request->send(len > max_body_size ? 413 : 400);
+        return;
+    }
+    const bool accepted = cb_iterator->second(
+        static_cast<const uint8_t*>(request->_tempObject), len);
+    request->send(accepted ? 200 : 400, "text/plain", accepted ? "OK" : "FAIL");
+}
+
 /* Catch-All-Handlers
  */
 void APIServer::onRequest(AsyncWebServerRequest *request) {
@@ -283,12 +736,63 @@ void APIServer::onRequest(AsyncWebServerRequest *request) {
 
 void APIServer::onBody(AsyncWebServerRequest *request,
         uint8_t *data, size_t len, size_t index, size_t total) {
-    //Handle body
+    // Body is collected in the request scratch buffer, which is released
+    // together with the request
+    if (total > max_body_size || body_map.find(request->url()) == body_map.end()) {
+        return;
+    }
+    if (index == 0) {
+        request->_tempObject = malloc(total);
+    }
+    if (request->_tempObject != nullptr && index + len <= total) {
+        memcpy(static_cast<uint8_t*>(request->_tempObject) + index, data, len);
+    }
+}
+
+// on(upload_endpoint)
+// The upload file is kept open by onUpload() when it was stored completely
+void APIServer::onUploadRequest(AsyncWebServerRequest *request) {
+    const bool ok = request->_tempFile;
+    request->_tempFile.close();
+    request->send(ok ? 200 : 500, "text/plain", ok ? "OK" : "FAIL");
 }
 
 void APIServer::onUpload(AsyncWebServerRequest *request, const String& filename,
         size_t index, uint8_t *data, size_t len, bool final) {
-    //Handle upload
+    const String path = String(upload_dir) + filename;
+    if (index == 0) {
+        if (filename.length() == 0 || filename.indexOf('/') >= 0
+                || path.length() > max_upload_path_length) {
+            error_print_sv("Invalid upload file name:", filename);
+            return;
+        }
+        info_print_sv("Upload Start:", path);
+        request->_tempFile = SPIFFS.open(path, FILE_WRITE);
+    }
+    if (!request->_tempFile) {
+        return;
+    }
+    if (request->_tempFile.write(data, len) != len) {
+        error_print_sv("Upload failed, file system full?", path);
+        request->_tempFile.close();
+        SPIFFS.remove(path);
+        return;
+    }
+    if (final) {
+        info_print_sv("Upload Success:", index + len);
+    }
+}
+
+// on(melody_upload_endpoint)
+// Without an open upload file, the following chunks are ignored
+void APIServer::onMelodyUpload(AsyncWebServerRequest *request,
+        const String& filename, size_t index, uint8_t *data, size_t len,
+        bool final) {
+    if (index == 0 && !filename.endsWith(melody_file_suffix)) {
+        error_print_sv("Not a melody file:", filename);
+        return;
+    }
+    onUpload(request, filename, index, data, len, final);
 }
 
 #ifdef WORK_IN_PROGRESS__
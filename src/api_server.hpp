@@ -6,38 +6,57 @@
 #ifndef API_SERVER_HPP__
 #define API_SERVER_HPP__
 
+#include <atomic>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <functional>
 
 //#include <Arduino.h>
 #include <Ticker.h>
 #include <AsyncTCP.h>
 #include <ESPAsyncWebServer.h>
+#include <esp_timer.h>
+
+#include "cmd_registry.hpp"
+#include "web_assets.hpp"
 
-// Callback function with string argument
-using CbStringT = std::function<void(const String& )>;
 // Callback function with float argument
 using CbFloatT = std::function<void(const float)>;
 // Callback function with integer argument
 using CbIntT = std::function<void(const int)>;
 // Callback function without arguments
 using CbVoidT = std::function<void(void)>;
+// Callback function with binary data argument, returns true when accepted
+using CbBodyT = std::function<bool(const uint8_t* data, size_t len)>;
+// Callback function writing into a buffer of size bytes, returns the length
+using CbStateT = std::function<size_t(char* buffer, size_t size)>;
 
-// Mapping used for resolving command strings received via HTTP request
-// on the "/cmd" endpoint to specialised request handlers
-using CmdMapT = std::map<String, CbStringT>;
 // String replacement mapping for template processor
 using TemplateMapT = std::map<String, String>;
+// Mapping of endpoints receiving POST request bodies to their handlers
+using BodyMapT = std::map<String, CbBodyT>;
 
 class APIServer
 {
 public:
+    // Maximum size of the JSON text of register_state_cb()
+    static constexpr size_t state_buffer_size = 256;
+    // Server-Sent Events clients, more are refused
+    static constexpr uint8_t max_event_clients = 4;
+
     // Base ESPAsyncWebServer
     AsyncWebServer* backend;
     // Server-Sent Events (SSE) for "PUSH" updates of application data
     AsyncEventSource* event_source;
-    // Callback registry, see above
-    CmdMapT cmd_map;
+    // WebSocket for binary commands and data, see register_ws_cb()
+    AsyncWebSocket* websocket;
+    // Resolves command strings received via HTTP request on the "/cmd"
+    // endpoint to specialised request handlers, frozen by
+    // activate_default_callbacks()
+    CmdRegistry cmd_registry;
+    // Request body callback registry, see above
+    BodyMapT body_map;
     // String replacement mapping for template processor
     TemplateMapT template_map;
     // Polled in main loop
@@ -46,12 +65,16 @@ class APIServer
     APIServer(AsyncWebServer* http_backend);
     ~APIServer();
 
-    // Set an entry in the template processor string <=> string mapping 
+    // Set an entry in the template processor string <=> string mapping.
+    // A changed entry invalidates the rendered page.
     void set_template(const char* placeholder, const char* replacement);
 
     // Activate event source for Server-Sent Events on specified endpoint
     void activate_events_on(const char* endpoint);
 
+    // Activate the WebSocket on specified endpoint
+    void activate_websocket_on(const char* endpoint);
+
     /** Setup HTTP request callbacks to a common API endpoint,
      *  distinguished by individual command names.
      */
@@ -64,35 +87,138 @@ class APIServer
     // Overload for void callbacks
     void register_api_cb(const char* cmd_name, CbVoidT cmd_callback);
 
+    /** Setup an endpoint receiving binary data via POST request body.
+     *  The complete body (max_body_size) is passed to the callback,
+     *  the request is answered with 200 when the callback returns true.
+     */
+    void register_body_cb(const char* endpoint, CbBodyT body_callback);
+
+    /** Setup the state_endpoint, answered with the JSON text which the
+     *  callback writes into a fixed buffer of state_buffer_size bytes.
+     *  The JSON text must be a flat object without whitespace,
+     *  e.g. {"mode":"larson","on":true}.
+     */
+    void register_state_cb(CbStateT state_callback);
+
+    /** Setup the handler for messages received on the WebSocket.
+     *  Each complete binary message is passed to the callback, in the
+     *  network task. Text and fragmented messages are rejected.
+     */
+    void register_ws_cb(CbBodyT ws_callback);
+    // Send a binary message to all WebSocket clients
+    void send_ws(const uint8_t* data, size_t len);
+
+    // Push the changed members of the state as "state" event to the
+    // event source clients. Changes within state_push_delay_ms are sent
+    // as one event. New clients get the complete state.
+    void notify_state_changed();
+
     // Start execution, includes starting the ESPAsyncWebServer backend.
     // Do not call this when using WifiManger or when backend has been
     // activated before by other means
     void begin();
 
-    // Start execution, assuming the backend server is started elsewhere
+    // Start execution, assuming the backend server is started elsewhere.
+    // Commands should all be registered before this.
     void activate_default_callbacks();
 
+    // Event source backpressure statistics:
+    // State events not sent to a client which was behind, it gets the
+    // latest complete state instead when it has caught up
+    uint32_t events_coalesced() const;
+    // Other events not sent to a client which was behind
+    uint32_t events_dropped() const;
+    // Clients disconnected for being behind too long, or refused
+    // because all client slots were taken
+    uint32_t event_clients_closed() const;
+    // WebSocket messages not accepted by the callback or not binary
+    uint32_t ws_messages_rejected() const;
+
 
 private:
     // Async event timer
     Ticker event_timer;
 
+    // Time since the last event was sent, for the heartbeats
+    std::atomic<unsigned long> idle_ms;
+
+    // Event source clients with their backpressure state. The library
+    // calls the connect and disconnect callbacks from its own task.
+    struct EventClient
+    {
+        AsyncEventSourceClient* client;
+        // Events were skipped, the latest complete state is due
+        bool stale;
+        // Time since the queue of the client is full
+        unsigned long behind_ms;
+    };
+    std::recursive_mutex event_clients_lock;
+    EventClient event_clients[max_event_clients];
+    uint32_t n_events_coalesced;
+    uint32_t n_events_dropped;
+    uint32_t n_event_clients_closed;
+    void add_event_client(AsyncEventSourceClient* client);
+    void remove_event_client(AsyncEventSourceClient* client);
+    // Sends to all clients which are not behind.
+    // is_state: Skipped state events are replaced by the complete state.
+    void send_event(const char* message, const char* event, bool is_state);
+    // Resends the state to clients which have caught up, and disconnects
+    // clients which are behind for too long. Called by the event timer.
+    void service_event_clients();
+
     // Timer update for heartbeats, reboot etc
     // Static function wraps member function to obtain C API callback
     static void on_timer_event(APIServer* self);
 
+    // State change publisher: State as last sent, new state and the
+    // difference between both
+    esp_timer_handle_t push_timer;
+    std::atomic<bool> push_pending;
+    char pushed_state[state_buffer_size];
+    char push_buffer[state_buffer_size];
+    char delta_buffer[state_buffer_size];
+    void push_state();
+    static void on_push_event(APIServer* self);
+
     // Sever-Sent Event Source
     void register_sse_callbacks();
 
     // Template processor
     String templateProcessor(const String& placeholder);
 
+    // Page with all placeholders replaced, rendered again when the
+    // template mapping has changed. The ETag is a hash of the body.
+    // Responses still sending an older page keep it alive.
+    std::shared_ptr<const String> page_body;
+    String page_etag;
+    // Bumped on every template mapping change, and the version the
+    // page was rendered at
+    uint32_t template_version;
+    uint32_t page_version;
+    void render_page();
+    // Sends the rendered page, or 304 when the client has it already
+    void send_page(AsyncWebServerRequest *request);
+
     // on("/")
     void onRootRequest(AsyncWebServerRequest *request);
 
     // on("/cmd")
     void onCmdRequest(AsyncWebServerRequest *request);
 
+    // WebSocket messages, see register_ws_cb()
+    CbBodyT ws_callback;
+    uint32_t n_ws_rejected;
+    void onWebSocketEvent(AsyncWebSocketClient *client, AwsEventType type,
+                          void *arg, uint8_t *data, size_t len);
+
+    // on(state_endpoint)
+    CbStateT state_callback;
+    void onStateRequest(AsyncWebServerRequest *request);
+
+    // on() URLs of the embedded web assets
+    static void onAssetRequest(AsyncWebServerRequest *request,
+                               const web_assets::Asset& asset);
+
     // on("/update")
     // When update is initiated via GET
     void onUpdateRequest(AsyncWebServerRequest *request);
@@ -101,14 +227,26 @@ class APIServer
         AsyncWebServerRequest *request, const String& filename,
         size_t index, uint8_t *data, size_t len, bool final);
 
+    // on() endpoints registered via register_body_cb()
+    void onBodyRequest(AsyncWebServerRequest *request);
+
     // Catch-All-Handlers
     static void onRequest(AsyncWebServerRequest *request);
 
-    static void onBody(AsyncWebServerRequest *request,
+    // Also collects the body for endpoints registered via register_body_cb()
+    void onBody(AsyncWebServerRequest *request,
         uint8_t *data, size_t len, size_t index, size_t total);
 
+    // on(upload_endpoint)
+    static void onUploadRequest(AsyncWebServerRequest *request);
+    // Stores the file in SPIFFS, see upload_dir
     static void onUpload(AsyncWebServerRequest *request, const String& filename,
         size_t index, uint8_t *data, size_t len, bool final);
+    // on(melody_upload_endpoint)
+    // Stores only files ending with melody_file_suffix, see onUpload()
+    static void onMelodyUpload(AsyncWebServerRequest *request,
+        const String& filename, size_t index, uint8_t *data, size_t len,
+        bool final);
 
 }; // class APIServer
 
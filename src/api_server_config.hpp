@@ -1,25 +1,75 @@
 // When set to yes, mount SPIFFS filesystem and serve static content
 // from files contained in data/www at the "/" endpoint.
 constexpr bool mount_spiffs_requested = false;
+// Format SPIFFS when mounting fails. Any mount error then erases all
+// files, so a new file system is better created by "pio run -t uploadfs".
+constexpr bool format_spiffs_on_fail = false;
 // Default filename served from SPIFFS when "/" without filename is requested
 constexpr const char* index_html_filename = "index.html";
 
+// Web UI assets embedded by embed_web_assets.py are served gzipped from
+// flash. Their URLs contain a content hash, so they never change.
+constexpr const char* asset_cache_control = "public, max-age=31536000, immutable";
+
 // Activate template processing when defined
 constexpr bool template_processing_activated = true;
 
 // Common API endpoint for AJAX GET requests registered via regster_ajax_cb()
 constexpr const char* api_endpoint = "/cmd";
-// For AJAX, reply with an plain string, default is empty string.
+// For AJAX, reply with an plain string, default is empty string, which
+// is sent as 204 No Content. A plain link to api_endpoint then also
+// leaves the page as it is.
 // When not using AJAX, reply with content from string API_HTML as
 // defined in separate header http_content.hpp
-constexpr bool api_is_ajax = false;
+constexpr bool api_is_ajax = true;
 constexpr const char* ajax_return_text = "";
 
-// Send heartbeat message via SSE event source in regular intervals when
-// set to true. This needs regular calling of update_timer().
+// Application state as JSON, see register_state_cb()
+constexpr const char* state_endpoint = "/state";
+
+// Maximum size of POST request bodies for endpoints registered via
+// register_body_cb(). The body is buffered completely in RAM.
+constexpr size_t max_body_size = 4096;
+
+// Files uploaded via multipart POST request on upload_endpoint are stored
+// in SPIFFS in directory upload_dir. SPIFFS is mounted when set to true.
+// Anybody on the network can write to the flash then, so also set
+// http_auth_requested, which protects the endpoint.
+constexpr bool file_uploads_activated = false;
+constexpr const char* upload_endpoint = "/upload";
+constexpr const char* upload_dir = "/upload/";
+// SPIFFS limits the file path length
+constexpr size_t max_upload_path_length = 31;
+// Melody files for /cmd?play are uploaded on melody_upload_endpoint, also
+// when file_uploads_activated is false. Only file names ending with
+// melody_file_suffix are stored in upload_dir, protected by
+// http_auth_requested like the other endpoints. SPIFFS is mounted when
+// set to true.
+constexpr bool melody_uploads_activated = true;
+constexpr const char* melody_upload_endpoint = "/melody";
+constexpr const char* melody_file_suffix = ".rtttl";
+
+// Send heartbeat message via SSE event source when no other event was
+// sent for heartbeat_interval, when set to true.
 constexpr bool sending_heartbeats = true;
-// Interval time in milliseconds
-constexpr unsigned long heartbeat_interval = 1000;
+// Idle time in milliseconds, a multiple of event_timer_interval
+constexpr unsigned long heartbeat_interval = 15000;
+// Period of the timer for heartbeats, reboot etc, in milliseconds
+constexpr unsigned long event_timer_interval = 1000;
+// State changes within this time in milliseconds are coalesced into one
+// delta event, see notify_state_changed()
+constexpr unsigned long state_push_delay_ms = 20;
+
+// Server-Sent Events backpressure. A client with this many messages
+// waiting gets no more events. Instead it gets the latest complete state
+// once it has caught up.
+constexpr size_t sse_max_queue_depth = 8;
+// Budget for the messages waiting for all clients, in bytes. Each message
+// is counted with the maximum event size. Above the budget, no client
+// gets new events.
+constexpr size_t sse_queue_budget_bytes = 4096;
+// A client which is behind for this time in milliseconds is disconnected
+constexpr unsigned long sse_slow_client_timeout_ms = 10000;
 
 // Activate HTTP Basic Authentication, set to true when user/password is given
 constexpr bool http_auth_requested = false;
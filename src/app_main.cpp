@@ -43,6 +43,7 @@ void setup() {
     api_server = new APIServer{&http_backend};
     tannenbaum = new Tannenbaum{*api_server, Tannenbaum::LARSON};
     api_server->activate_events_on("/events");
+    api_server->activate_websocket_on("/ws");
     api_server->activate_default_callbacks();
 }
 
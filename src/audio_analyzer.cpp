@@ -0,0 +1,169 @@
+#include <algorithm>
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include "info_debug_error.h"
+#include "audio_analyzer.hpp"
+
+static_assert(AudioAnalyzer::block_size >> AudioAnalyzer::n_bands == 2,
+              "Octave bands must cover the bins up to half the sample rate");
+
+AudioAnalyzer::AudioAnalyzer(adc1_channel_t adc_channel, i2s_port_t i2s_port)
+    : adc_channel{adc_channel}
+    , i2s_port{i2s_port}
+    , raw{}
+    , pcm{}
+    , spectrum{}
+    , last_levels{}
+    , handoff{}
+{
+}
+
+AudioAnalyzer::~AudioAnalyzer() {
+    end();
+}
+
+// The built-in ADC is only available on I2S0
+bool AudioAnalyzer::begin() {
+    if (task) {
+        return true;
+    }
+    i2s_config_t i2s_config{};
+    i2s_config.mode = static_cast<i2s_mode_t>(
+        I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN);
+    i2s_config.sample_rate = sample_rate;
+    i2s_config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+    i2s_config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+    i2s_config.communication_format = I2S_COMM_FORMAT_I2S_MSB;
+    i2s_config.dma_buf_count = dma_buf_count;
+    i2s_config.dma_buf_len = block_size;
+    if (i2s_driver_install(i2s_port, &i2s_config, 0, nullptr) != ESP_OK) {
+        error_print("AudioAnalyzer: I2S driver install failed");
+        return false;
+    }
+    i2s_set_adc_mode(ADC_UNIT_1, adc_channel);
+    adc1_config_channel_atten(adc_channel, ADC_ATTEN_DB_11);
+    i2s_adc_enable(i2s_port);
+    std::fill(last_levels, last_levels + n_bands, 0);
+    stop_requested = false;
+    task_stopped = false;
+    if (xTaskCreatePinnedToCore(reinterpret_cast<TaskFunction_t>(dsp_task),
+                                "audio_dsp", task_stack_size, this,
+                                task_priority, &task, task_core) != pdPASS) {
+        error_print("AudioAnalyzer: DSP task creation failed");
+        task = nullptr;
+        i2s_adc_disable(i2s_port);
+        i2s_driver_uninstall(i2s_port);
+        return false;
+    }
+    debug_print("Audio input started");
+    return true;
+}
+
+void AudioAnalyzer::end() {
+    if (!task) {
+        return;
+    }
+    // The task may be blocked in i2s_read(), holding the driver lock.
+    // It returns from there after one block or the timeout and exits,
+    // only then the driver can be uninstalled.
+    stop_requested = true;
+    while (!task_stopped) {
+        vTaskDelay(1);
+    }
+    task = nullptr;
+    i2s_adc_disable(i2s_port);
+    i2s_driver_uninstall(i2s_port);
+    debug_print("Audio input stopped");
+}
+
+bool AudioAnalyzer::is_started() const {
+    return task != nullptr;
+}
+
+// The levels rise at once and fall by level_decay per block
+void AudioAnalyzer::analyze(const int16_t* samples, int64_t captured_us) {
+    const unsigned long start_us = micros();
+    fft::window(samples, spectrum);
+    fft::forward(spectrum);
+    BandLevels& out = handoff.back();
+    for (uint8_t band = 0; band < n_bands; ++band) {
+        uint64_t power = 0;
+        for (size_t bin = 1 << band; bin < 2U << band; ++bin) {
+            power += fft::power(spectrum[bin]);
+        }
+        const uint16_t fallen = last_levels[band] > level_decay
+                                ? last_levels[band] - level_decay : 0;
+        last_levels[band] = std::max(to_level(power), fallen);
+        out.levels[band] = last_levels[band];
+    }
+    out.captured_us = captured_us;
+    handoff.publish();
+    const unsigned long dsp_us = micros() - start_us;
+    dsp_us_max = std::max<uint32_t>(dsp_us_max, dsp_us);
+    dsp_us_sum += dsp_us;
+    ++n_blocks;
+}
+
+bool AudioAnalyzer::read_levels(BandLevels& out) {
+    if (!handoff.take()) {
+        return false;
+    }
+    out = handoff.front();
+    return true;
+}
+
+uint32_t AudioAnalyzer::blocks_analyzed() const {
+    return n_blocks;
+}
+
+uint32_t AudioAnalyzer::dsp_time_us_max() const {
+    return dsp_us_max;
+}
+
+uint32_t AudioAnalyzer::dsp_time_us_avg() const {
+    return n_blocks ? dsp_us_sum / n_blocks : 0;
+}
+
+///////////// private
+
+// ADC samples are 12-bit values with the channel number in the top bits,
+// centered and scaled to 16 bits for the FFT
+void AudioAnalyzer::run() {
+    while (!stop_requested) {
+        size_t bytes_read = 0;
+        i2s_read(i2s_port, raw, sizeof(raw), &bytes_read,
+                 pdMS_TO_TICKS(read_timeout_ms));
+        if (bytes_read < sizeof(raw)) {
+            continue;
+        }
+        const int64_t captured_us = esp_timer_get_time();
+        for (size_t i = 0; i < block_size; ++i) {
+            pcm[i] = static_cast<int16_t>(((raw[i] & 0x0FFF) - 2048) * 16);
+        }
+        analyze(pcm, captured_us);
+    }
+    task_stopped = true;
+    // A task function must not return
+    vTaskDelete(nullptr);
+}
+
+uint16_t AudioAnalyzer::to_level(uint64_t power) {
+    if (power == 0) {
+        return 0;
+    }
+    // log2 in Q8, the fraction taken linearly from the bits below the MSB
+    const int msb = 63 - __builtin_clzll(power);
+    const uint32_t fraction = msb >= 8 ? power >> (msb - 8) & 0xFF
+                                       : power << (8 - msb) & 0xFF;
+    const int32_t log2_q8 = msb * 256 + fraction;
+    constexpr int32_t range_q8 = (top_log2 - floor_log2) * 256;
+    const int32_t above_floor = std::min(range_q8,
+        std::max<int32_t>(0, log2_q8 - floor_log2 * 256));
+    return static_cast<uint16_t>(above_floor * UINT16_MAX / range_q8);
+}
+
+void AudioAnalyzer::dsp_task(AudioAnalyzer* self) {
+    self->run();
+}
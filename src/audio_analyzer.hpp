@@ -0,0 +1,111 @@
+/* Audio spectrum analyzer for the audio-reactive LED mode
+ *
+ * A microphone at an ADC1 pin is sampled by the I2S0 peripheral in
+ * built-in ADC mode, so whole blocks of samples arrive by DMA. A task
+ * runs each block through the fixed-point FFT (see fft.hpp) and sums up
+ * the power in octave bands. The band levels go to the LED frame clock
+ * on the timeline through a lock-free triple buffer.
+ *
+ * The built-in ADC and the PDM output of the synth both only exist on
+ * I2S0, so the analyzer and the synth take turns on it.
+ */
+#ifndef AUDIO_ANALYZER_HPP__
+#define AUDIO_ANALYZER_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <driver/i2s.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "fft.hpp"
+#include "triple_buffer.hpp"
+
+class AudioAnalyzer
+{
+public:
+    static constexpr int sample_rate = 16000;
+    // One FFT per block (16 ms), bins are 62.5 Hz apart
+    static constexpr size_t block_size = fft::size;
+    // DMA ring size in blocks
+    static constexpr int dma_buf_count = 4;
+    // Octave bands, band n covers bins 2^n...2^(n+1)-1 (62.5 Hz...8 kHz)
+    static constexpr uint8_t n_bands = 7;
+    // Band power shown from off to full level, as log2 of the FFT power.
+    // A full scale sine is 2^26, the range is 48 dB.
+    static constexpr uint8_t floor_log2 = 10;
+    static constexpr uint8_t top_log2 = 26;
+    // Fall of a band level per block, full range in 16 blocks (256 ms)
+    static constexpr uint16_t level_decay = UINT16_MAX / 16;
+    // DSP task on core 0, away from the Arduino loop on core 1. The
+    // esp_timer task (priority 22) and WiFi also run on core 0 and
+    // preempt it, a block takes a few milliseconds of its 16 ms.
+    static constexpr uint32_t task_stack_size = 4096;
+    static constexpr UBaseType_t task_priority = 5;
+    static constexpr BaseType_t task_core = 0;
+    // i2s_read() timeout of the DSP task, bounds the wait of end()
+    // when no samples arrive
+    static constexpr uint32_t read_timeout_ms = 2 * block_size * 1000 / sample_rate;
+
+    struct BandLevels
+    {
+        // Perceptually linear levels, 0...UINT16_MAX like LED brightness
+        uint16_t levels[n_bands];
+        // Time when the last sample of the block was received
+        int64_t captured_us;
+    };
+
+    explicit AudioAnalyzer(adc1_channel_t adc_channel,
+                           i2s_port_t i2s_port = I2S_NUM_0);
+    virtual ~AudioAnalyzer();
+
+    // Install the I2S driver in built-in ADC mode and start the DSP task
+    bool begin();
+    // Stop the DSP task and release the I2S peripheral. Waits for the
+    // task to finish its current block, at most read_timeout_ms.
+    void end();
+    bool is_started() const;
+
+    // Analyze one block of block_size samples and publish the band
+    // levels. Used by the DSP task, and for offline analysis on the host.
+    void analyze(const int16_t* samples, int64_t captured_us);
+
+    // Consumer side: Copies the latest band levels.
+    // Returns false when there are none since the last call.
+    bool read_levels(BandLevels& out);
+
+    // Statistics
+    uint32_t blocks_analyzed() const;
+    uint32_t dsp_time_us_max() const;
+    uint32_t dsp_time_us_avg() const;
+
+private:
+    const adc1_channel_t adc_channel;
+    const i2s_port_t i2s_port;
+
+    TaskHandle_t task = nullptr;
+    // Set by end(), the task exits after its current block and
+    // reports back when it does not use the I2S driver any more
+    std::atomic<bool> stop_requested{false};
+    std::atomic<bool> task_stopped{false};
+    // DSP task buffers: ADC samples, PCM samples, spectrum
+    uint16_t raw[block_size];
+    int16_t pcm[block_size];
+    fft::Complex spectrum[block_size];
+    // Band levels of the last block, for the decay
+    uint16_t last_levels[n_bands];
+    TripleBuffer<BandLevels> handoff;
+
+    uint32_t n_blocks = 0;
+    uint32_t dsp_us_max = 0;
+    uint64_t dsp_us_sum = 0;
+
+    void run();
+    // Band power to level, logarithmic between floor_log2 and top_log2
+    static uint16_t to_level(uint64_t power);
+
+    static void dsp_task(AudioAnalyzer* self);
+}; // class AudioAnalyzer
+
+#endif
@@ -0,0 +1,106 @@
+#include <algorithm>
+
+#include "info_debug_error.h"
+#include "cmd_registry.hpp"
+
+void CmdRegistry::add(const char* name, CbStringT callback) {
+    const std::string_view key{name};
+    frozen = false;
+    slots.clear();
+    for (auto& entry : entries) {
+        if (entry.key() == key) {
+            entry.callback = std::move(callback);
+            return;
+        }
+    }
+    if (entries.size() >= no_entry) {
+        error_print_sv("Command registry full, not added:", name);
+        return;
+    }
+    entries.push_back(Entry{String{name}, std::move(callback)});
+}
+
+void CmdRegistry::freeze() {
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.key() < b.key();
+    });
+    entries.shrink_to_fit();
+    frozen = true;
+    size_t n_slots = 1;
+    while (n_slots < slots_per_entry * entries.size()) {
+        n_slots *= 2;
+    }
+    slots.assign(n_slots, no_entry);
+    for (uint32_t candidate = 0; candidate < max_seed_tries; ++candidate) {
+        if (try_seed(candidate)) {
+            seed = candidate;
+            debug_print_sv("Command registry: Perfect hash seed", seed);
+            return;
+        }
+    }
+    slots.clear();
+    slots.shrink_to_fit();
+    debug_print("Command registry: No perfect hash, using binary search");
+}
+
+bool CmdRegistry::is_frozen() const {
+    return frozen;
+}
+
+bool CmdRegistry::has_perfect_hash() const {
+    return frozen && !slots.empty();
+}
+
+size_t CmdRegistry::size() const {
+    return entries.size();
+}
+
+const CbStringT* CmdRegistry::find(std::string_view name) const {
+    if (has_perfect_hash()) {
+        const uint8_t index = slots[hash(name, seed) & (slots.size() - 1)];
+        if (index != no_entry && entries[index].key() == name) {
+            return &entries[index].callback;
+        }
+        return nullptr;
+    }
+    if (frozen) {
+        const auto it = std::lower_bound(
+            entries.begin(), entries.end(), name,
+            [](const Entry& entry, std::string_view key) { return entry.key() < key; });
+        return it != entries.end() && it->key() == name ? &it->callback : nullptr;
+    }
+    for (const auto& entry : entries) {
+        if (entry.key() == name) {
+            return &entry.callback;
+        }
+    }
+    return nullptr;
+}
+
+///////////// private
+
+uint32_t CmdRegistry::hash(std::string_view key, uint32_t seed) {
+    uint32_t value = 2166136261UL ^ (seed * 0x9E3779B9UL);
+    for (const char c : key) {
+        value ^= static_cast<uint8_t>(c);
+        value *= 16777619UL;
+    }
+    // The low bits of FNV only depend on the low bits of the basis,
+    // mix in the high bits for the table index
+    value ^= value >> 16;
+    value *= 0x85EBCA6BUL;
+    value ^= value >> 13;
+    return value;
+}
+
+bool CmdRegistry::try_seed(uint32_t candidate) {
+    std::fill(slots.begin(), slots.end(), no_entry);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        uint8_t& slot = slots[hash(entries[i].key(), candidate) & (slots.size() - 1)];
+        if (slot != no_entry) {
+            return false;
+        }
+        slot = static_cast<uint8_t>(i);
+    }
+    return true;
+}
@@ -0,0 +1,68 @@
+/* Command registry for the "/cmd" API endpoint
+ *
+ * Commands are added during setup. freeze() then sorts them into a flat
+ * table and searches a seed for which the hash of every command name
+ * hits its own slot of a small index table (perfect hash). Lookups take
+ * a non-owning string view, hash it once and compare a single entry,
+ * without any heap allocation. When no perfect hash is found, lookups
+ * fall back to a binary search of the sorted table.
+ */
+#ifndef CMD_REGISTRY_HPP__
+#define CMD_REGISTRY_HPP__
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+#include <WString.h>
+
+// Callback function with string argument
+using CbStringT = std::function<void(const String& )>;
+
+class CmdRegistry
+{
+public:
+    // Seeds tried by freeze() before falling back to binary search
+    static constexpr uint32_t max_seed_tries = 4096;
+    static constexpr uint8_t no_entry = UINT8_MAX;
+    // Index table slots per command, more slots find a seed sooner
+    static constexpr size_t slots_per_entry = 2;
+
+    // Add or replace a command. A frozen registry is unfrozen, lookups
+    // are then linear until the next freeze().
+    void add(const char* name, CbStringT callback);
+    // Build the lookup tables, call after setup
+    void freeze();
+    bool is_frozen() const;
+    // True when freeze() found a perfect hash
+    bool has_perfect_hash() const;
+    size_t size() const;
+
+    // Callback registered for name, nullptr when there is none.
+    // Valid until the next add().
+    const CbStringT* find(std::string_view name) const;
+
+private:
+    struct Entry
+    {
+        String name;
+        CbStringT callback;
+
+        std::string_view key() const {
+            return std::string_view{name.c_str(), name.length()};
+        }
+    };
+
+    std::vector<Entry> entries;
+    // Perfect hash index table, slot => entry index or no_entry
+    std::vector<uint8_t> slots;
+    uint32_t seed = 0;
+    bool frozen = false;
+
+    // FNV-1a with a final mix, the seed varies the offset basis
+    static uint32_t hash(std::string_view key, uint32_t seed);
+    bool try_seed(uint32_t seed);
+}; // class CmdRegistry
+
+#endif
@@ -0,0 +1,150 @@
+#include <cstring>
+#include <Arduino.h>
+
+#include "compositor.hpp"
+#include "packed16.hpp"
+
+Compositor::Compositor(unsigned long frame_clock_ms)
+    : breathe_increment{static_cast<uint32_t>(
+        (1ULL << 32) * frame_clock_ms / breathe_period_ms)}
+    , layers{}
+    , frame{}
+    , scratch{}
+    , output{}
+    , overruns{0}
+{
+    set_layer(BREATHE, false, BLEND_MAX, 112);
+    set_layer(SPARKLE, false, BLEND_ADD, UINT8_MAX);
+    set_layer(FLASH, false, BLEND_MAX, 160);
+}
+
+void Compositor::set_layer(enum LAYER_TYPES type, bool enabled,
+                           enum BLEND_MODES blend, uint8_t opacity) {
+    Layer& layer = layers[type];
+    layer.enabled = enabled;
+    layer.blend = blend;
+    layer.opacity = opacity;
+    layer.cost_us = 0;
+}
+
+bool Compositor::toggle_layer(enum LAYER_TYPES type) {
+    Layer& layer = layers[type];
+    layer.enabled = !layer.enabled;
+    if (layer.enabled) {
+        // Start from a dark layer, with a fresh render time estimate
+        layer.phase = 0;
+        std::memset(layer.values, 0, sizeof(layer.values));
+        layer.cost_us = 0;
+    }
+    return layer.enabled;
+}
+
+bool Compositor::has_active_layers() const {
+    for (const auto& layer : layers) {
+        if (layer.enabled) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Compositor::flash() {
+    std::memset(layers[FLASH].values, 0xFF, sizeof(layers[FLASH].values));
+}
+
+const uint16_t* Compositor::compose(const uint16_t* base, uint8_t n_channels,
+                                    unsigned long budget_us) {
+    // Nothing to blend, and no last lane to clear
+    if (n_channels == 0) {
+        return base;
+    }
+    const unsigned long start_us = micros();
+    if (n_channels > max_channels) {
+        n_channels = max_channels;
+    }
+    const uint8_t n_words_used = (n_channels + 1) / 2;
+    // Odd channel count: Last lane stays zero
+    frame[n_words_used - 1] = 0;
+    std::memcpy(frame, base, n_channels * sizeof(uint16_t));
+    for (int type = 0; type < n_layer_types; ++type) {
+        Layer& layer = layers[type];
+        if (!layer.enabled) {
+            continue;
+        }
+        // At least 1 us per frame, down to 0
+        layer.cost_us -= (layer.cost_us + cost_decay_divisor - 1) / cost_decay_divisor;
+        const unsigned long layer_start_us = micros();
+        if (layer_start_us - start_us + layer.cost_us > budget_us) {
+            ++overruns;
+            continue;
+        }
+        switch (type) {
+            case BREATHE: render_breathe(layer, n_words_used); break;
+            case SPARKLE: render_sparkle(layer, n_words_used, n_channels); break;
+            case FLASH: render_flash(layer, n_words_used); break;
+        }
+        if (layer.opacity != UINT8_MAX) {
+            for (uint8_t i = 0; i < n_words_used; ++i) {
+                scratch[i] = packed16::scale(scratch[i], layer.opacity);
+            }
+        }
+        switch (layer.blend) {
+            case BLEND_ADD:
+                for (uint8_t i = 0; i < n_words_used; ++i) {
+                    frame[i] = packed16::add_saturate(frame[i], scratch[i]);
+                }
+                break;
+            case BLEND_MAX:
+                for (uint8_t i = 0; i < n_words_used; ++i) {
+                    frame[i] = packed16::max(frame[i], scratch[i]);
+                }
+                break;
+        }
+        const unsigned long cost_us = micros() - layer_start_us;
+        if (cost_us > layer.cost_us) {
+            layer.cost_us = cost_us;
+        }
+    }
+    std::memcpy(output, frame, n_channels * sizeof(uint16_t));
+    return output;
+}
+
+uint32_t Compositor::budget_overruns() const {
+    return overruns;
+}
+
+///////////// private
+
+// Triangle wave over the full phase range, squared for a softer bottom
+void Compositor::render_breathe(Layer& layer, uint8_t n_words_used) {
+    layer.phase += breathe_increment;
+    const uint32_t position = layer.phase >> 16;
+    const uint32_t triangle = position < 0x8000 ? 2 * position
+                                                : 2 * (0xFFFF - position);
+    const uint16_t level = triangle * triangle >> 16;
+    const uint32_t packed_level = packed16::splat(level);
+    for (uint8_t i = 0; i < n_words_used; ++i) {
+        scratch[i] = packed_level;
+    }
+}
+
+// Decays all sparkles, then randomly ignites one channel at full brightness
+void Compositor::render_sparkle(Layer& layer, uint8_t n_words_used,
+                                uint8_t n_channels) {
+    for (uint8_t i = 0; i < n_words_used; ++i) {
+        layer.values[i] = packed16::scale(layer.values[i], sparkle_decay);
+    }
+    if (random(100) < sparkle_rate_percent) {
+        const long channel = random(n_channels);
+        layer.values[channel / 2] |= static_cast<uint32_t>(UINT16_MAX) << (16 * (channel % 2));
+    }
+    std::memcpy(scratch, layer.values, n_words_used * sizeof(uint32_t));
+}
+
+// Shows the flash level, then decays it for the next tick
+void Compositor::render_flash(Layer& layer, uint8_t n_words_used) {
+    for (uint8_t i = 0; i < n_words_used; ++i) {
+        scratch[i] = layer.values[i];
+        layer.values[i] = packed16::scale(layer.values[i], flash_decay);
+    }
+}
@@ -0,0 +1,91 @@
+/* Layered LED effect compositor
+ *
+ * The frame of the current operation mode is the base layer. Effect
+ * layers are blended on top of it, e.g. a slow global breathe glow under
+ * a Larson scanner plus random sparkles.
+ *
+ * Frames are processed as packed 16-bit brightness values, two channels
+ * per 32-bit word (see packed16.hpp), in one pass per layer.
+ *
+ * Each compose() call advances all effect layers by one frame clock tick.
+ * A render budget limits the time spent per frame: A layer which would
+ * not fit into the remaining budget is skipped for that frame. The render
+ * time of a layer is estimated by its recent maximum, which decays with
+ * every frame, so a single preempted render does not keep it skipped.
+ */
+#ifndef COMPOSITOR_HPP__
+#define COMPOSITOR_HPP__
+
+#include <cstdint>
+
+class Compositor
+{
+public:
+    static constexpr uint8_t max_channels = 16;
+
+    // Effect layers:
+    // BREATHE: All channels slowly glowing up and down together
+    // SPARKLE: Random channels flashing up and decaying
+    // FLASH: All channels flashing up on flash() and decaying
+    enum LAYER_TYPES{BREATHE, SPARKLE, FLASH};
+    static constexpr int n_layer_types = FLASH + 1;
+    // Blending of a layer onto the frame below
+    enum BLEND_MODES{BLEND_ADD, BLEND_MAX};
+
+    // Breathe cycle duration
+    static constexpr unsigned long breathe_period_ms = 4000;
+    // Sparkle probability per tick and decay factor per tick (x/256)
+    static constexpr long sparkle_rate_percent = 8;
+    static constexpr uint8_t sparkle_decay = 230;
+    // Flash decay factor per tick (x/256)
+    static constexpr uint8_t flash_decay = 200;
+
+    explicit Compositor(unsigned long frame_clock_ms);
+
+    // opacity: 0...255, 255 => layer is blended unscaled
+    void set_layer(enum LAYER_TYPES type, bool enabled,
+                   enum BLEND_MODES blend, uint8_t opacity);
+    bool toggle_layer(enum LAYER_TYPES type);
+    bool has_active_layers() const;
+    // Start a flash of the FLASH layer
+    void flash();
+
+    // Blend all enabled layers over the base frame, returns the result,
+    // which is valid until the next call.
+    const uint16_t* compose(const uint16_t* base, uint8_t n_channels,
+                            unsigned long budget_us);
+
+    // Number of layer renders skipped because of the render budget
+    uint32_t budget_overruns() const;
+
+private:
+    static constexpr uint8_t n_words = max_channels / 2;
+    static constexpr unsigned long cost_decay_divisor = 8;
+
+    struct Layer
+    {
+        bool enabled;
+        enum BLEND_MODES blend;
+        uint8_t opacity;
+        // Animation state
+        uint32_t phase;
+        uint32_t values[n_words];
+        // Render time estimate for the budget check: Longest render
+        // time, decaying by 1/cost_decay_divisor per frame
+        unsigned long cost_us;
+    };
+
+    const uint32_t breathe_increment;
+    Layer layers[n_layer_types];
+    // Frame being composed and layer render buffer, packed
+    uint32_t frame[n_words];
+    uint32_t scratch[n_words];
+    uint16_t output[max_channels];
+    uint32_t overruns;
+
+    void render_breathe(Layer& layer, uint8_t n_words_used);
+    void render_sparkle(Layer& layer, uint8_t n_words_used, uint8_t n_channels);
+    void render_flash(Layer& layer, uint8_t n_words_used);
+}; // class Compositor
+
+#endif
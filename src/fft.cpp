@@ -0,0 +1,143 @@
+#include <utility>
+
+#include "fft.hpp"
+
+namespace {
+
+constexpr double pi = 3.14159265358979323846;
+
+// Sine for -pi...pi, Taylor series after folding into -pi/2...pi/2
+constexpr double sine(double x) {
+    if (x > pi / 2) {
+        x = pi - x;
+    } else if (x < -pi / 2) {
+        x = -pi - x;
+    }
+    const double x2 = x * x;
+    return x * (1 - x2 / 6 * (1 - x2 / 20 * (1 - x2 / 42 * (1 - x2 / 72
+               * (1 - x2 / 110)))));
+}
+
+constexpr int16_t to_q15(double value) {
+    value *= 32767;
+    return static_cast<int16_t>(value < 0 ? value - 0.5 : value + 0.5);
+}
+
+// exp(-2 pi i k / size) for k = 0...3/4 size, the largest index used by
+// the butterflies
+struct Twiddles
+{
+    fft::Complex values[3 * fft::size / 4];
+
+    constexpr Twiddles() : values{} {
+        for (size_t k = 0; k < 3 * fft::size / 4; ++k) {
+            // Angle folded into -pi...pi
+            const double angle = 2 * pi * k / fft::size;
+            const double folded = angle > pi ? angle - 2 * pi : angle;
+            values[k].re = to_q15(sine(folded + (folded > pi / 2 ? -1.5 * pi : pi / 2)));
+            values[k].im = to_q15(-sine(folded));
+        }
+    }
+};
+
+struct HannWindow
+{
+    int16_t values[fft::size];
+
+    constexpr HannWindow() : values{} {
+        for (size_t i = 0; i < fft::size; ++i) {
+            // 0.5 - 0.5 cos(2 pi i / size) = sin^2(pi i / size)
+            const double angle = pi * i / fft::size;
+            const double s = sine(angle > pi / 2 ? pi - angle : angle);
+            values[i] = to_q15(s * s);
+        }
+    }
+};
+
+// Index with its base-4 digits reversed
+struct DigitReversal
+{
+    uint8_t indices[fft::size];
+
+    constexpr DigitReversal() : indices{} {
+        for (size_t i = 0; i < fft::size; ++i) {
+            size_t reversed = 0;
+            size_t rest = i;
+            for (size_t stage = 0; stage < fft::n_stages; ++stage) {
+                reversed = reversed << 2 | (rest & 3);
+                rest >>= 2;
+            }
+            indices[i] = static_cast<uint8_t>(reversed);
+        }
+    }
+};
+
+constexpr Twiddles twiddles{};
+constexpr HannWindow hann_window{};
+constexpr DigitReversal digit_reversal{};
+static_assert(fft::size <= 256, "Digit reversal table holds 8-bit indices");
+
+// Q15 complex multiplication, rounded
+inline fft::Complex multiply(int32_t re, int32_t im, const fft::Complex& w) {
+    return fft::Complex{
+        static_cast<int16_t>((re * w.re - im * w.im + (1 << 14)) >> 15),
+        static_cast<int16_t>((re * w.im + im * w.re + (1 << 14)) >> 15)};
+}
+
+} // namespace
+
+namespace fft {
+
+void window(const int16_t* in, Complex* out) {
+    for (size_t i = 0; i < size; ++i) {
+        out[i].re = static_cast<int16_t>(
+            (int32_t{in[i]} * hann_window.values[i] + (1 << 14)) >> 15);
+        out[i].im = 0;
+    }
+}
+
+// Decimation in frequency. Every butterfly takes four points a quarter
+// of the span apart, and writes the four partial transforms back to the
+// same places, each multiplied by its twiddle factor. The results end
+// up in digit-reversed order.
+void forward(Complex* data) {
+    for (size_t span = size; span > 1; span /= 4) {
+        const size_t quarter = span / 4;
+        const size_t twiddle_step = size / span;
+        for (size_t j = 0; j < quarter; ++j) {
+            const Complex& w1 = twiddles.values[j * twiddle_step];
+            const Complex& w2 = twiddles.values[2 * j * twiddle_step];
+            const Complex& w3 = twiddles.values[3 * j * twiddle_step];
+            for (size_t i = j; i < size; i += span) {
+                Complex& a = data[i];
+                Complex& b = data[i + quarter];
+                Complex& c = data[i + 2 * quarter];
+                Complex& d = data[i + 3 * quarter];
+                const int32_t t0_re = a.re + c.re;
+                const int32_t t0_im = a.im + c.im;
+                const int32_t t1_re = a.re - c.re;
+                const int32_t t1_im = a.im - c.im;
+                const int32_t t2_re = b.re + d.re;
+                const int32_t t2_im = b.im + d.im;
+                const int32_t t3_re = b.re - d.re;
+                const int32_t t3_im = b.im - d.im;
+                // Scaled by 1/4 per stage
+                a.re = static_cast<int16_t>((t0_re + t2_re) >> 2);
+                a.im = static_cast<int16_t>((t0_im + t2_im) >> 2);
+                // t1 - i t3
+                b = multiply((t1_re + t3_im) >> 2, (t1_im - t3_re) >> 2, w1);
+                c = multiply((t0_re - t2_re) >> 2, (t0_im - t2_im) >> 2, w2);
+                // t1 + i t3
+                d = multiply((t1_re - t3_im) >> 2, (t1_im + t3_re) >> 2, w3);
+            }
+        }
+    }
+    for (size_t i = 0; i < size; ++i) {
+        const size_t j = digit_reversal.indices[i];
+        if (i < j) {
+            std::swap(data[i], data[j]);
+        }
+    }
+}
+
+} // namespace fft
@@ -0,0 +1,39 @@
+/* Fixed-point radix-4 FFT
+ *
+ * Complex Q15 data, transformed in place. Each of the log4(size) stages
+ * scales by 1/4, so the result is the DFT divided by size and can not
+ * overflow. The twiddle factors, the window and the digit-reversal
+ * permutation are tables computed at compile time.
+ */
+#ifndef FFT_HPP__
+#define FFT_HPP__
+
+#include <cstddef>
+#include <cstdint>
+
+namespace fft {
+
+// Transform length, a power of 4
+constexpr size_t size = 256;
+constexpr size_t n_stages = 4;
+static_assert(size == 1 << 2 * n_stages, "Size must be 4^n_stages");
+
+struct Complex
+{
+    int16_t re;
+    int16_t im;
+};
+
+// Apply the Hann window to size real samples
+void window(const int16_t* in, Complex* out);
+// Forward transform in place, result in natural order
+void forward(Complex* data);
+// Squared magnitude of a bin
+constexpr uint32_t power(const Complex& bin) {
+    return static_cast<uint32_t>(int32_t{bin.re} * bin.re)
+           + static_cast<uint32_t>(int32_t{bin.im} * bin.im);
+}
+
+} // namespace fft
+
+#endif
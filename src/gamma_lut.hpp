@@ -0,0 +1,59 @@
+/* Gamma correction for LED brightness values
+ *
+ * LED brightness is handled as perceptually linear 16-bit fixed-point
+ * values, 0 => off, 0xFFFF => full brightness. For output, these are
+ * mapped to PWM duty cycles by a lookup table following the CIE 1931
+ * lightness curve, which is generated at compile time.
+ *
+ * The table has 257 points spanning the full brightness range. In between,
+ * the duty cycle is interpolated linearly with integer math, so the full
+ * PWM resolution is available in the dim range, where the eye is most
+ * sensitive to steps.
+ */
+#ifndef GAMMA_LUT_HPP__
+#define GAMMA_LUT_HPP__
+
+#include <cstdint>
+
+template<uint8_t RESOLUTION_BITS, bool INVERTED>
+class GammaLUT
+{
+public:
+    static_assert(RESOLUTION_BITS <= 15, "Duty cycle must fit int16_t");
+    // Duty cycle for 100% on-time
+    static constexpr int32_t max_duty = 1 << RESOLUTION_BITS;
+
+    constexpr GammaLUT() : duty{} {
+        for (int i = 0; i < n_points; ++i) {
+            // CIE 1931: Relative luminance Y from lightness L* = 0...100
+            const double lightness = 100.0 * i / (n_points - 1);
+            const double root = (lightness + 16.0) / 116.0;
+            const double luminance = lightness <= 8.0 ? lightness / 903.3
+                                                      : root * root * root;
+            int32_t on_time = static_cast<int32_t>(luminance * max_duty + 0.5);
+            if (on_time > max_duty) {
+                on_time = max_duty;
+            }
+            duty[i] = INVERTED ? max_duty - on_time : on_time;
+        }
+        // Padding, full brightness is read with zero interpolation weight
+        duty[n_points] = duty[n_points - 1];
+    }
+
+    // PWM duty cycle for a perceptually linear brightness value
+    constexpr uint16_t operator()(const uint16_t brightness) const {
+        // Brightness scaled to 0...0x10000, i.e. 256 table intervals
+        const int32_t position = brightness + (brightness >> 15);
+        const int32_t index = position >> 8;
+        const int32_t fraction = position & 0xFF;
+        const int32_t d0 = duty[index];
+        const int32_t d1 = duty[index + 1];
+        return d0 + (d1 - d0) * fraction / 256;
+    }
+
+private:
+    static constexpr int n_points = 257;
+    uint16_t duty[n_points + 1];
+};
+
+#endif
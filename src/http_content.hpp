@@ -1,3 +1,5 @@
+#include "web_assets.hpp"
+
 // Display the HTML web page
 // For the ESP32, immutable data is automatically stored in FLASH, on the
 // ESP8266 whis would be:
@@ -10,18 +12,16 @@ constexpr const char index_html[] =
     "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">"
     "<meta charset=\"UTF-8\">"
     "<link rel=\"icon\" href=\"data:,\">"
-    // CSS to style the on/off buttons
-    "<style>"
-        "html { font-family: Helvetica; display: inline-block; margin: 0px auto; text-align: center;}"
-        "button { background-color: #4CAF50; border: none; color: white; padding: 16px 30px;"
-        "text-decoration: none; font-size: 25px; margin: 2px; cursor: pointer;}"
-        ".btn_off {background-color: #555555;}"
-    "</style>"
+    // CSS to style the on/off buttons, see web/style.css
+    "<link rel=\"stylesheet\" href=\"" WEB_ASSET_STYLE_CSS_URL "\">"
+    // Sends the commands without reloading the page, see web/app.js
+    "<script src=\"" WEB_ASSET_APP_JS_URL "\" defer></script>"
     "</head>"
     
     // Web Page Heading
     "<body><h1>Karlottas Tannenbaum!</h1>"
     "<p>Teilweise selbst gebastelt</p>"
+    "<p id=\"state\"></p>"
     "<p><a href=\"/cmd?larson\"><button>Glen A. Larson</button></a></p>"
     "<p><a href=\"/cmd?arrow_up\"><button>Aufwärts!</button></a>"
        "<a href=\"/cmd?arrow_down\"><button>Abwärts!</button></a></p>"
@@ -29,11 +29,16 @@ constexpr const char index_html[] =
        "<a href=\"/cmd?spin_left\"><button>Links herum!</button></a></p>"
 
     "<p><a href=\"/cmd?on_off\">"
-    "<button class=\"%ON_OFF_BTN_STATE%\">ON/OFF</button>"
+    "<button id=\"on_off\" class=\"%ON_OFF_BTN_STATE%\">ON/OFF</button>"
     "</a></p>"
 
     "<p><a href=\"/cmd?plus\"><button>SCHNELLER</button></a>"
        "<a href=\"/cmd?minus\"><button>LANGSAMER</button></a></p>"
+    "<p><a href=\"/cmd?crossfade\"><button>Überblenden</button></a>"
+       "<a href=\"/cmd?beat\"><button>Im Takt</button></a></p>"
+    "<p><a href=\"/cmd?breathe\"><button>Atmen</button></a>"
+       "<a href=\"/cmd?sparkle\"><button>Funkeln</button></a></p>"
+    "<p><a href=\"/cmd?audio\"><button>Lauschen</button></a></p>"
     "</body>"
     "</html>"
     "\n";
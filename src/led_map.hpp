@@ -0,0 +1,98 @@
+/* LED topology of the tree
+ *
+ * Every LED is listed once with its GPIO and physical position. The PWM
+ * channel groupings used by the animation modes are derived from this
+ * table at compile time, so a tree with a different number of LEDs only
+ * needs a different table.
+ */
+#ifndef LED_MAP_HPP__
+#define LED_MAP_HPP__
+
+#include <cstddef>
+#include <cstdint>
+
+namespace led_map {
+
+enum SIDES{LEFT, CENTER, RIGHT};
+
+struct LedInfo
+{
+    uint8_t gpio;
+    enum SIDES side;
+    // Position on the tree outline, counting from bottom left
+    // upwards and on the right side downwards again
+    uint8_t ring_index;
+    // Height level, 0 => bottom
+    uint8_t height;
+};
+
+constexpr LedInfo leds[] = {
+    {32, LEFT, 0, 0}, // Links unten
+    {33, LEFT, 1, 1}, // Links
+    {25, LEFT, 2, 2}, // Links
+    {26, LEFT, 3, 3}, // Links
+    {27, LEFT, 4, 4}, // Links oberster
+    {4, CENTER, 5, 5}, // Rechteckige oben
+    {14, CENTER, 6, 6}, // Baumkrone rund
+    {16, RIGHT, 7, 4}, // Rechts oberster
+    {17, RIGHT, 8, 3}, // Rechts
+    {18, RIGHT, 9, 2}, // Rechts
+    {19, RIGHT, 10, 1}, // Rechts
+    {21, RIGHT, 11, 0}, // Rechts unten
+};
+constexpr size_t n_leds = sizeof(leds) / sizeof(leds[0]);
+
+// PWM channel groupings:
+// BY_HEIGHT: One channel per height level, left and right side in parallel
+// BY_RING: One channel per LED, in order of the tree outline
+// SINGLE: All LEDs on channel 0
+enum GROUPINGS{BY_HEIGHT, BY_RING, SINGLE};
+
+// PWM channel for each LED of the table
+struct Routing
+{
+    uint8_t channel[n_leds];
+    uint8_t n_channels;
+};
+
+constexpr Routing make_routing(const enum GROUPINGS grouping) {
+    Routing result{};
+    for (size_t i = 0; i < n_leds; ++i) {
+        uint8_t channel = 0;
+        switch (grouping) {
+            case BY_HEIGHT: channel = leds[i].height; break;
+            case BY_RING: channel = leds[i].ring_index; break;
+            case SINGLE: channel = 0; break;
+        }
+        result.channel[i] = channel;
+        if (channel >= result.n_channels) {
+            result.n_channels = channel + 1;
+        }
+    }
+    return result;
+}
+
+constexpr Routing by_height = make_routing(BY_HEIGHT);
+constexpr Routing by_ring = make_routing(BY_RING);
+constexpr Routing single = make_routing(SINGLE);
+
+// Index into the table for each position on the tree outline
+struct RingOrder
+{
+    uint8_t led[n_leds];
+};
+
+constexpr RingOrder make_ring_order() {
+    RingOrder result{};
+    for (size_t i = 0; i < n_leds; ++i) {
+        result.led[leds[i].ring_index] = i;
+    }
+    return result;
+}
+
+static_assert(by_ring.n_channels == n_leds, "One outline position per LED");
+constexpr RingOrder ring_order = make_ring_order();
+
+} // namespace led_map
+
+#endif
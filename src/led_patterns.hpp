@@ -0,0 +1,106 @@
+/* Pre-computed LED animation frame tables
+ *
+ * Every animation mode steps through a fixed cycle of frames. The cycles
+ * are generated at compile time into flat constexpr arrays, which end up
+ * in flash. Updating the LEDs is then one table lookup and one PWM write
+ * per channel, with no per-frame arithmetic or branching.
+ */
+#ifndef LED_PATTERNS_HPP__
+#define LED_PATTERNS_HPP__
+
+#include <cstddef>
+#include <cstdint>
+
+// Frame table view: n_frames frames, each holding one PWM value per channel
+struct PatternTable
+{
+    const uint16_t* frames;
+    uint8_t n_frames;
+    uint8_t n_channels;
+
+    constexpr const uint16_t* frame(uint8_t index) const {
+        return frames + index * n_channels;
+    }
+};
+
+// Storage for a complete animation cycle
+template<size_t N_FRAMES, size_t N_CHANNELS>
+struct PatternFrames
+{
+    static_assert(N_FRAMES > 0 && N_FRAMES < 256, "Frame count must fit uint8_t");
+    static_assert(N_CHANNELS > 0 && N_CHANNELS < 256, "Channel count must fit uint8_t");
+    uint16_t values[N_FRAMES * N_CHANNELS];
+
+    constexpr PatternTable table() const {
+        return PatternTable{values, N_FRAMES, N_CHANNELS};
+    }
+};
+
+namespace led_patterns {
+
+// Value of LED "led" when the marker pattern starts at LED "shift",
+// all LEDs not covered by the marker are off.
+template<size_t L_PATTERN>
+constexpr uint16_t marker_value(const uint16_t (&pattern)[L_PATTERN],
+                                const uint16_t off, const int led,
+                                const int shift) {
+    const int pattern_index = led - shift;
+    return pattern_index < 0 || pattern_index >= static_cast<int>(L_PATTERN)
+           ? off : pattern[pattern_index];
+}
+
+/* Marker bouncing back and forth ("Larson scanner").
+ * The marker starts one position before the first LED and moves until
+ * its last element has reached the last LED, then turns around.
+ */
+template<size_t N_LEDS, size_t L_PATTERN>
+constexpr auto bounce(const uint16_t (&pattern)[L_PATTERN], const uint16_t off) {
+    // Shift positions from -1 to N_LEDS + 1 - L_PATTERN
+    constexpr int n_positions = N_LEDS + 3 - L_PATTERN;
+    constexpr int n_frames = 2 * n_positions - 2;
+    PatternFrames<n_frames, N_LEDS> result{};
+    for (int frame = 0; frame < n_frames; ++frame) {
+        const int position = frame < n_positions ? frame : n_frames - frame;
+        for (int led = 0; led < static_cast<int>(N_LEDS); ++led) {
+            result.values[frame * N_LEDS + led] =
+                marker_value(pattern, off, led, position - 1);
+        }
+    }
+    return result;
+}
+
+/* Marker rotating with a cycle of WRAP_LENGTH shift positions.
+ * When WRAP_LENGTH is larger than N_LEDS, the marker moves out of the
+ * visible range before it re-appears on the other end.
+ * direction: true => towards higher channel numbers
+ */
+template<size_t N_LEDS, size_t WRAP_LENGTH, size_t L_PATTERN>
+constexpr auto rotate(const uint16_t (&pattern)[L_PATTERN], const uint16_t off,
+                      const bool direction) {
+    static_assert(WRAP_LENGTH >= N_LEDS, "Wrap length must cover all LEDs");
+    constexpr int wrap_length = WRAP_LENGTH;
+    PatternFrames<WRAP_LENGTH, N_LEDS> result{};
+    for (int frame = 0; frame < wrap_length; ++frame) {
+        const int shift = direction ? frame : (wrap_length - frame) % wrap_length;
+        for (int led = 0; led < static_cast<int>(N_LEDS); ++led) {
+            const int pattern_index = (led - shift + wrap_length) % wrap_length;
+            result.values[frame * N_LEDS + led] =
+                marker_value(pattern, off, pattern_index, 0);
+        }
+    }
+    return result;
+}
+
+// Single static frame with all channels set to the same value
+template<size_t N_CHANNELS>
+constexpr auto constant(const uint16_t value) {
+    PatternFrames<1, N_CHANNELS> result{};
+    for (size_t channel = 0; channel < N_CHANNELS; ++channel) {
+        result.values[channel] = value;
+    }
+    return result;
+}
+
+} // namespace led_patterns
+
+#endif
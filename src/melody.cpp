@@ -1,38 +1,74 @@
 #include "melody.hpp"
 #include "info_debug_error.h"
 
-MelodyPlayer::MelodyPlayer(uint8_t gpio_pin, uint8_t pwm_channel)
-    : gpio_pin{gpio_pin}
-    , pwm_channel{pwm_channel}
-    , tone_timer{}
-    , melody_queue{}
-{
-    // Setup IO for tone output
-    ledcSetup(pwm_channel, 0, 10);
-}
+MelodyPlayer::MelodyPlayer(Synth& synth, uint8_t voice, Timeline& timeline,
+                           bool conducting)
+    : synth{synth}
+    , voice{voice}
+    , timeline{timeline}
+    , conducting{conducting}
+    , timeline_client{timeline.add_client(on_timeline_event, this)}
+{}
 
 MelodyPlayer::~MelodyPlayer() {
-    tone_timer.detach();
-    ledcDetachPin(gpio_pin);
+    timeline.cancel(timeline_client);
 }
 
-void MelodyPlayer::play(Melody melody, uint32_t tempo_ms) {
-    if (tempo_ms > 0) {
-        playing_at_custom_tempo = true;
-    } else {
-        tempo_ms = base_tempo_ms;
+void MelodyPlayer::play(const Melody& melody, uint32_t tempo_ms) {
+    {
+        std::lock_guard<std::mutex> lock{state_lock};
+        if (is_muted) {
+            return;
+        }
+        stream.close();
+        melody_tempo_ms = tempo_ms;
+        next_event = melody.events;
+        end_event = melody.events + melody.n_events;
+        request = START;
     }
-    melody_queue = melody;
-    is_idle = false;
-    tone_timer.attach_ms(tempo_ms, on_tone_timer, this);
+    timeline.wake(timeline_client);
+}
+
+// The timeline client does not parse the stream while it is opened
+bool MelodyPlayer::play_file(const char* path) {
+    bool is_open;
+    {
+        std::lock_guard<std::mutex> lock{state_lock};
+        if (is_muted) {
+            return false;
+        }
+        is_open = stream.open(path);
+        melody_tempo_ms = 0;
+        next_event = end_event = nullptr;
+        request = is_open ? START : STOP;
+    }
+    if (is_open) {
+        debug_print_sv("Playing melody file:", path);
+    }
+    timeline.wake(timeline_client);
+    return is_open;
+}
+
+void MelodyPlayer::set_muted(bool muted) {
+    {
+        std::lock_guard<std::mutex> lock{state_lock};
+        is_muted = muted;
+        if (!muted) {
+            return;
+        }
+        stream.close();
+        next_event = end_event = nullptr;
+        request = STOP;
+    }
+    timeline.wake(timeline_client);
 }
 
+// Tempo changes take effect with the next note
 void MelodyPlayer::increase_tempo() {
     debug_print("Melody playing faster...");
     if (base_tempo_ms >= 64) {
         base_tempo_ms /= 2;
     }
-    tone_timer.attach_ms(base_tempo_ms, on_tone_timer, this);
 }
 
 void MelodyPlayer::decrease_tempo() {
@@ -40,102 +76,127 @@ void MelodyPlayer::decrease_tempo() {
     if (base_tempo_ms < 2048) {
         base_tempo_ms *= 2;
     }
-    tone_timer.attach_ms(base_tempo_ms, on_tone_timer, this);
 }
 
 void MelodyPlayer::set_tempo(uint32_t tempo_ms) {
     debug_print_sv("Setting tempo to:", tempo_ms);
     base_tempo_ms = tempo_ms;
-    tone_timer.attach_ms(tempo_ms, on_tone_timer, this);
+}
+
+uint32_t MelodyPlayer::file_underruns() const {
+    return stream.underruns();
 }
 
 ////////// PlayMelody: private
 
-void MelodyPlayer::on_tone_timer(MelodyPlayer* self) {
-    static uint8_t repeat_note = 1;
-    static bool output_off = true;
-    if (self->is_idle) {
+bool MelodyPlayer::fetch_event(uint8_t& pitch, uint32_t& duration_ms) {
+    if (stream.is_open()) {
+        return stream.next(pitch, duration_ms);
+    }
+    if (next_event == end_event) {
+        return false;
+    }
+    const NoteEvent& event = *next_event++;
+    const uint32_t tempo_ms = melody_tempo_ms > 0 ? melody_tempo_ms
+                                                  : base_tempo_ms;
+    pitch = event.pitch;
+    duration_ms = tempo_ms * event.length;
+    return true;
+}
+
+void MelodyPlayer::run() {
+    const enum REQUESTS taken = request;
+    request = NO_REQUEST;
+    if (taken == STOP) {
+        stop();
         return;
     }
-    if (repeat_note > 0) {
-        // Keep playing the current note until repeat_note == 0
-        repeat_note--;
+    if (taken == START) {
+        start();
         return;
-    } else {
-        // A Quarter note is an eights note repeated once, this is the default.
-        repeat_note = 1;
-    }
-    // This is the ESP32 API enum
-    note_t api_note = NOTE_C;
-    // This is our custom type with additional control characters etc.
-    NoteT note;
-    bool is_control_symbol;
-    bool is_pause;
-    // This consumes the non-audible (and non-pause) control symbols
-    // until an audible note or pause is found which is then played.
-    do {
-        if (self->melody_queue.empty()) {
-            ledcWriteTone(self->pwm_channel, 0);
-            ledcDetachPin(self->gpio_pin);
-            output_off = true;
-            self->is_idle = true;
-            if (self->playing_at_custom_tempo) {
-                // If tempo for the currently playint tune has been set different
-                // than preset tempo, unset temporary tempo and reset timer
-                // to preset tempo.
-                self->playing_at_custom_tempo = false;
-                self->tone_timer.attach_ms(self->base_tempo_ms, on_tone_timer, self);
-            }
-            return;
-        }
-        // Queue is not empty:
-        note = self->melody_queue.front();
-        self->melody_queue.pop_front();
-        is_control_symbol = false;
-        is_pause = false;
-        switch (note) {
-            case O_DOWN: self->octave--; is_control_symbol = true; break;
-            case O_UP: self->octave++; is_control_symbol = true; break;
-            case L1: repeat_note = 15 ; is_control_symbol = true; break;
-            case L2: repeat_note = 7 ; is_control_symbol = true; break;
-            case L4: repeat_note = 3; is_control_symbol = true; break;
-            case L8: repeat_note = 1; is_control_symbol = true; break;
-            case L16: repeat_note = 0; is_control_symbol = true; break;
-            case P: is_pause = true; break;
-            case C: api_note = NOTE_C; break;
-            case Cs: api_note = NOTE_Cs; break;
-            case D: api_note = NOTE_D; break;
-            case Ds: api_note = NOTE_Eb; break;
-            case E: api_note = NOTE_E; break;
-            case F: api_note = NOTE_F; break;
-            case Fs: api_note = NOTE_Fs; break;
-            case G: api_note = NOTE_G; break;
-            case Gs: api_note = NOTE_Gs; break;
-            case A: api_note = NOTE_A; break;
-            case As: api_note = NOTE_Bb; break;
-            case B: api_note = NOTE_B; break;
-        }
-    } while (is_control_symbol);
-    // Found a note or a pause
-    if (is_pause) {
+    }
+    if (is_idle) {
+        return;
+    }
+    // Woken up for a request which was already taken
+    if (Timeline::now_us() < due_us) {
+        timeline.schedule(timeline_client, due_us);
+        return;
+    }
+    if (note_sounding) {
+        // Note ended, release it for the gap
+        note_sounding = false;
+        synth.note_off(voice);
+        schedule(next_event_us);
+        return;
+    }
+    play_next_event();
+}
+
+void MelodyPlayer::start() {
+    is_idle = false;
+    note_sounding = false;
+    next_event_us = Timeline::now_us();
+    if (conducting) {
+        // Sixteenth notes, four per beat. The beats are heard after the
+        // synthesizer output latency.
+        const uint32_t beat_ms = stream.is_open() ? stream.beat_ms()
+            : 4 * (melody_tempo_ms > 0 ? melody_tempo_ms : base_tempo_ms);
+        timeline.start_tempo(beat_ms * 1000,
+                             next_event_us + synth.output_latency_us());
+    }
+    play_next_event();
+}
+
+void MelodyPlayer::play_next_event() {
+    uint8_t pitch;
+    uint32_t duration_ms;
+    if (!fetch_event(pitch, duration_ms)) {
+        stop();
+        return;
+    }
+    next_event_us += static_cast<int64_t>(duration_ms) * 1000;
+    if (pitch == pause_pitch) {
         // Play nothing
-        ledcWriteTone(self->pwm_channel, 0);
-        ledcDetachPin(self->gpio_pin);
-        output_off = true;
+        synth.note_off(voice);
+        schedule(next_event_us);
     } else {
-        // Play audible note.
-        // If the note is unchanged from the previous one, keep playing the 
-        // current note instead of restarting the PWM for cleaner waveform.
-        // if (self->current_note != api_note || output_off) {
-            // Play a new note
-            output_off = false;
-            self->current_note = api_note;
-            ledcWriteTone(self->pwm_channel, 0);
-            ledcDetachPin(self->gpio_pin);
-            delay(10);
-            ledcAttachPin(self->gpio_pin, self->pwm_channel);
-            ledcWriteNote(self->pwm_channel, api_note, self->octave);
-        //}
-    }
-
-}
\ No newline at end of file
+        // Play audible note, it is heard after the audio queued before it
+        const int64_t heard_us = Timeline::now_us() + synth.output_latency_us();
+        synth.note_on(voice, pitch);
+        if (conducting) {
+            timeline.note_onset(heard_us);
+        }
+        note_sounding = duration_ms > note_gap_ms;
+        schedule(note_sounding ? next_event_us - note_gap_ms * 1000
+                               : next_event_us);
+    }
+}
+
+void MelodyPlayer::schedule(int64_t t_us) {
+    due_us = t_us;
+    timeline.schedule(timeline_client, t_us);
+}
+
+void MelodyPlayer::stop() {
+    timeline.cancel(timeline_client);
+    if (conducting) {
+        timeline.stop_tempo();
+    }
+    stream.close();
+    synth.note_off(voice);
+    is_idle = true;
+    note_sounding = false;
+    melody_tempo_ms = 0;
+}
+
+// Static function
+void MelodyPlayer::on_timeline_event(MelodyPlayer* self) {
+    if (!self->state_lock.try_lock()) {
+        self->timeline.schedule(self->timeline_client,
+                                Timeline::now_us() + busy_retry_us);
+        return;
+    }
+    std::lock_guard<std::mutex> lock{self->state_lock, std::adopt_lock};
+    self->run();
+}
@@ -1,9 +1,14 @@
 #ifndef MELODY_PLAYER_HPP__
 #define MELODY_PLAYER_HPP__
 
-#include <deque>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
 #include <esp32-hal-ledc.h>
-#include <Ticker.h>
+
+#include "synth.hpp"
+#include "melody_stream.hpp"
+#include "timeline.hpp"
 
 // A single musical note [C, D, E, F, G, A, B],
 // plus halve-tones [Cs, Ds, Fs, Gs, As],
@@ -15,45 +20,225 @@
 enum NoteT {C,  D, E, F,  G,  A, B, P, O_UP, O_DOWN, L1, L2, L4, L8, L16,
             Cs, Ds,   Fs, Gs, As};
 
-// Musical melody comprised of notes
-using Melody = std::deque<NoteT>;
+// Compiled melody event: One note or pause with its length.
+// pitch: Semitones above C in octave 0, pause_pitch for a pause.
+// length: Number of sixteenth notes
+struct NoteEvent
+{
+    uint8_t pitch;
+    uint8_t length;
+};
+
+constexpr uint8_t pause_pitch = UINT8_MAX;
+
+// Musical melody, view of a compiled event array
+struct Melody
+{
+    const NoteEvent* events;
+    uint16_t n_events;
+};
+
+// Storage for a compiled melody, see compile_melody()
+template<size_t N_NOTES>
+struct CompiledMelody
+{
+    NoteEvent events[N_NOTES];
+    uint16_t n_events;
+
+    constexpr operator Melody() const {
+        return Melody{events, n_events};
+    }
+};
+
+namespace melody_compiler {
+
+constexpr uint8_t default_octave = 4;
+constexpr uint8_t default_length = 2;
+// Highest octave within the pitch range of the synthesizer
+constexpr uint8_t max_octave = Synth::n_pitches / 12 - 1;
+
+// Not constexpr: Reaching it while compiling a melody makes the
+// compilation fail
+inline void error_octave_out_of_range() {}
+
+// Semitone within the octave, for audible notes
+constexpr uint8_t semitone(const NoteT note) {
+    switch (note) {
+        case C: return NOTE_C;
+        case Cs: return NOTE_Cs;
+        case D: return NOTE_D;
+        case Ds: return NOTE_Eb;
+        case E: return NOTE_E;
+        case F: return NOTE_F;
+        case Fs: return NOTE_Fs;
+        case G: return NOTE_G;
+        case Gs: return NOTE_Gs;
+        case A: return NOTE_A;
+        case As: return NOTE_Bb;
+        case B: return NOTE_B;
+        default: return 0;
+    }
+}
+
+// Translate n notes into events, returns the number of events.
+// Control symbols are resolved here, so the player only walks the
+// event array.
+constexpr uint16_t compile(const NoteT* notes, const size_t n,
+                           NoteEvent* events) {
+    uint16_t n_events = 0;
+    uint8_t octave = default_octave;
+    uint8_t length = default_length;
+    for (size_t i = 0; i < n; ++i) {
+        uint8_t pitch = pause_pitch;
+        switch (notes[i]) {
+            case O_DOWN:
+                if (octave == 0) {
+                    error_octave_out_of_range();
+                    continue;
+                }
+                --octave;
+                continue;
+            case O_UP:
+                if (octave == max_octave) {
+                    error_octave_out_of_range();
+                    continue;
+                }
+                ++octave;
+                continue;
+            case L1: length = 16; continue;
+            case L2: length = 8; continue;
+            case L4: length = 4; continue;
+            case L8: length = 2; continue;
+            case L16: length = 1; continue;
+            case P: break;
+            default: pitch = 12 * octave + semitone(notes[i]); break;
+        }
+        events[n_events++] = NoteEvent{pitch, length};
+        // Length prefixes apply to the following note only
+        length = default_length;
+    }
+    return n_events;
+}
+
+} // namespace melody_compiler
+
+/* Translate the NoteT melody notation into timed note events at compile
+ * time. Use for constexpr variables, which end up in flash:
+ *
+ *     constexpr auto jingle = compile_melody({C, D, L2, E});
+ *
+ * Shifting the octave out of the synthesizer range is a compile error.
+ */
+template<size_t N_NOTES>
+constexpr CompiledMelody<N_NOTES> compile_melody(const NoteT (&notes)[N_NOTES]) {
+    CompiledMelody<N_NOTES> result{};
+    result.n_events = melody_compiler::compile(notes, N_NOTES, result.events);
+    return result;
+}
+
+/* Compile a melody in place at the call site, e.g.
+ *
+ *     player.play(MELODY(C, D, L2, E));
+ *
+ * The events are a static constexpr array of the call site, so they are
+ * compiled by the compiler and live in flash like compile_melody() ones.
+ */
+#define MELODY(...) ([]() -> Melody { \
+        static constexpr auto melody = compile_melody({__VA_ARGS__}); \
+        return melody; \
+    }())
 
 class MelodyPlayer {
 public:
-    MelodyPlayer(uint8_t gpio_pin, uint8_t pwm_channel);
+    // Note released before its end, so that repeated notes are audible
+    // as separate notes
+    static constexpr uint32_t note_gap_ms = 10;
+
+    // Plays on one voice of the synthesizer. Players on different voices
+    // play at the same time. Notes are scheduled on the timeline.
+    // conducting: Publish tempo and note onsets on the timeline
+    MelodyPlayer(Synth& synth, uint8_t voice, Timeline& timeline,
+                 bool conducting = false);
     virtual ~MelodyPlayer();
 
+    // Play a melody compiled by MELODY() or compile_melody().
     // tempo_ms: Sets tempo only for the currently playing tune.
-    void play(Melody melody, uint32_t tempo_ms=0);
+    // The melody events must stay valid while playing (static storage).
+    // The player is scheduled on the timeline only while a melody is
+    // playing, once per note.
+    // play() and play_file() can be called from any task. They set up
+    // the melody and wake up the player on the timeline, which starts it.
+    void play(const Melody& melody, uint32_t tempo_ms=0);
+    // Play an RTTTL file from SPIFFS, the tempo is set by the file.
+    // The file is opened in the calling task.
+    // Returns false if the file cannot be played.
+    bool play_file(const char* path);
+
+    // A muted player stops and ignores play requests, e.g. while the
+    // synthesizer output is stopped
+    void set_muted(bool muted);
 
     void increase_tempo();
     void decrease_tempo();
     // tempo_ms: Duration of a sixteenths note in milliseconds
     void set_tempo(uint32_t tempo_ms);
 
-private:
-    const uint8_t gpio_pin;
-    const uint8_t pwm_channel;
-
-    Ticker tone_timer;
+    // Melody files ended early because the prefetch fell behind
+    uint32_t file_underruns() const;
 
-    Melody melody_queue;
-
-    // This is the ESP32 API enum type
-    note_t current_note = NOTE_C;
+private:
+    // The timeline client tries again after this time while play() or
+    // play_file() is setting up a melody
+    static constexpr int64_t busy_retry_us = 1000;
+    // Melody set up for the timeline client
+    enum REQUESTS{NO_REQUEST, START, STOP};
+
+    Synth& synth;
+    const uint8_t voice;
+    Timeline& timeline;
+    const bool conducting;
+    uint8_t timeline_client;
+    // Start time of the next event on the timeline. Events follow each
+    // other without gaps, so the timing does not drift.
+    int64_t next_event_us = 0;
+    // Time the player is scheduled for, it may be woken up earlier
+    int64_t due_us = 0;
+    // Taken by play(), play_file() and the timeline client, which is the
+    // only one touching the synthesizer and the timeline
+    std::mutex state_lock;
+    enum REQUESTS request = NO_REQUEST;
+    bool is_muted = false;
+
+    // Next event to be played and end of the current melody
+    const NoteEvent* next_event = nullptr;
+    const NoteEvent* end_event = nullptr;
+    // Melody file, used instead of the event array while open
+    MelodyStream stream;
 
     bool is_idle = true;
+    // Set while an audible note is sounding, it is followed by a gap
+    bool note_sounding = false;
     // base_tempo_ms: Duration of a sixteenths note in milliseconds
     uint32_t base_tempo_ms = 64;
-    // Is set to true by play() if tempo is changed for a single tune
-    bool playing_at_custom_tempo = false;
-    uint8_t octave = 4;
-
-    static void on_tone_timer(MelodyPlayer* self);
+    // Tempo set by play() for a single tune, 0 => base_tempo_ms
+    uint32_t melody_tempo_ms = 0;
+
+    // Next event of the melody array or file, false at the end
+    bool fetch_event(uint8_t& pitch, uint32_t& duration_ms);
+    // Timeline client with state_lock taken
+    void run();
+    void start();
+    // Start the next event and schedule the player for its end
+    // or for the gap before the next event
+    void play_next_event();
+    void schedule(int64_t t_us);
+    void stop();
+
+    static void on_timeline_event(MelodyPlayer* self);
 };
 
 
 
 
 
-#endif
\ No newline at end of file
+#endif
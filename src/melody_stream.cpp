@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <cctype>
+#include <SPIFFS.h>
+
+#include "info_debug_error.h"
+#include "melody.hpp"
+#include "melody_stream.hpp"
+
+namespace {
+
+// Semitone of the RTTTL note letters a...h, h is the German b
+constexpr uint8_t letter_semitones[] = {9, 11, 0, 2, 4, 5, 7, 11};
+// Number values in the file are limited to this
+constexpr uint32_t number_max = 10000;
+
+} // namespace
+
+// The ring positions wrap around together with the size_t counters
+static_assert((MelodyStream::buffer_size & (MelodyStream::buffer_size - 1)) == 0,
+              "Buffer size must be a power of two");
+
+// The prefetch task waits for a notification and does not hold the
+// file lock then
+MelodyStream::~MelodyStream() {
+    std::lock_guard<std::mutex> lock{file_lock};
+    if (prefetch_task) {
+        vTaskDelete(prefetch_task);
+    }
+    file.close();
+}
+
+bool MelodyStream::open(const char* path) {
+    close();
+    std::lock_guard<std::mutex> lock{file_lock};
+    file.close();
+    n_written = 0;
+    n_read = 0;
+    end_of_file = false;
+    file = SPIFFS.open(path, FILE_READ);
+    if (!file) {
+        error_print_sv("Melody file not found:", path);
+        return false;
+    }
+    if (!parse_header()) {
+        error_print_sv("Invalid RTTTL header:", path);
+        file.close();
+        return false;
+    }
+    if (!prefetch_task
+            && xTaskCreatePinnedToCore(reinterpret_cast<TaskFunction_t>(on_prefetch_task),
+                                       "melody_prefetch", task_stack_size, this,
+                                       task_priority, &prefetch_task,
+                                       tskNO_AFFINITY) != pdPASS) {
+        error_print("MelodyStream: Prefetch task creation failed");
+        prefetch_task = nullptr;
+        file.close();
+        return false;
+    }
+    refill();
+    is_streaming = true;
+    return true;
+}
+
+void MelodyStream::close() {
+    if (is_streaming.exchange(false) && prefetch_task) {
+        xTaskNotifyGive(prefetch_task);
+    }
+}
+
+bool MelodyStream::is_open() const {
+    return is_streaming;
+}
+
+uint32_t MelodyStream::beat_ms() const {
+    return whole_note_ms / 4;
+}
+
+bool MelodyStream::next(uint8_t& pitch, uint32_t& duration_ms) {
+    if (!is_streaming) {
+        return false;
+    }
+    // Read ahead in large chunks, notes are a few bytes each
+    if (n_buffered() < buffer_size / 2 && !end_of_file) {
+        xTaskNotifyGive(prefetch_task);
+    }
+    if (!has_complete_note()) {
+        ++n_underruns;
+        return false;
+    }
+    skip_spaces();
+    if (peek() < 0) {
+        return false;
+    }
+    uint32_t duration = parse_number();
+    if (duration == 0) {
+        duration = default_duration;
+    }
+    const int letter = std::tolower(get());
+    const bool is_pause = letter == 'p';
+    if (!is_pause && (letter < 'a' || letter > 'h')) {
+        return false;
+    }
+    uint8_t semitone = is_pause ? 0 : letter_semitones[letter - 'a'];
+    if (peek() == '#') {
+        get();
+        ++semitone;
+    }
+    bool dotted = false;
+    if (peek() == '.') {
+        get();
+        dotted = true;
+    }
+    uint8_t octave = default_octave;
+    if (std::isdigit(peek())) {
+        octave = get() - '0';
+    }
+    // The dot is also found after the octave
+    if (peek() == '.') {
+        get();
+        dotted = true;
+    }
+    skip_spaces();
+    const int separator = peek();
+    if (separator == ',') {
+        get();
+    } else if (separator >= 0) {
+        return false;
+    }
+    pitch = is_pause ? pause_pitch : 12 * octave + semitone;
+    duration_ms = whole_note_ms / duration;
+    if (dotted) {
+        duration_ms += duration_ms / 2;
+    }
+    return true;
+}
+
+uint32_t MelodyStream::underruns() const {
+    return n_underruns;
+}
+
+///////////// private
+
+size_t MelodyStream::n_buffered() const {
+    return n_written - n_read;
+}
+
+// The end of file flag is read first, it is set after the last write
+bool MelodyStream::has_complete_note() const {
+    if (end_of_file) {
+        return true;
+    }
+    const size_t end = n_written;
+    for (size_t i = n_read; i != end; ++i) {
+        if (buffer[i % buffer_size] == ',') {
+            return true;
+        }
+    }
+    return false;
+}
+
+int MelodyStream::peek() {
+    if (n_buffered() == 0) {
+        // Only open() reads the file here, for the header
+        if (!is_streaming) {
+            refill();
+        }
+        if (n_buffered() == 0) {
+            return -1;
+        }
+    }
+    return buffer[n_read % buffer_size];
+}
+
+int MelodyStream::get() {
+    const int c = peek();
+    if (c >= 0) {
+        ++n_read;
+    }
+    return c;
+}
+
+// Fill the free space of the ring buffer, at most two reads
+void MelodyStream::refill() {
+    while (!end_of_file && n_buffered() < buffer_size) {
+        const size_t write_index = n_written % buffer_size;
+        const size_t n_free = std::min(buffer_size - n_buffered(),
+                                       buffer_size - write_index);
+        const size_t n_read_now = file.read(buffer + write_index, n_free);
+        n_written += n_read_now;
+        if (n_read_now < n_free) {
+            end_of_file = true;
+        }
+    }
+}
+
+void MelodyStream::skip_spaces() {
+    while (std::isspace(peek())) {
+        get();
+    }
+}
+
+uint32_t MelodyStream::parse_number() {
+    uint32_t value = 0;
+    while (std::isdigit(peek())) {
+        value = std::min<uint32_t>(number_max, 10 * value + get() - '0');
+    }
+    return value;
+}
+
+// "name:d=4,o=6,b=63:", all settings are optional
+bool MelodyStream::parse_header() {
+    int c;
+    do {
+        c = get();
+        if (c < 0) {
+            return false;
+        }
+    } while (c != ':');
+    uint32_t duration = 4;
+    uint32_t octave = 6;
+    uint32_t beats_per_minute = 63;
+    for (;;) {
+        skip_spaces();
+        const int key = get();
+        if (key == ':') {
+            break;
+        }
+        if (key == ',') {
+            continue;
+        }
+        skip_spaces();
+        if (get() != '=') {
+            return false;
+        }
+        skip_spaces();
+        const uint32_t value = parse_number();
+        switch (key) {
+            case 'd': duration = value; break;
+            case 'o': octave = value; break;
+            case 'b': beats_per_minute = value; break;
+            default: return false;
+        }
+    }
+    if (duration == 0 || duration > 64 || octave > 8 || beats_per_minute == 0) {
+        return false;
+    }
+    default_duration = duration;
+    default_octave = octave;
+    // Beats are quarter notes
+    whole_note_ms = 4 * 60000 / beats_per_minute;
+    return true;
+}
+
+void MelodyStream::run() {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        std::lock_guard<std::mutex> lock{file_lock};
+        if (is_streaming) {
+            refill();
+        } else {
+            file.close();
+        }
+    }
+}
+
+void MelodyStream::on_prefetch_task(MelodyStream* self) {
+    self->run();
+}
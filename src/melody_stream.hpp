@@ -0,0 +1,91 @@
+/* RTTTL melody file reader
+ *
+ * Reads a melody in RTTTL (Ring Tone Text Transfer Language) format from
+ * SPIFFS, e.g.:
+ *
+ *     Tannenbaum:d=8,o=5,b=100:g,4c6,c6,c6,4d6,e6,e6,4e6.
+ *
+ * The file is parsed note by note through a small ring buffer, so a song
+ * of any length is played in constant RAM. The notes are parsed on the
+ * timeline, which must not wait for the flash. A low priority prefetch
+ * task reads the file ahead into the ring buffer instead.
+ */
+#ifndef MELODY_STREAM_HPP__
+#define MELODY_STREAM_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <FS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+class MelodyStream
+{
+public:
+    // Ring buffer size, also the maximum number of bytes read at once
+    static constexpr size_t buffer_size = 64;
+    // Prefetch task, started by the first open()
+    static constexpr uint32_t task_stack_size = 3072;
+    static constexpr UBaseType_t task_priority = 1;
+
+    MelodyStream() = default;
+    virtual ~MelodyStream();
+
+    // Open an RTTTL file, parse its header and fill the buffer.
+    // Reads the file in the calling task.
+    // Returns false if the file does not exist or the header is invalid.
+    bool open(const char* path);
+    // Does not wait for the file, the prefetch task closes it
+    void close();
+    bool is_open() const;
+    // Duration of a beat (quarter note) as set by the file header
+    uint32_t beat_ms() const;
+
+    // Parse the next note from the buffer, never reads the file.
+    // pitch: Semitones above C in octave 0, or pause_pitch
+    // Returns false at the end of the song, on a syntax error or when
+    // the prefetch fell behind (see underruns()).
+    bool next(uint8_t& pitch, uint32_t& duration_ms);
+    // Songs ended early because the next note was not yet read
+    uint32_t underruns() const;
+
+private:
+    // Taken by open() and the prefetch task for all file access
+    std::mutex file_lock;
+    File file;
+    TaskHandle_t prefetch_task = nullptr;
+    // Single producer, single consumer ring buffer: The positions count
+    // all bytes written and read, each is advanced by one side only.
+    uint8_t buffer[buffer_size];
+    std::atomic<size_t> n_written{0};
+    std::atomic<size_t> n_read{0};
+    std::atomic<bool> end_of_file{false};
+    // Notes are parsed while streaming, the file is read while not
+    std::atomic<bool> is_streaming{false};
+    uint32_t n_underruns = 0;
+    // Song defaults from the RTTTL header
+    uint8_t default_duration = 4;
+    uint8_t default_octave = 6;
+    uint32_t whole_note_ms = 2400;
+
+    size_t n_buffered() const;
+    // A whole note is in the buffer, so parsing does not run dry
+    bool has_complete_note() const;
+    // Next character, -1 at the end of the buffered data
+    int peek();
+    int get();
+    // Fill the free space of the buffer from the file, file_lock taken
+    void refill();
+    void skip_spaces();
+    uint32_t parse_number();
+    bool parse_header();
+
+    // Refills the buffer when notified by next(), closes the file
+    // when notified by close()
+    void run();
+    static void on_prefetch_task(MelodyStream* self);
+}; // class MelodyStream
+
+#endif
@@ -0,0 +1,61 @@
+/* Packed 16-bit fixed-point arithmetic
+ *
+ * Two unsigned 16-bit values (lanes) are held in one 32-bit word, the lower
+ * lane in bits 0...15. All operations work on both lanes at once using
+ * plain 32-bit integer instructions, with no carry or borrow crossing from
+ * one lane into the other.
+ */
+#ifndef PACKED16_HPP__
+#define PACKED16_HPP__
+
+#include <cstdint>
+
+namespace packed16 {
+
+// Most significant bit of each lane
+constexpr uint32_t msb_mask = 0x80008000;
+
+// Both lanes set to the same value
+constexpr uint32_t splat(const uint16_t value) {
+    return value | static_cast<uint32_t>(value) << 16;
+}
+
+// Expand a mask with bit 0 and/or bit 16 set to full lanes
+constexpr uint32_t lane_mask(const uint32_t lsb_bits) {
+    return lsb_bits * 0xFFFF;
+}
+
+// Lane-wise a + b, clamped to 0xFFFF
+constexpr uint32_t add_saturate(const uint32_t a, const uint32_t b) {
+    // Sum of the lower 15 bits cannot carry into the next lane
+    const uint32_t sum = (a & ~msb_mask) + (b & ~msb_mask);
+    const uint32_t carry = ((a & b) | ((a | b) & sum)) & msb_mask;
+    return (sum ^ ((a ^ b) & msb_mask)) | lane_mask(carry >> 15);
+}
+
+// Lane-wise a - b, clamped to 0
+constexpr uint32_t sub_saturate(const uint32_t a, const uint32_t b) {
+    // Setting the MSB of a stops a borrow from crossing into the next lane
+    const uint32_t diff = (a | msb_mask) - (b & ~msb_mask);
+    const uint32_t borrow = ((~a & b) | (~(a ^ b) & ~diff)) & msb_mask;
+    const uint32_t result = (diff & ~msb_mask) | ((a ^ b ^ ~diff) & msb_mask);
+    return result & ~lane_mask(borrow >> 15);
+}
+
+// Lane-wise maximum
+constexpr uint32_t max(const uint32_t a, const uint32_t b) {
+    return sub_saturate(a, b) + b;
+}
+
+// Lane-wise a * factor / 256, factor 0...255.
+// Both 8-bit halves of each lane are multiplied separately, so no
+// partial product exceeds its 16-bit lane.
+constexpr uint32_t scale(const uint32_t a, const uint8_t factor) {
+    const uint32_t high = ((a >> 8) & 0x00FF00FF) * factor;
+    const uint32_t low = (((a & 0x00FF00FF) * factor) >> 8) & 0x00FF00FF;
+    return high + low;
+}
+
+} // namespace packed16
+
+#endif
@@ -0,0 +1,96 @@
+/* Compile-time segmentation of HTML page templates
+ *
+ * A page is split into static text segments and placeholder slots, with
+ * the same rules as the ESPAsyncWebServer template processor: %NAME%
+ * with NAME up to placeholder_max_size characters is a placeholder,
+ * "%%" is a literal percent sign. Rendering a page then only copies the
+ * segments and looks up each placeholder once, without scanning.
+ *
+ *     constexpr auto segments = page_template::split<
+ *         page_template::count_segments(page)>(page);
+ */
+#ifndef PAGE_TEMPLATE_HPP__
+#define PAGE_TEMPLATE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+
+namespace page_template {
+
+constexpr size_t placeholder_max_size = 32;
+
+struct Segment
+{
+    // Text, or placeholder name without the percent signs
+    uint16_t offset;
+    uint16_t length;
+    bool is_placeholder;
+};
+
+template<size_t N_SEGMENTS>
+struct Segments
+{
+    Segment segments[N_SEGMENTS];
+
+    constexpr const Segment* begin() const { return segments; }
+    constexpr const Segment* end() const { return segments + N_SEGMENTS; }
+};
+
+// Calls on_segment for every segment of the text, in order
+template<typename SegmentFnT>
+constexpr void scan(const char* text, SegmentFnT on_segment) {
+    size_t start = 0;
+    size_t i = 0;
+    while (text[i] != '\0') {
+        if (text[i] != '%') {
+            ++i;
+            continue;
+        }
+        size_t end = i + 1;
+        while (text[end] != '\0' && text[end] != '%'
+                && end < i + 1 + placeholder_max_size) {
+            ++end;
+        }
+        if (text[end] != '%') {
+            // No placeholder, the percent sign is text
+            ++i;
+            continue;
+        }
+        if (i > start) {
+            on_segment(Segment{static_cast<uint16_t>(start),
+                               static_cast<uint16_t>(i - start), false});
+        }
+        if (end == i + 1) {
+            on_segment(Segment{static_cast<uint16_t>(i), 1, false});
+        } else {
+            on_segment(Segment{static_cast<uint16_t>(i + 1),
+                               static_cast<uint16_t>(end - i - 1), true});
+        }
+        i = end + 1;
+        start = i;
+    }
+    if (i > start) {
+        on_segment(Segment{static_cast<uint16_t>(start),
+                           static_cast<uint16_t>(i - start), false});
+    }
+}
+
+constexpr size_t count_segments(const char* text) {
+    size_t n = 0;
+    scan(text, [&n](const Segment&) { ++n; });
+    return n;
+}
+
+template<size_t N_SEGMENTS>
+constexpr Segments<N_SEGMENTS> split(const char* text) {
+    Segments<N_SEGMENTS> result{};
+    size_t n = 0;
+    scan(text, [&result, &n](const Segment& segment) {
+        result.segments[n++] = segment;
+    });
+    return result;
+}
+
+} // namespace page_template
+
+#endif
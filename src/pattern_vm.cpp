@@ -0,0 +1,263 @@
+#include <cstring>
+
+#include "pattern_vm.hpp"
+#include "packed16.hpp"
+
+namespace {
+
+constexpr uint16_t brightness(const uint8_t level) {
+    return level * 257;
+}
+
+uint8_t grouping_channels(const enum led_map::GROUPINGS grouping) {
+    switch (grouping) {
+        case led_map::BY_HEIGHT: return led_map::by_height.n_channels;
+        case led_map::BY_RING: return led_map::by_ring.n_channels;
+        case led_map::SINGLE: return led_map::single.n_channels;
+    }
+    return 0;
+}
+
+} // namespace
+
+PatternVM::PatternVM()
+    : programs{}
+    , program{nullptr}
+    , restart_requested{false}
+    , loaded_len{0}
+    , channel_grouping{led_map::SINGLE}
+    , n_loaded_channels{1}
+    , values{}
+    , pc{0}
+    , wait_frames{0}
+    , c{0}
+    , loops{}
+    , loop_depth{0}
+    , exhaustions{0}
+{}
+
+bool PatternVM::load(const uint8_t* program, size_t len) {
+    if (len < header_size || len - header_size > max_program_size
+            || program[0] != 'T' || program[1] != 'B'
+            || program[2] != format_version || program[3] > led_map::SINGLE) {
+        return false;
+    }
+    const auto grouping = static_cast<enum led_map::GROUPINGS>(program[3]);
+    const uint8_t n = grouping_channels(grouping);
+    if (n > max_channels) {
+        return false;
+    }
+    // Check opcodes, operands and block nesting
+    int depth = 0;
+    for (size_t i = header_size; i < len;) {
+        const uint8_t opcode = program[i];
+        if (opcode >= n_opcodes || i + 1 + operand_count(opcode) > len) {
+            return false;
+        }
+        const uint8_t* operands = &program[i + 1];
+        switch (opcode) {
+            case OP_SET:
+                if (operands[0] >= n) {
+                    return false;
+                }
+                break;
+            case OP_EACH:
+                if (operands[0] >= n || operands[1] >= n) {
+                    return false;
+                }
+                // Fall through
+            case OP_LOOP:
+                if (++depth > max_loop_depth) {
+                    return false;
+                }
+                break;
+            case OP_NEXT:
+                if (--depth < 0) {
+                    return false;
+                }
+                break;
+        }
+        i += 1 + operand_count(opcode);
+    }
+    if (depth != 0) {
+        return false;
+    }
+    Program& staged = programs.back();
+    staged.code_len = len - header_size;
+    std::memcpy(staged.code, program + header_size, staged.code_len);
+    staged.n_channels = n;
+    programs.publish();
+    loaded_len = len - header_size;
+    channel_grouping = grouping;
+    n_loaded_channels = n;
+    restart();
+    return true;
+}
+
+bool PatternVM::is_loaded() const {
+    return loaded_len > 0;
+}
+
+void PatternVM::restart() {
+    restart_requested.store(true, std::memory_order_release);
+}
+
+bool PatternVM::restart_pending() const {
+    return restart_requested.load(std::memory_order_relaxed);
+}
+
+void PatternVM::run_frame() {
+    if (restart_requested.exchange(false, std::memory_order_acquire)) {
+        if (programs.take()) {
+            program = &programs.front();
+        }
+        reset();
+    }
+    if (program == nullptr || program->code_len == 0) {
+        return;
+    }
+    if (wait_frames > 0) {
+        --wait_frames;
+        return;
+    }
+    for (uint16_t n = 0; n < instruction_budget; ++n) {
+        if (pc >= program->code_len) {
+            // Implicit END
+            pc = 0;
+            loop_depth = 0;
+        }
+        const uint8_t opcode = program->code[pc];
+        const uint8_t* operands = &program->code[pc + 1];
+        pc += 1 + operand_count(opcode);
+        if (!execute(opcode, operands)) {
+            return;
+        }
+    }
+    ++exhaustions;
+}
+
+const uint16_t* PatternVM::frame() const {
+    return values;
+}
+
+uint8_t PatternVM::n_channels() const {
+    return n_loaded_channels;
+}
+
+enum led_map::GROUPINGS PatternVM::grouping() const {
+    return channel_grouping;
+}
+
+uint32_t PatternVM::budget_exhaustions() const {
+    return exhaustions;
+}
+
+///////////// private
+
+uint8_t PatternVM::operand_count(uint8_t opcode) {
+    switch (opcode) {
+        case OP_SET: case OP_SETC: case OP_EACH:
+            return 2;
+        case OP_FILL: case OP_SHIFT: case OP_FADE: case OP_WAIT: case OP_LOOP:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+void PatternVM::reset() {
+    pc = 0;
+    wait_frames = 0;
+    c = 0;
+    loop_depth = 0;
+    std::memset(values, 0, sizeof(values));
+}
+
+// Returns false when the frame is complete (WAIT).
+// Block nesting is checked on load already, and again here, so the loop
+// stack stays in bounds whatever the code is.
+bool PatternVM::execute(uint8_t opcode, const uint8_t* operands) {
+    const uint8_t n = program->n_channels;
+    if ((opcode == OP_LOOP || opcode == OP_EACH) && loop_depth >= max_loop_depth) {
+        opcode = OP_END;
+    } else if (opcode == OP_NEXT && loop_depth == 0) {
+        opcode = OP_END;
+    }
+    switch (opcode) {
+        case OP_END:
+            pc = 0;
+            loop_depth = 0;
+            break;
+        case OP_SET:
+            values[operands[0]] = brightness(operands[1]);
+            break;
+        case OP_SETC: {
+            const int channel = c + static_cast<int8_t>(operands[0]);
+            if (channel >= 0 && channel < n) {
+                values[channel] = brightness(operands[1]);
+            }
+            break;
+        }
+        case OP_FILL:
+            for (uint8_t i = 0; i < n; ++i) {
+                values[i] = brightness(operands[0]);
+            }
+            break;
+        case OP_SHIFT:
+            if (operands[0] == 0) {
+                const uint16_t last = values[n - 1];
+                std::memmove(&values[1], &values[0], (n - 1) * sizeof(uint16_t));
+                values[0] = last;
+            } else {
+                const uint16_t first = values[0];
+                std::memmove(&values[0], &values[1], (n - 1) * sizeof(uint16_t));
+                values[n - 1] = first;
+            }
+            break;
+        case OP_FADE:
+            // Two channels per step, see packed16.hpp
+            for (uint8_t i = 0; i < n; i += 2) {
+                uint32_t pair;
+                std::memcpy(&pair, &values[i], sizeof(pair));
+                pair = packed16::scale(pair, operands[0]);
+                std::memcpy(&values[i], &pair, sizeof(pair));
+            }
+            break;
+        case OP_WAIT:
+            wait_frames = operands[0] > 0 ? operands[0] - 1 : 0;
+            return false;
+        case OP_LOOP:
+            loops[loop_depth++] = LoopState{pc, operands[0], false, 0, 0};
+            break;
+        case OP_EACH:
+            c = operands[0];
+            loops[loop_depth++] = LoopState{
+                pc, operands[1], true,
+                static_cast<int8_t>(operands[0] <= operands[1] ? 1 : -1), c};
+            break;
+        case OP_NEXT: {
+            LoopState& loop = loops[loop_depth - 1];
+            if (loop.is_each) {
+                if (loop.channel != loop.count) {
+                    loop.channel += loop.step;
+                    c = loop.channel;
+                    pc = loop.start_pc;
+                    break;
+                }
+            } else if (loop.count == 0 || --loop.count > 0) {
+                pc = loop.start_pc;
+                break;
+            }
+            // Block done, c is the channel of the enclosing EACH again
+            --loop_depth;
+            for (int i = loop_depth - 1; i >= 0; --i) {
+                if (loops[i].is_each) {
+                    c = loops[i].channel;
+                    break;
+                }
+            }
+            break;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,127 @@
+/* Bytecode interpreter for user-uploaded LED animations
+ *
+ * A program is a 4-byte header followed by instructions, each an opcode
+ * byte plus zero to two operand bytes:
+ *
+ *   Header: 'T', 'B', version (1), channel grouping (led_map::GROUPINGS)
+ *
+ *   END                restart the program from the beginning
+ *   SET ch, level      set channel ch to level
+ *   SETC offset, level set channel c + offset (signed), ignored when
+ *                      out of range. c is the channel of the innermost EACH
+ *   FILL level         set all channels to level
+ *   SHIFT direction    rotate all channels by one,
+ *                      0 => towards higher channel numbers
+ *   FADE factor        scale all channels by factor / 256
+ *   WAIT n_frames      show the frame, resume after n_frames (0 => 1)
+ *   LOOP count         repeat the block up to NEXT count times, 0 => forever
+ *   EACH first, last   repeat the block up to NEXT for c = first...last,
+ *                      counting up or down
+ *   NEXT               end of a LOOP or EACH block
+ *
+ * Levels are 8-bit brightness values, scaled to the 16-bit perceptually
+ * linear range of the pattern frames.
+ *
+ * Programs are validated completely on load. The interpreter then runs
+ * once per animation frame until the next WAIT, but for at most
+ * instruction_budget instructions, so a program without WAIT cannot block
+ * the timer task.
+ *
+ * Programs are loaded by the network task while the frame clock runs the
+ * current one. load() validates into a staging buffer of a TripleBuffer,
+ * and run_frame() switches to the new program on its next frame, so a
+ * running program is never modified.
+ */
+#ifndef PATTERN_VM_HPP__
+#define PATTERN_VM_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "led_map.hpp"
+#include "triple_buffer.hpp"
+
+class PatternVM
+{
+public:
+    enum OPCODES : uint8_t {OP_END, OP_SET, OP_SETC, OP_FILL, OP_SHIFT,
+                            OP_FADE, OP_WAIT, OP_LOOP, OP_EACH, OP_NEXT};
+    static constexpr int n_opcodes = OP_NEXT + 1;
+
+    static constexpr uint8_t header_size = 4;
+    static constexpr uint8_t format_version = 1;
+    static constexpr size_t max_program_size = 1024;
+    static constexpr uint8_t max_channels = 16;
+    static constexpr uint8_t max_loop_depth = 4;
+    // Instructions executed per frame at most
+    static constexpr uint16_t instruction_budget = 64;
+
+    PatternVM();
+
+    // Validate and load a program, returns false for an invalid program,
+    // then the previous program is kept. The program starts on the next
+    // run_frame().
+    bool load(const uint8_t* code, size_t len);
+    bool is_loaded() const;
+
+    // Restart the program with all channels off, on the next run_frame()
+    void restart();
+    // A new program or a restart is waiting for run_frame()
+    bool restart_pending() const;
+    // Run the program for one animation frame
+    void run_frame();
+
+    // Frame buffer, one 16-bit brightness value per channel
+    const uint16_t* frame() const;
+    // Channels and grouping of the last loaded program
+    uint8_t n_channels() const;
+    enum led_map::GROUPINGS grouping() const;
+
+    // Number of frames where the instruction budget ran out before WAIT
+    uint32_t budget_exhaustions() const;
+
+private:
+    struct LoopState
+    {
+        // Program counter of the first instruction of the block
+        uint16_t start_pc;
+        // LOOP: iterations left, 0 => forever. EACH: last channel.
+        uint8_t count;
+        bool is_each;
+        // EACH: counting direction and current channel
+        int8_t step;
+        uint8_t channel;
+    };
+
+    struct Program
+    {
+        uint8_t code[max_program_size];
+        uint16_t code_len;
+        uint8_t n_channels;
+    };
+
+    // Programs from load(), the front buffer is the running program
+    TripleBuffer<Program> programs;
+    const Program* program;
+    std::atomic<bool> restart_requested;
+    // Last loaded program
+    uint16_t loaded_len;
+    enum led_map::GROUPINGS channel_grouping;
+    uint8_t n_loaded_channels;
+
+    uint16_t values[max_channels];
+    uint16_t pc;
+    uint8_t wait_frames;
+    // Channel register set by EACH
+    uint8_t c;
+    LoopState loops[max_loop_depth];
+    uint8_t loop_depth;
+    uint32_t exhaustions;
+
+    static uint8_t operand_count(uint8_t opcode);
+    void reset();
+    bool execute(uint8_t opcode, const uint8_t* operands);
+}; // class PatternVM
+
+#endif
@@ -0,0 +1,161 @@
+#include <Arduino.h>
+
+#include "info_debug_error.h"
+#include "pixel_output.hpp"
+
+namespace {
+
+// I2S bit pattern for four WS2812 bits (one nibble), MSB first
+struct NibblePatterns
+{
+    uint16_t values[16];
+
+    constexpr NibblePatterns() : values{} {
+        for (int nibble = 0; nibble < 16; ++nibble) {
+            uint16_t pattern = 0;
+            for (int bit = 3; bit >= 0; --bit) {
+                pattern = pattern << 4 | (nibble & 1 << bit ? 0b1110 : 0b1000);
+            }
+            values[nibble] = pattern;
+        }
+    }
+};
+
+constexpr NibblePatterns nibble_patterns{};
+
+} // namespace
+
+PixelOutput::PixelOutput(uint8_t gpio, uint16_t n_pixels, i2s_port_t i2s_port)
+    : gpio{gpio}
+    , n_pixels{n_pixels}
+    , i2s_port{i2s_port}
+{}
+
+PixelOutput::~PixelOutput() {
+    refill_timer.detach();
+    if (is_started) {
+        i2s_driver_uninstall(i2s_port);
+    }
+}
+
+bool PixelOutput::begin() {
+    pixel_buffer.assign(3 * n_pixels, 0);
+    // Two 16-bit words per pixel byte, reset time is all zero
+    for (auto& i2s_frame : i2s_frames) {
+        i2s_frame.assign(2 * pixel_buffer.size() + reset_bytes / 2, 0);
+    }
+    // DMA ring must hold two frames
+    frame_bytes = 2 * i2s_frames[0].size();
+    constexpr size_t dma_buf_bytes = 4 * dma_buf_len;
+    const int dma_buf_count = std::max<size_t>(
+        2, (2 * frame_bytes + dma_buf_bytes - 1) / dma_buf_bytes);
+    i2s_config_t i2s_config{};
+    i2s_config.mode = static_cast<i2s_mode_t>(I2S_MODE_MASTER | I2S_MODE_TX);
+    i2s_config.sample_rate = i2s_sample_rate;
+    i2s_config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+    i2s_config.channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT;
+    i2s_config.communication_format = I2S_COMM_FORMAT_I2S_MSB;
+    i2s_config.dma_buf_count = dma_buf_count;
+    i2s_config.dma_buf_len = dma_buf_len;
+    // Line stays low when no frame is queued
+    i2s_config.tx_desc_auto_clear = true;
+    if (i2s_driver_install(i2s_port, &i2s_config, 0, nullptr) != ESP_OK) {
+        error_print("Pixel output: I2S driver install failed");
+        return false;
+    }
+    i2s_pin_config_t pin_config{};
+    pin_config.bck_io_num = I2S_PIN_NO_CHANGE;
+    pin_config.ws_io_num = I2S_PIN_NO_CHANGE;
+    pin_config.data_out_num = gpio;
+    pin_config.data_in_num = I2S_PIN_NO_CHANGE;
+    i2s_set_pin(i2s_port, &pin_config);
+    is_started = true;
+    debug_print_sv("Pixel output started, number of pixels: ", n_pixels);
+    return true;
+}
+
+void PixelOutput::set_pixel(uint16_t index, uint8_t red, uint8_t green, uint8_t blue) {
+    if (index >= n_pixels || !is_started) {
+        return;
+    }
+    uint8_t* pixel = &pixel_buffer[3 * index];
+    pixel[0] = green;
+    pixel[1] = red;
+    pixel[2] = blue;
+}
+
+// The frame being queued is never touched, the new frame goes into the
+// other buffer.
+bool PixelOutput::show() {
+    if (!is_started) {
+        return false;
+    }
+    if (frame_waiting) {
+        ++dropped;
+    }
+    encode_frame(i2s_frames[1 - queuing_index].data());
+    frame_waiting = true;
+    refill();
+    return true;
+}
+
+uint16_t PixelOutput::size() const {
+    return n_pixels;
+}
+
+uint32_t PixelOutput::frame_time_us() const {
+    return frame_bytes * 8 * 1000000ULL / i2s_bit_rate;
+}
+
+uint32_t PixelOutput::frames_shown() const {
+    return shown;
+}
+
+uint32_t PixelOutput::frames_dropped() const {
+    return dropped;
+}
+
+///////////// private
+
+// The I2S peripheral sends the right channel (second 16-bit word) of each
+// stereo sample first, so the low nibble word goes first in memory.
+void PixelOutput::encode_frame(uint16_t* out) {
+    for (const uint8_t value : pixel_buffer) {
+        *out++ = nibble_patterns.values[value & 0x0F];
+        *out++ = nibble_patterns.values[value >> 4];
+    }
+}
+
+// Queues the rest of the current frame and then the waiting one, as far
+// as the DMA ring takes them
+void PixelOutput::refill() {
+    for (;;) {
+        if (bytes_pending == 0) {
+            if (!frame_waiting) {
+                refill_timer.detach();
+                is_refilling = false;
+                return;
+            }
+            queuing_index = 1 - queuing_index;
+            frame_waiting = false;
+            bytes_pending = frame_bytes;
+            ++shown;
+        }
+        const auto* data = reinterpret_cast<const uint8_t*>(
+            i2s_frames[queuing_index].data()) + frame_bytes - bytes_pending;
+        size_t bytes_written = 0;
+        i2s_write(i2s_port, data, bytes_pending, &bytes_written, 0);
+        bytes_pending -= bytes_written;
+        if (bytes_pending > 0) {
+            if (!is_refilling) {
+                is_refilling = true;
+                refill_timer.attach_ms(refill_interval_ms, on_refill_timer, this);
+            }
+            return;
+        }
+    }
+}
+
+void PixelOutput::on_refill_timer(PixelOutput* self) {
+    self->refill();
+}
@@ -0,0 +1,87 @@
+/* WS2812 style addressable LED strip output via I2S with DMA
+ *
+ * The pixels are sent as a serial bit stream of 800 kbit/s. Each WS2812
+ * bit is encoded as four I2S bits at 3.2 MHz, "1000" for a zero and
+ * "1110" for a one, so the I2S peripheral can clock out a whole frame by
+ * DMA without any CPU involvement.
+ *
+ * Frames are rendered into a GRB pixel buffer. show() encodes the buffer
+ * into one of two I2S frame buffers: While one frame is being queued into
+ * the DMA ring, the next one waits in the other buffer. A frame is always
+ * queued in full, a part which does not fit into the DMA ring is carried
+ * over by a refill timer. Starting a frame in the middle of another one
+ * would garble the whole strip.
+ */
+#ifndef PIXEL_OUTPUT_HPP__
+#define PIXEL_OUTPUT_HPP__
+
+#include <cstdint>
+#include <vector>
+#include <driver/i2s.h>
+#include <Ticker.h>
+
+class PixelOutput
+{
+public:
+    // WS2812 data rate and I2S bit clock (four I2S bits per WS2812 bit)
+    static constexpr uint32_t ws2812_bit_rate = 800000;
+    static constexpr uint32_t i2s_bit_rate = 4 * ws2812_bit_rate;
+    // I2S sample frame is 16-bit stereo => 32 bits
+    static constexpr int i2s_sample_rate = i2s_bit_rate / 32;
+    // Low time after each frame latches the pixel values (>= 50 us)
+    static constexpr size_t reset_bytes = 32;
+    // DMA buffer length in I2S sample frames (4 bytes each)
+    static constexpr int dma_buf_len = 256;
+    // Refill timer period while a frame is only partly queued. The DMA
+    // ring is full then, which is at least two DMA buffers (5 ms).
+    static constexpr uint32_t refill_interval_ms = 1;
+
+    PixelOutput(uint8_t gpio, uint16_t n_pixels, i2s_port_t i2s_port = I2S_NUM_1);
+    virtual ~PixelOutput();
+
+    // Install the I2S driver and allocate the frame buffers
+    bool begin();
+
+    void set_pixel(uint16_t index, uint8_t red, uint8_t green, uint8_t blue);
+
+    // Queue the current pixel buffer for output, after the frame being
+    // queued now. A frame still waiting from the last call is replaced,
+    // it is counted as dropped.
+    bool show();
+
+    uint16_t size() const;
+    // Transmission time of one frame
+    uint32_t frame_time_us() const;
+    // Frames queued into the DMA ring, in full or partly
+    uint32_t frames_shown() const;
+    uint32_t frames_dropped() const;
+
+private:
+    const uint8_t gpio;
+    const uint16_t n_pixels;
+    const i2s_port_t i2s_port;
+
+    bool is_started = false;
+    bool is_refilling = false;
+    // Pixel buffer, three bytes per pixel in order of transmission (GRB)
+    std::vector<uint8_t> pixel_buffer;
+    // I2S bit pattern of two frames, including reset time: The frame
+    // being queued into the DMA ring and the next one
+    std::vector<uint16_t> i2s_frames[2];
+    size_t frame_bytes = 0;
+    uint8_t queuing_index = 0;
+    bool frame_waiting = false;
+    // Bytes of the frame being queued which did not fit into the DMA ring
+    size_t bytes_pending = 0;
+    // Refill timer, runs only while a frame is partly queued
+    Ticker refill_timer;
+    uint32_t shown = 0;
+    uint32_t dropped = 0;
+
+    void encode_frame(uint16_t* out);
+    void refill();
+
+    static void on_refill_timer(PixelOutput* self);
+}; // class PixelOutput
+
+#endif
@@ -0,0 +1,1227 @@
+/* Host simulation entry point for the "native" environment
+ *
+ * Builds the same object graph as app_main.cpp on top of the simulated
+ * ESP32 (see sim/esp32_sim) and runs it on the virtual clock. All LED,
+ * audio, touch and API heartbeat handling runs in timer callbacks, so the
+ * per-timer dispatch statistics show where the time goes.
+ *
+ * Usage: program [-v] [-w file.wav] [-p file.wav]
+ *   -v: Show the application serial console output
+ *   -w: Write the synthesizer output of the audio scenario to a WAV file
+ *   -p: Microphone input for the audio-reactive mode, 16-bit mono WAV or
+ *       raw PCM at AudioAnalyzer::sample_rate. Default is a test signal.
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <Arduino.h>
+#include <Ticker.h>
+#include <ESPAsyncWebServer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <sim.hpp>
+
+#include "api_server.hpp"
+#include "api_server_config.hpp"
+#include "fft.hpp"
+#include "tannenbaum.hpp"
+
+namespace {
+
+constexpr uint64_t us_per_s = 1000000;
+
+struct App {
+    AsyncWebServer http_backend{80};
+    APIServer api_server{&http_backend};
+    Tannenbaum tannenbaum;
+
+    explicit App(Tannenbaum::OUTPUTS output = Tannenbaum::PWM_OUTPUT,
+                 uint16_t n_pixels = led_map::n_leds)
+        : tannenbaum{api_server, Tannenbaum::LARSON, output, n_pixels}
+    {
+        api_server.activate_events_on("/events");
+        api_server.activate_websocket_on("/ws");
+        api_server.activate_default_callbacks();
+    }
+
+    int cmd(const char* url) {
+        auto request = http_backend.sim_request(HTTP_GET, url);
+        auto response = request->sim_response();
+        return response ? response->code() : 0;
+    }
+
+    int post(const char* url, const uint8_t* body, size_t len) {
+        auto request = http_backend.sim_request(HTTP_POST, url, {}, body, len);
+        auto response = request->sim_response();
+        return response ? response->code() : 0;
+    }
+
+    int upload(const char* url, const char* filename, const String& content) {
+        auto request = http_backend.sim_upload(
+            url, filename, reinterpret_cast<const uint8_t*>(content.c_str()),
+            content.length());
+        auto response = request->sim_response();
+        return response ? response->code() : 0;
+    }
+};
+
+// Larson scanner as bytecode animation program, see pattern_vm.hpp
+constexpr uint8_t dim_level = Tannenbaum::led_dim / 257;
+constexpr uint8_t larson_program[] = {
+    'T', 'B', PatternVM::format_version, led_map::BY_HEIGHT,
+    PatternVM::OP_LOOP, 0,
+        PatternVM::OP_EACH, 0, 6,
+            PatternVM::OP_FILL, 0,
+            PatternVM::OP_SETC, static_cast<uint8_t>(-1), dim_level,
+            PatternVM::OP_SETC, 0, 255,
+            PatternVM::OP_SETC, 1, dim_level,
+            PatternVM::OP_WAIT, 1,
+        PatternVM::OP_NEXT,
+        PatternVM::OP_EACH, 5, 1,
+            PatternVM::OP_FILL, 0,
+            PatternVM::OP_SETC, static_cast<uint8_t>(-1), dim_level,
+            PatternVM::OP_SETC, 0, 255,
+            PatternVM::OP_SETC, 1, dim_level,
+            PatternVM::OP_WAIT, 1,
+        PatternVM::OP_NEXT,
+    PatternVM::OP_NEXT,
+};
+// Endless loop without WAIT, stopped by the instruction budget
+constexpr uint8_t runaway_program[] = {
+    'T', 'B', PatternVM::format_version, led_map::BY_RING,
+    PatternVM::OP_LOOP, 0,
+        PatternVM::OP_SHIFT, 0,
+    PatternVM::OP_NEXT,
+};
+
+// Eighth notes up and down two octaves, for melody timing
+constexpr auto scale_melody = compile_melody({
+    C, D, E, F, G, A, B, O_UP, C, D, E, F, G, A, B,
+    A, G, F, E, D, C, O_DOWN, B, A, G, F, E, D, C});
+// Eighth note at the default tempo of the player
+constexpr uint32_t eighth_note_ms = 2 * 64;
+
+void report_timers(const char* scenario, double seconds) {
+    std::printf("\n== %s (%.1f s simulated)\n", scenario, seconds);
+    std::printf("%-32s %8s %10s %10s %10s %10s\n", "timer", "calls",
+                "late avg", "late max", "host avg", "host max");
+    std::printf("%-32s %8s %10s %10s %10s %10s\n", "", "",
+                "[us]", "[us]", "[ns]", "[ns]");
+    for (const auto& stats : sim::timer_stats()) {
+        const uint64_t calls = stats.calls ? stats.calls : 1;
+        std::printf("%-32s %8llu %10llu %10llu %10llu %10llu\n",
+                    stats.name,
+                    static_cast<unsigned long long>(stats.calls),
+                    static_cast<unsigned long long>(stats.late_us_sum / calls),
+                    static_cast<unsigned long long>(stats.late_us_max),
+                    static_cast<unsigned long long>(stats.host_ns_sum / calls),
+                    static_cast<unsigned long long>(stats.host_ns_max));
+    }
+    std::printf("ledcWrite calls: %llu (%.0f/s), hardware fades: %llu (%.0f/s), "
+                "ledcAttachPin calls: %llu, GPIO matrix routes: %llu\n",
+                static_cast<unsigned long long>(sim::ledc_write_count()),
+                sim::ledc_write_count() / seconds,
+                static_cast<unsigned long long>(sim::ledc_fade_count()),
+                sim::ledc_fade_count() / seconds,
+                static_cast<unsigned long long>(sim::ledc_attach_count()),
+                static_cast<unsigned long long>(sim::gpio_matrix_route_count()));
+}
+
+void run_scenario(App& app, const char* scenario, double seconds) {
+    sim::reset_timer_stats();
+    sim::reset_ledc_counters();
+    sim::run_for(static_cast<uint64_t>(seconds * us_per_s));
+    report_timers(scenario, seconds);
+    std::printf("PWM writes saved: %u/s\n",
+                app.tannenbaum.pwm_writes_saved_per_s());
+}
+
+// Dispatch lateness of the timeline running the LED frame clock
+void report_frame_clock_jitter() {
+    for (const auto& stats : sim::timer_stats()) {
+        if (std::strcmp(stats.name, "timeline") == 0) {
+            const uint64_t calls = stats.calls ? stats.calls : 1;
+            std::printf("LED frame clock jitter: %llu us avg, %llu us max\n",
+                        static_cast<unsigned long long>(stats.late_us_sum / calls),
+                        static_cast<unsigned long long>(stats.late_us_max));
+        }
+    }
+}
+
+void press_button(int touch_io) {
+    sim::touch_set_value(touch_io, sim::touch_value_pressed);
+    sim::run_for(200 * 1000);
+    sim::touch_set_value(touch_io, sim::touch_value_released);
+    sim::run_for(200 * 1000);
+}
+
+// A layer render preempted once, e.g. by WiFi on the same core, must not
+// keep the layer skipped
+bool run_layer_budget_checks() {
+    constexpr int n_frames = 100;
+    constexpr int skipped_limit = 16;
+    Compositor compositor{Tannenbaum::frame_clock_ms};
+    compositor.toggle_layer(Compositor::BREATHE);
+    const uint16_t base[led_map::n_leds] = {};
+    compositor.compose(base, led_map::n_leds, Tannenbaum::render_budget_us);
+    // micros() calls: Frame start, layer start, layer end
+    sim::preempt_micros_call(3, 4 * Tannenbaum::render_budget_us);
+    compositor.compose(base, led_map::n_leds, Tannenbaum::render_budget_us);
+    const uint32_t overruns_before = compositor.budget_overruns();
+    for (int i = 0; i < n_frames; ++i) {
+        compositor.compose(base, led_map::n_leds, Tannenbaum::render_budget_us);
+    }
+    const uint32_t skipped = compositor.budget_overruns() - overruns_before;
+    const bool recovered = skipped > 0 && skipped <= skipped_limit;
+    std::printf("Layer after one preempted render: skipped in %u of %d frames "
+                "(limit %d): %s\n", skipped, n_frames, skipped_limit,
+                recovered ? "OK" : "FAILED");
+    return recovered;
+}
+
+// Returns false when a check fails
+// Rendered page cache: 200 with ETag, 304 on revalidation, new ETag
+// after a template value has changed
+bool run_page_cache_checks(App& app) {
+    auto get_page = [&app](const String& etag) {
+        std::vector<std::pair<String, String>> headers;
+        if (etag.length() > 0) {
+            headers.emplace_back("If-None-Match", etag);
+        }
+        return app.http_backend.sim_request(HTTP_GET, "/", headers);
+    };
+    auto etag_of = [](const AsyncWebServerResponse* response) {
+        const String* etag = response ? response->header("ETag") : nullptr;
+        return etag ? *etag : String{};
+    };
+    auto code_of = [](const AsyncWebServerResponse* response) {
+        return response ? response->code() : 0;
+    };
+
+    std::printf("\n== Page cache\n");
+    auto first = get_page(String{});
+    const String etag = etag_of(first->sim_response());
+    const bool first_ok = code_of(first->sim_response()) == 200 && etag.length() > 0
+        && first->sim_response()->content().indexOf("%") < 0;
+    auto again = get_page(etag);
+    const bool again_ok = code_of(again->sim_response()) == 304
+        && etag_of(again->sim_response()) == etag;
+    app.cmd("/cmd?on_off");
+    auto changed = get_page(etag);
+    const String new_etag = etag_of(changed->sim_response());
+    const bool changed_ok = code_of(changed->sim_response()) == 200
+        && new_etag.length() > 0 && new_etag != etag;
+    app.cmd("/cmd?on_off");
+    std::printf("GET: %d, revalidate: %d, after change: %d, ETag %s -> %s: %s\n",
+                code_of(first->sim_response()), code_of(again->sim_response()),
+                code_of(changed->sim_response()), etag.c_str(), new_etag.c_str(),
+                first_ok && again_ok && changed_ok ? "OK" : "FAILED");
+
+    // Cost per full page and per revalidation
+    constexpr int n_requests = 1000;
+    for (const bool revalidate : {false, true}) {
+        const String current = etag_of(get_page(String{})->sim_response());
+        const String request_etag = revalidate ? current : String{};
+        const uint64_t allocs_before = sim::heap_alloc_count();
+        const uint64_t alloc_bytes_before = sim::heap_alloc_bytes();
+        const auto t_start = std::chrono::steady_clock::now();
+        for (int i = 0; i < n_requests; ++i) {
+            get_page(request_etag);
+        }
+        const auto t_end = std::chrono::steady_clock::now();
+        std::printf("%s: %.1f us per request host, %.1f heap allocations"
+                    " (%.0f bytes) per request\n",
+                    revalidate ? "304 Not Modified" : "200 page",
+                    std::chrono::duration<double, std::micro>(t_end - t_start).count()
+                    / n_requests,
+                    static_cast<double>(sim::heap_alloc_count() - allocs_before)
+                    / n_requests,
+                    static_cast<double>(sim::heap_alloc_bytes() - alloc_bytes_before)
+                    / n_requests);
+    }
+    return first_ok && again_ok && changed_ok;
+}
+
+// Embedded web assets: Linked from the page, served gzipped and immutable
+bool run_asset_checks(App& app) {
+    std::printf("\n== Web assets\n");
+    auto page = app.http_backend.sim_request(HTTP_GET, "/");
+    const String& html = page->sim_response()->content();
+    bool ok = true;
+    for (const auto& asset : web_assets::assets) {
+        auto request = app.http_backend.sim_request(HTTP_GET, asset.url);
+        const AsyncWebServerResponse* response = request->sim_response();
+        const String* encoding = response ? response->header("Content-Encoding") : nullptr;
+        const String* cache_control = response ? response->header("Cache-Control") : nullptr;
+        const bool asset_ok = response && response->code() == 200
+            && html.indexOf(asset.url) >= 0
+            && response->content().length() == asset.gz_size
+            && asset.gz[0] == 0x1f && asset.gz[1] == 0x8b
+            && encoding && *encoding == "gzip"
+            && cache_control && cache_control->indexOf("immutable") >= 0;
+        std::printf("%s: %zu bytes gzipped, %s\n",
+                    asset.url, asset.gz_size, asset_ok ? "OK" : "FAILED");
+        ok = ok && asset_ok;
+    }
+    std::printf("Page: %u bytes\n", html.length());
+    return ok;
+}
+
+// Commands answered with 204, the state as JSON from a fixed buffer
+bool run_state_checks(App& app) {
+    std::printf("\n== State endpoint\n");
+    auto get = [&app](const char* url) {
+        return app.http_backend.sim_request(HTTP_GET, url);
+    };
+    auto click = get("/cmd?spin_right");
+    auto state = get("/state");
+    const AsyncWebServerResponse* click_response = click->sim_response();
+    const AsyncWebServerResponse* state_response = state->sim_response();
+    const bool click_ok = click_response && click_response->code() == 204
+        && click_response->content().length() == 0;
+    const bool state_ok = state_response && state_response->code() == 200
+        && state_response->contentType() == "application/json"
+        && state_response->content().startsWith("{\"mode\":\"spin_right\",");
+    std::printf("Click: %d, %u bytes, page: %u bytes\n",
+                click_response ? click_response->code() : 0,
+                click_response ? click_response->content().length() : 0,
+                get("/")->sim_response()->content().length());
+    std::printf("State: %d %s: %s\n", state_response ? state_response->code() : 0,
+                state_response ? state_response->content().c_str() : "",
+                click_ok && state_ok ? "OK" : "FAILED");
+
+    // The response is sent after the handler returned, its content must not
+    // change with a later state change or state request
+    auto early = get("/state");
+    get("/cmd?larson");
+    get("/state");
+    const bool early_ok = early->sim_response()
+        && early->sim_response()->content().startsWith("{\"mode\":\"spin_right\",");
+    std::printf("State sent after a state change: %s\n", early_ok ? "OK" : "FAILED");
+
+    constexpr int n_requests = 1000;
+    const uint64_t allocs_before = sim::heap_alloc_count();
+    for (int i = 0; i < n_requests; ++i) {
+        get("/state");
+    }
+    std::printf("%.1f heap allocations per state request\n",
+                static_cast<double>(sim::heap_alloc_count() - allocs_before) / n_requests);
+    return click_ok && state_ok && early_ok;
+}
+
+// Data of an SSE frame: "event: state\r\ndata: {...}\r\n\r\n"
+String data_of(const String& frame) {
+    const int start = frame.indexOf("data: ");
+    return start < 0 ? String{} : frame.substring(start + 6, frame.indexOf('\r', start));
+}
+
+// State changes pushed as coalesced delta events, heartbeats only when idle
+bool run_state_push_checks(App& app) {
+    std::printf("\n== State push\n");
+    // Let the tune end, its tempo is part of the state
+    for (int i = 0; i < 300 && app.tannenbaum.timeline.has_tempo(); ++i) {
+        sim::run_for(us_per_s);
+    }
+    sim::run_for(us_per_s);
+    AsyncEventSource& events = *app.api_server.event_source;
+    AsyncEventSourceClient* client = events.sim_connect();
+    const String full_state = data_of(client->sim_last_message());
+    const bool connect_ok = full_state.startsWith("{\"mode\":")
+        && client->sim_last_message().indexOf("event: state") >= 0;
+    std::printf("On connect: %s\n", full_state.c_str());
+
+    const uint64_t idle_before = client->sim_messages();
+    const uint64_t idle_bytes_before = client->sim_bytes();
+    constexpr int idle_s = 60;
+    sim::run_for(idle_s * us_per_s);
+    const uint64_t idle_messages = client->sim_messages() - idle_before;
+    std::printf("Idle %d s: %llu events, %llu bytes\n", idle_s,
+                static_cast<unsigned long long>(idle_messages),
+                static_cast<unsigned long long>(client->sim_bytes() - idle_bytes_before));
+
+    // Changes in a row make one event with the changed members only,
+    // crossfade is toggled back
+    const uint64_t before = client->sim_messages();
+    app.cmd("/cmd?spin_left");
+    app.cmd("/cmd?crossfade");
+    app.cmd("/cmd?crossfade");
+    sim::run_for(us_per_s / 10);
+    const uint64_t n_pushed = client->sim_messages() - before;
+    const String delta = data_of(client->sim_last_message());
+    std::printf("3 commands: %llu event %s\n",
+                static_cast<unsigned long long>(n_pushed), delta.c_str());
+    const bool coalesce_ok = n_pushed == 1 && delta == "{\"mode\":\"spin_left\"}";
+    const bool idle_ok = idle_messages <= idle_s * 1000 / heartbeat_interval;
+    std::printf("State push: %s\n",
+                connect_ok && idle_ok && coalesce_ok ? "OK" : "FAILED");
+    events.sim_disconnect(client);
+    return connect_ok && idle_ok && coalesce_ok;
+}
+
+// Stalled event clients: Bounded queues, the latest state after catching
+// up, disconnect when behind for too long
+bool run_sse_backpressure_checks(App& app) {
+    std::printf("\n== SSE backpressure\n");
+    APIServer& api = app.api_server;
+    AsyncEventSource& events = *api.event_source;
+    auto burst = [&app](int n_changes) {
+        for (int i = 0; i < n_changes; ++i) {
+            app.cmd("/cmd?crossfade");
+            sim::run_for(us_per_s / 20);
+        }
+    };
+    auto current_state = [&app]() {
+        return app.http_backend.sim_request(HTTP_GET, "/state")->sim_response()->content();
+    };
+    AsyncEventSourceClient* fast = events.sim_connect();
+    AsyncEventSourceClient* slow = events.sim_connect();
+    const uint32_t coalesced_before = api.events_coalesced();
+    const uint64_t fast_before = fast->sim_messages();
+
+    // One stalled client: Its queue stays at the limit, the others get all
+    slow->sim_set_stalled(true);
+    burst(100);
+    const bool bounded_ok = slow->packetsWaiting() <= sse_max_queue_depth
+        && fast->sim_messages() - fast_before == 100
+        && api.events_coalesced() - coalesced_before == 100 - sse_max_queue_depth;
+    std::printf("1 stalled client, 100 changes: fast client %llu events, "
+                "slow client %zu waiting, peak %zu bytes, %u coalesced: %s\n",
+                static_cast<unsigned long long>(fast->sim_messages() - fast_before),
+                slow->packetsWaiting(), slow->sim_peak_queued_bytes(),
+                api.events_coalesced() - coalesced_before, bounded_ok ? "OK" : "FAILED");
+    slow->sim_set_stalled(false);
+    sim::run_for(event_timer_interval * 1100);
+    const bool catch_up_ok = data_of(slow->sim_last_message()) == current_state();
+    std::printf("Caught up, latest state: %s\n", catch_up_ok ? "OK" : "FAILED");
+
+    // Two stalled clients: The global budget holds
+    AsyncEventSourceClient* slow2 = events.sim_connect();
+    slow->sim_set_stalled(true);
+    slow2->sim_set_stalled(true);
+    burst(20);
+    const size_t queued = slow->packetsWaiting() + slow2->packetsWaiting();
+    const bool budget_ok = queued * (APIServer::state_buffer_size + 64) <= sse_queue_budget_bytes;
+    slow2->sim_set_stalled(false);
+    sim::run_for(event_timer_interval * 1100);
+    const bool fast_latest_ok = data_of(fast->sim_last_message()) == current_state();
+    std::printf("2 stalled clients: %zu messages waiting, fast client has latest state: %s\n",
+                queued, budget_ok && fast_latest_ok ? "OK" : "FAILED");
+
+    // All slots taken: Refused
+    const uint32_t closed_before = api.event_clients_closed();
+    AsyncEventSourceClient* extra = events.sim_connect();
+    AsyncEventSourceClient* refused = events.sim_connect();
+    const bool refuse_ok = extra->connected() && !refused->connected()
+        && api.event_clients_closed() == closed_before + 1;
+
+    // Staying behind: Disconnected after the timeout
+    burst(sse_slow_client_timeout_ms / 50 + 40);
+    const bool disconnect_ok = !slow->connected() && fast->connected()
+        && slow2->connected() && api.event_clients_closed() == closed_before + 2;
+    std::printf("Refused 5th client, slow client closed after %lu ms: %s\n",
+                sse_slow_client_timeout_ms, refuse_ok && disconnect_ok ? "OK" : "FAILED");
+    std::printf("Events coalesced: %u, dropped: %u, clients closed: %u\n",
+                api.events_coalesced(), api.events_dropped(), api.event_clients_closed());
+    for (AsyncEventSourceClient* client : {fast, slow, slow2, extra, refused}) {
+        events.sim_disconnect(client);
+    }
+    return bounded_ok && catch_up_ok && budget_ok && fast_latest_ok && refuse_ok
+        && disconnect_ok;
+}
+
+// Binary WebSocket commands and a live frame stream at 60 fps
+bool run_websocket_checks(App& app) {
+    std::printf("\n== WebSocket control and live frames\n");
+    Tannenbaum& tannenbaum = app.tannenbaum;
+    AsyncWebSocket& ws = *app.api_server.websocket;
+    auto current_state = [&app]() {
+        return app.http_backend.sim_request(HTTP_GET, "/state")->sim_response()->content();
+    };
+    AsyncWebSocketClient* client = ws.sim_connect();
+
+    const uint8_t mode_cmd[] = {Tannenbaum::WS_MODE, Tannenbaum::SPIN_RIGHT};
+    const uint8_t speed_cmd[] = {Tannenbaum::WS_SPEED, 25, 0, 0xe8, 0x03};
+    const uint8_t brightness_cmd[] = {Tannenbaum::WS_BRIGHTNESS, 128};
+    ws.sim_receive(client, mode_cmd, sizeof(mode_cmd));
+    ws.sim_receive(client, speed_cmd, sizeof(speed_cmd));
+    ws.sim_receive(client, brightness_cmd, sizeof(brightness_cmd));
+    const String state = current_state();
+    const bool commands_ok = state.startsWith("{\"mode\":\"spin_right\"")
+        && state.indexOf("\"frames_per_s\":25.0,") >= 0
+        && state.indexOf("\"brightness\":128") >= 0;
+    std::printf("Mode, speed, brightness: %s %s\n", state.c_str(),
+                commands_ok ? "OK" : "FAILED");
+
+    // Text, truncated and unknown messages are rejected
+    const uint32_t rejected_before = app.api_server.ws_messages_rejected();
+    const uint8_t bad_mode[] = {Tannenbaum::WS_MODE, Tannenbaum::n_op_modes};
+    const uint8_t short_frame[] = {Tannenbaum::WS_FRAME, 0, 0};
+    const uint8_t unknown[] = {0xff};
+    ws.sim_receive(client, mode_cmd, sizeof(mode_cmd), false);
+    ws.sim_receive(client, bad_mode, sizeof(bad_mode));
+    ws.sim_receive(client, short_frame, sizeof(short_frame));
+    ws.sim_receive(client, unknown, sizeof(unknown));
+    const bool reject_ok = app.api_server.ws_messages_rejected() - rejected_before == 4
+        && current_state().startsWith("{\"mode\":\"spin_right\"");
+    std::printf("Invalid messages rejected: %s\n", reject_ok ? "OK" : "FAILED");
+
+    // Live frames: A moving dot, received at the display rate of the client.
+    // A frame is shown right away, not on the next frame clock tick.
+    constexpr uint32_t live_latency_limit_us = 1000;
+    constexpr int fps = 60;
+    constexpr int n_frames = 5 * fps;
+    uint8_t frame[1 + Tannenbaum::n_live_channels] = {Tannenbaum::WS_FRAME};
+    const uint32_t received_before = tannenbaum.live_frames_received();
+    const uint32_t shown_before = tannenbaum.live_frames_shown();
+    const uint64_t allocs_before = sim::heap_alloc_count();
+    for (int i = 0; i < n_frames; ++i) {
+        std::fill(frame + 1, frame + sizeof(frame), 0);
+        frame[1 + i % Tannenbaum::n_live_channels] = 255;
+        ws.sim_receive(client, frame, sizeof(frame));
+        sim::run_for(us_per_s / fps);
+    }
+    const uint64_t allocs = sim::heap_alloc_count() - allocs_before;
+    const uint32_t received = tannenbaum.live_frames_received() - received_before;
+    const uint32_t shown = tannenbaum.live_frames_shown() - shown_before;
+    const bool live_ok = current_state().startsWith("{\"mode\":\"live\"")
+        && received == n_frames && shown == n_frames && allocs == 0
+        && tannenbaum.live_latency_us_max() <= live_latency_limit_us;
+    std::printf("%d frames at %d fps: %u received, %u shown, latency avg %u us, "
+                "max %u us, %.2f heap allocations per frame: %s\n",
+                n_frames, fps, received, shown, tannenbaum.live_latency_us_avg(),
+                tannenbaum.live_latency_us_max(),
+                static_cast<double>(allocs) / n_frames, live_ok ? "OK" : "FAILED");
+
+    // Round trip seen by the client: Frames with a sequence are echoed
+    // when they are on the LEDs
+    constexpr int n_echo_frames = 10;
+    uint8_t sequenced[sizeof(frame) + 4];
+    std::copy(frame, frame + sizeof(frame), sequenced);
+    int n_echoed = 0;
+    for (int i = 0; i < n_echo_frames; ++i) {
+        const uint32_t sequence = 0x01020300 + i;
+        for (int byte = 0; byte < 4; ++byte) {
+            sequenced[sizeof(frame) + byte] = sequence >> 8 * byte;
+        }
+        const uint64_t messages_before = client->sim_messages();
+        ws.sim_receive(client, sequenced, sizeof(sequenced));
+        sim::run_for(live_latency_limit_us);
+        const String& echo = client->sim_last_message();
+        if (client->sim_messages() == messages_before + 1 && echo.length() == 5
+                && std::equal(sequenced + sizeof(frame), sequenced + sizeof(sequenced),
+                              reinterpret_cast<const uint8_t*>(echo.c_str()) + 1)
+                && static_cast<uint8_t>(echo[0]) == Tannenbaum::WS_FRAME) {
+            ++n_echoed;
+        }
+        sim::run_for(us_per_s / fps - live_latency_limit_us);
+    }
+    const bool echo_ok = n_echoed == n_echo_frames;
+    std::printf("Sequence echo within %u us: %d of %d frames: %s\n",
+                live_latency_limit_us, n_echoed, n_echo_frames,
+                echo_ok ? "OK" : "FAILED");
+
+    const uint8_t restore_mode[] = {Tannenbaum::WS_MODE, Tannenbaum::LARSON};
+    const uint8_t restore_brightness[] = {Tannenbaum::WS_BRIGHTNESS, 255};
+    ws.sim_receive(client, restore_mode, sizeof(restore_mode));
+    ws.sim_receive(client, restore_brightness, sizeof(restore_brightness));
+    ws.sim_disconnect(client);
+    sim::run_for(us_per_s / 10);
+    return commands_ok && reject_ok && live_ok && echo_ok;
+}
+
+bool run_pwm_scenarios() {
+    bool ok = true;
+    App app;
+
+    // LED pattern hot path, one scenario per mode
+    const char* mode_cmds[] = {"larson", "spin_right", "spin_left",
+                               "arrow_up", "arrow_down"};
+    for (auto mode_cmd : mode_cmds) {
+        String url = String{"/cmd?"} + mode_cmd;
+        app.cmd(url.c_str());
+        sim::run_for(2 * us_per_s);
+        run_scenario(app, mode_cmd, 10);
+    }
+
+    // Hardware crossfade renderer
+    app.cmd("/cmd?larson");
+    app.cmd("/cmd?crossfade");
+    run_scenario(app, "larson, crossfade", 10);
+    app.cmd("/cmd?crossfade");
+
+    // Effect layers composed over the Larson pattern
+    app.cmd("/cmd?breathe");
+    app.cmd("/cmd?sparkle");
+    run_scenario(app, "larson + breathe + sparkle", 10);
+    std::printf("Render budget overruns: %u\n",
+                app.tannenbaum.render_budget_overruns());
+    app.cmd("/cmd?breathe");
+    app.cmd("/cmd?sparkle");
+    ok = run_layer_budget_checks() && ok;
+    app.cmd("/cmd?arrow_down");
+
+    // Bytecode animation programs, compare with the native larson mode
+    std::printf("\n== Program upload: %d\n",
+                app.post("/program", larson_program, sizeof(larson_program)));
+    run_scenario(app, "larson, bytecode program", 10);
+    app.post("/program", runaway_program, sizeof(runaway_program));
+    run_scenario(app, "runaway bytecode program", 10);
+    std::printf("Program instruction budget exhaustions: %u\n",
+                app.tannenbaum.program_budget_exhaustions());
+    app.cmd("/cmd?arrow_down");
+
+    // Fastest pattern speed
+    for (int i = 0; i < 8; ++i) {
+        app.cmd("/cmd?plus");
+    }
+    sim::run_for(2 * us_per_s);
+    run_scenario(app, "arrow_down, fastest speed", 10);
+    for (int i = 0; i < 8; ++i) {
+        app.cmd("/cmd?minus");
+    }
+
+    // Melody playback next to the pattern timer, "on_off" switches to
+    // the static mode and plays the long tune
+    app.cmd("/cmd?on_off");
+    run_scenario(app, "on_off + melody", 20);
+
+    // Frame clock jitter caused by note changes
+    app.cmd("/cmd?larson");
+    sim::run_for(2 * us_per_s);
+    run_scenario(app, "larson", 4);
+    report_frame_clock_jitter();
+    // Control case: Note changes blocking the timer task like the former
+    // delay(10) between notes, at the eighth note rate of scale_melody
+    Ticker blocking_note_changes;
+    blocking_note_changes.attach_ms(eighth_note_ms, [](){delay(10);});
+    run_scenario(app, "larson + blocking note changes", 4);
+    report_frame_clock_jitter();
+    blocking_note_changes.detach();
+    app.tannenbaum.mplayer.play(scale_melody);
+    run_scenario(app, "larson + melody", 4);
+    report_frame_clock_jitter();
+
+    // Pattern stepping with the beats, flashes on the note onsets
+    app.cmd("/cmd?beat");
+    const uint32_t onsets_before = app.tannenbaum.timeline.note_onsets();
+    app.tannenbaum.mplayer.play(scale_melody);
+    run_scenario(app, "larson + melody, beat sync", 4);
+    report_frame_clock_jitter();
+    std::printf("Note onsets flashed: %u\n",
+                app.tannenbaum.timeline.note_onsets() - onsets_before);
+    app.cmd("/cmd?beat");
+
+    // Touch button dispatch, right button cycles through the modes
+    sim::reset_timer_stats();
+    sim::reset_ledc_counters();
+    for (int i = 0; i < 6; ++i) {
+        press_button(Tannenbaum::touch_io_right);
+    }
+    report_timers("touch buttons, 6 presses", 6 * 0.4);
+
+    // HTTP API command dispatch
+    constexpr int n_requests = 1000;
+    const uint64_t allocs_before = sim::heap_alloc_count();
+    int n_ok = 0;
+    for (int i = 0; i < n_requests; ++i) {
+        n_ok += app.cmd(i % 2 ? "/cmd?spin_right" : "/cmd?spin_left") == 204;
+    }
+    std::printf("\n== /cmd dispatch\n%d/%d requests OK, %.1f heap allocations per request\n",
+                n_ok, n_requests,
+                static_cast<double>(sim::heap_alloc_count() - allocs_before) / n_requests);
+
+    // Command lookup and call alone, as done per request parameter
+    const CmdRegistry& registry = app.api_server.cmd_registry;
+    const String cmd_names[] = {"spin_right", "spin_left", "no_such_command"};
+    const String value;
+    constexpr int n_dispatches = 100000;
+    const uint64_t dispatch_allocs_before = sim::heap_alloc_count();
+    const auto t_start = std::chrono::steady_clock::now();
+    int n_found = 0;
+    for (int i = 0; i < n_dispatches; ++i) {
+        const String& name = cmd_names[i % 3];
+        const CbStringT* callback = registry.find(
+            std::string_view{name.c_str(), name.length()});
+        if (callback) {
+            (*callback)(value);
+            ++n_found;
+        }
+    }
+    const auto t_end = std::chrono::steady_clock::now();
+    const uint64_t dispatch_allocs = sim::heap_alloc_count() - dispatch_allocs_before;
+    std::printf("Command registry: %zu commands, %s, %.0f ns per dispatch host, "
+                "%d/%d found, %llu heap allocations: %s\n",
+                registry.size(),
+                registry.has_perfect_hash() ? "perfect hash" : "binary search",
+                std::chrono::duration<double, std::nano>(t_end - t_start).count()
+                / n_dispatches,
+                n_found, n_dispatches,
+                static_cast<unsigned long long>(dispatch_allocs),
+                dispatch_allocs == 0 ? "OK" : "FAILED");
+    ok = ok && dispatch_allocs == 0;
+
+    ok = run_page_cache_checks(app) && ok;
+    ok = run_asset_checks(app) && ok;
+    ok = run_state_checks(app) && ok;
+    ok = run_state_push_checks(app) && ok;
+    ok = run_sse_backpressure_checks(app) && ok;
+    ok = run_websocket_checks(app) && ok;
+
+    std::printf("\nFree heap: %u bytes, peak host heap use: %zu bytes\n",
+                ESP.getFreeHeap(), sim::heap_peak_bytes());
+    return ok;
+}
+
+// Same patterns on the addressable pixel strip backend
+bool run_pixel_scenarios() {
+    bool ok = true;
+    constexpr int i2s_port = 1;
+    {
+        App app{Tannenbaum::PIXEL_OUTPUT};
+        const uint64_t bytes_before = sim::i2s_tx_bytes(i2s_port);
+        run_scenario(app, "larson, pixel output", 10);
+        std::printf("I2S data: %.0f bytes/s\n",
+                    (sim::i2s_tx_bytes(i2s_port) - bytes_before) / 10.0);
+        app.cmd("/cmd?spin_right");
+        run_scenario(app, "spin_right, pixel output", 10);
+    }
+
+    // Strips longer than the LED map: With an effect layer, a frame is
+    // written on every frame clock tick, each one in full.
+    std::printf("\n== Pixel strip length, sparkle layer, one frame per tick\n");
+    for (const uint16_t n_pixels : {uint16_t{led_map::n_leds}, uint16_t{150},
+                                    uint16_t{300}}) {
+        App app{Tannenbaum::PIXEL_OUTPUT, n_pixels};
+        app.cmd("/cmd?sparkle");
+        sim::run_for(us_per_s);
+        const Tannenbaum& tannenbaum = app.tannenbaum;
+        const uint32_t shown_before = tannenbaum.pixel_frames_shown();
+        const uint32_t dropped_before = tannenbaum.pixel_frames_dropped();
+        const uint64_t bytes_before = sim::i2s_tx_bytes(i2s_port);
+        const uint64_t allocs_before = sim::heap_alloc_count();
+        sim::reset_timer_stats();
+        constexpr int seconds = 5;
+        sim::run_for(seconds * us_per_s);
+        const uint32_t shown = tannenbaum.pixel_frames_shown() - shown_before;
+        const uint32_t dropped = tannenbaum.pixel_frames_dropped() - dropped_before;
+        const uint64_t bytes = sim::i2s_tx_bytes(i2s_port) - bytes_before;
+        const uint64_t allocs = sim::heap_alloc_count() - allocs_before;
+        uint64_t host_ns_avg = 0;
+        uint64_t host_ns_max = 0;
+        for (const auto& stats : sim::timer_stats()) {
+            if (std::strcmp(stats.name, "timeline") == 0 && stats.calls > 0) {
+                host_ns_avg = stats.host_ns_sum / stats.calls;
+                host_ns_max = stats.host_ns_max;
+            }
+        }
+        // Four I2S bits per data bit, plus the reset time
+        const uint64_t frame_bytes = 12 * n_pixels + PixelOutput::reset_bytes;
+        const bool strip_ok = shown == seconds * 1000 / Tannenbaum::frame_clock_ms
+            && dropped == 0 && bytes == shown * frame_bytes && allocs == 0;
+        std::printf("%3u pixels: %u frames, %u dropped, %llu I2S bytes/frame, "
+                    "%llu ns/frame avg (%llu max), %llu heap allocations: %s\n",
+                    n_pixels, shown, dropped,
+                    static_cast<unsigned long long>(shown ? bytes / shown : 0),
+                    static_cast<unsigned long long>(host_ns_avg),
+                    static_cast<unsigned long long>(host_ns_max),
+                    static_cast<unsigned long long>(allocs),
+                    strip_ok ? "OK" : "FAILED");
+        ok = ok && strip_ok;
+    }
+
+    // Frames longer than the frame clock: The DMA ring can not take every
+    // frame, but the data stream only ever has whole frames
+    {
+        constexpr uint16_t n_pixels = 600;
+        App app{Tannenbaum::PIXEL_OUTPUT, n_pixels};
+        const Tannenbaum& tannenbaum = app.tannenbaum;
+        const uint64_t bytes_before = sim::i2s_tx_bytes(i2s_port);
+        const uint32_t shown_before = tannenbaum.pixel_frames_shown();
+        app.cmd("/cmd?sparkle");
+        constexpr int seconds = 5;
+        sim::run_for(seconds * us_per_s);
+        // Back to one frame per pattern step, until all is sent
+        app.cmd("/cmd?sparkle");
+        sim::run_for(us_per_s / 2);
+        const uint32_t shown = tannenbaum.pixel_frames_shown() - shown_before;
+        const uint64_t bytes = sim::i2s_tx_bytes(i2s_port) - bytes_before;
+        const uint64_t frame_bytes = 12 * n_pixels + PixelOutput::reset_bytes;
+        const uint32_t frame_time_us = frame_bytes * 8 * us_per_s / PixelOutput::i2s_bit_rate;
+        const bool whole_ok = bytes == shown * frame_bytes
+            && shown <= (seconds * us_per_s + us_per_s / 2) / frame_time_us + 2
+            && tannenbaum.pixel_frames_dropped() > 0;
+        std::printf("%u pixels, %u us per frame: %u frames sent, %u dropped, "
+                    "%llu I2S bytes = whole frames: %s\n",
+                    n_pixels, frame_time_us, shown, tannenbaum.pixel_frames_dropped(),
+                    static_cast<unsigned long long>(bytes), whole_ok ? "OK" : "FAILED");
+        ok = ok && whole_ok;
+    }
+    return ok;
+}
+
+// Write 16-bit mono PCM data as a WAV file
+bool write_wav(const char* path, const sim::CaptureT& pcm, uint32_t sample_rate) {
+    FILE* file = std::fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+    const auto put_u16 = [file](uint16_t value) {
+        std::fputc(value & 0xFF, file);
+        std::fputc(value >> 8, file);
+    };
+    const auto put_u32 = [put_u16](uint32_t value) {
+        put_u16(value & 0xFFFF);
+        put_u16(value >> 16);
+    };
+    const uint32_t data_size = pcm.size();
+    std::fputs("RIFF", file);
+    put_u32(36 + data_size);
+    std::fputs("WAVEfmt ", file);
+    put_u32(16);
+    put_u16(1); // PCM
+    put_u16(1); // Mono
+    put_u32(sample_rate);
+    put_u32(2 * sample_rate);
+    put_u16(2);
+    put_u16(16);
+    std::fputs("data", file);
+    put_u32(data_size);
+    std::fwrite(pcm.data(), 1, pcm.size(), file);
+    return std::fclose(file) == 0;
+}
+
+// Note onsets are published when the note is heard. Compares them with
+// the attacks in the synthesizer output, detected as a peak rising to 1.5
+// times the peak of the previous window. Returns false when a check fails.
+bool run_onset_checks(App& app) {
+    constexpr int i2s_port = 0;
+    constexpr size_t window = 64;
+    constexpr int32_t attack_min_peak = 1000;
+    // Shortest time between two attacks, the attack ramp spans windows
+    constexpr uint64_t attack_holdoff_us = 40000;
+    std::printf("\n== Note onsets against the audio output\n");
+    sim::i2s_reset_capture(i2s_port);
+    std::vector<uint64_t> note_on_times;
+    std::vector<uint64_t> onset_times;
+    uint32_t onsets_seen = app.tannenbaum.timeline.note_onsets();
+    const uint64_t start_us = sim::now_us();
+    app.tannenbaum.mplayer.play(scale_melody);
+    for (uint64_t t_us = 0; t_us < 5 * us_per_s; t_us += 1000) {
+        sim::run_for(1000);
+        for (; onsets_seen != app.tannenbaum.timeline.note_onsets(); ++onsets_seen) {
+            onset_times.push_back(sim::now_us());
+        }
+    }
+    // All notes of the scale are audible eighth notes
+    for (size_t i = 0; i < onset_times.size(); ++i) {
+        note_on_times.push_back(start_us + i * eighth_note_ms * 1000);
+    }
+    const sim::CaptureT& capture = sim::i2s_capture(i2s_port);
+    const auto* samples = reinterpret_cast<const int16_t*>(capture.data());
+    std::vector<uint64_t> attack_times;
+    int32_t last_peak = 0;
+    for (size_t start = 0; start + window <= capture.size() / 2; start += window) {
+        int32_t peak = 0;
+        for (size_t i = start; i < start + window; ++i) {
+            peak = std::max<int32_t>(peak, std::abs(samples[i]));
+        }
+        const uint64_t t_us = sim::i2s_capture_play_us(i2s_port, 2 * start);
+        if (peak > attack_min_peak && 2 * peak > 3 * last_peak
+                && (attack_times.empty()
+                    || t_us - attack_times.back() >= attack_holdoff_us)) {
+            attack_times.push_back(t_us);
+        }
+        last_peak = peak;
+    }
+    // Lead of the flash (onset) and of the note_on against the sound
+    const size_t n = std::min(attack_times.size(), onset_times.size());
+    int64_t onset_lag_max = 0;
+    int64_t onset_lag_sum = 0;
+    int64_t note_on_lag_sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const int64_t onset_lag = static_cast<int64_t>(attack_times[i] - onset_times[i]);
+        onset_lag_max = std::max(onset_lag_max, std::abs(onset_lag));
+        onset_lag_sum += onset_lag;
+        note_on_lag_sum += static_cast<int64_t>(attack_times[i] - note_on_times[i]);
+    }
+    // Onsets are sampled every millisecond, attacks per window
+    const int64_t lag_limit_us = 1000 + window * 1000000 / Synth::sample_rate;
+    const bool onsets_ok = n > 0 && attack_times.size() == onset_times.size()
+                           && onset_lag_max <= lag_limit_us;
+    std::printf("Notes: %zu onsets, %zu attacks heard\n",
+                onset_times.size(), attack_times.size());
+    std::printf("Sound after note_on: %lld us avg\n",
+                static_cast<long long>(n ? note_on_lag_sum / static_cast<int64_t>(n) : 0));
+    std::printf("Sound after onset: %lld us avg, %lld us max (limit %lld): %s\n",
+                static_cast<long long>(n ? onset_lag_sum / static_cast<int64_t>(n) : 0),
+                static_cast<long long>(onset_lag_max),
+                static_cast<long long>(lag_limit_us), onsets_ok ? "OK" : "FAILED");
+    return onsets_ok;
+}
+
+// Background tune and UI sounds mixed by the synthesizer.
+// Returns false when a check fails.
+// Melody requests from the network task, see run_player_task_checks()
+struct PlayerTask {
+    App* app;
+    int n_requests;
+    uint32_t request_interval_ms;
+    // Note onsets before the last melody
+    uint32_t onsets_before_last;
+};
+
+void play_from_task(PlayerTask* task) {
+    MelodyPlayer& player = task->app->tannenbaum.mplayer;
+    for (int i = 0; i < task->n_requests; ++i) {
+        if (i % 3 == 2) {
+            player.play_file((String(upload_dir) + "scales.rtttl").c_str());
+        } else {
+            player.play(scale_melody);
+        }
+        vTaskDelay(pdMS_TO_TICKS(task->request_interval_ms));
+    }
+    // A short melody ends the interrupted ones, then the scale plays
+    player.play(MELODY(C, E, G));
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    task->onsets_before_last = task->app->tannenbaum.timeline.note_onsets();
+    player.play(scale_melody);
+    vTaskDelete(nullptr);
+}
+
+// Melodies started from another task than the timeline, like by /cmd in
+// the async_tcp task. Only the timeline task may touch the timeline.
+bool run_player_task_checks(App& app) {
+    constexpr uint32_t scale_onsets = 27;
+    PlayerTask task{&app, 60, 37, 0};
+    const uint64_t outside_calls_before = sim::timer_calls_outside_timers("timeline");
+    TaskHandle_t handle = nullptr;
+    xTaskCreatePinnedToCore(reinterpret_cast<TaskFunction_t>(play_from_task),
+                            "player_requests", 4096, &task, 1, &handle, 0);
+    sim::run_for(task.n_requests * task.request_interval_ms * 1000 + 6 * us_per_s);
+    const uint64_t outside_calls =
+        sim::timer_calls_outside_timers("timeline") - outside_calls_before;
+    const uint32_t onsets = app.tannenbaum.timeline.note_onsets() - task.onsets_before_last;
+    const bool task_ok = outside_calls == 0 && onsets == scale_onsets;
+    std::printf("\n== Melody requests from another task\n"
+                "%d requests: timeline timer calls outside the timer task: %llu, "
+                "last melody %u of %u onsets: %s\n",
+                task.n_requests, static_cast<unsigned long long>(outside_calls),
+                onsets, scale_onsets, task_ok ? "OK" : "FAILED");
+    return task_ok;
+}
+
+bool run_audio_scenarios(const char* wav_path) {
+    bool ok = true;
+    App app;
+    constexpr int i2s_port = 0;
+    const Synth& synth = app.tannenbaum.synth;
+    sim::i2s_reset_capture(i2s_port);
+    // Switches the LEDs on, which plays the tune and a UI sound on top
+    app.cmd("/cmd?on_off");
+    sim::run_for(3 * us_per_s);
+    app.cmd("/cmd?plus");
+    run_scenario(app, "on_off tune + UI sounds", 30);
+    std::printf("Synth pitch table: %.6f cents max error\n",
+                Synth::max_pitch_error_cents());
+    std::printf("Synth: %u blocks rendered, render time %u us avg, %u us max\n",
+                synth.blocks_rendered(), synth.render_time_us_avg(),
+                synth.render_time_us_max());
+    // Refill timer stops when all voices are released
+    run_scenario(app, "audio idle", 5);
+    if (wav_path) {
+        const bool ok = write_wav(wav_path, sim::i2s_capture(i2s_port),
+                                  Synth::sample_rate);
+        std::printf("WAV output %s: %s\n", wav_path, ok ? "written" : "FAILED");
+    }
+
+    ok = run_onset_checks(app) && ok;
+
+    // Long RTTTL song streamed from SPIFFS, RAM use must not depend on
+    // the song length
+    String song{"Scales:d=32,o=5,b=240:"};
+    const char* notes[] = {"c", "d", "e", "f", "g", "a", "b", "c6", "8p", "4a#4."};
+    constexpr int n_notes = 3000;
+    for (int i = 0; i < n_notes; ++i) {
+        song += notes[i % 10];
+        song += i + 1 < n_notes ? ", " : "\n";
+    }
+    // General uploads are off by default, melody files have their own
+    // endpoint, which only takes melody files
+    const int upload_code = app.upload(upload_endpoint, "scales.rtttl", song);
+    const int other_code = app.upload(melody_upload_endpoint, "scales.txt", song);
+    const int melody_code = app.upload(melody_upload_endpoint, "scales.rtttl", song);
+    const bool upload_ok = upload_code == (file_uploads_activated ? 200 : 404)
+                           && other_code == 500 && melody_code == 200;
+    std::printf("\n== Melody file (%u bytes), upload endpoint: %d, "
+                "other file: %d, melody endpoint: %d: %s\n",
+                song.length(), upload_code, other_code, melody_code,
+                upload_ok ? "OK" : "FAILED");
+    ok = ok && upload_ok;
+    constexpr size_t stream_heap_limit = 1024;
+    // Request handling itself is not counted, only what stays allocated
+    const size_t heap_before = sim::heap_live_bytes();
+    const uint64_t timer_reads_before = sim::fs_reads_in_timers();
+    const uint32_t song_onsets_before = app.tannenbaum.timeline.note_onsets();
+    app.cmd("/cmd?play=scales.rtttl");
+    sim::reset_heap_peak();
+    sim::run_for(240 * us_per_s);
+    // Every tenth note is a pause
+    const uint32_t song_onsets =
+        app.tannenbaum.timeline.note_onsets() - song_onsets_before;
+    std::printf("Uploaded song played: %u of %d notes: %s\n",
+                song_onsets, n_notes / 10 * 9,
+                song_onsets == n_notes / 10 * 9 ? "OK" : "FAILED");
+    ok = ok && song_onsets == n_notes / 10 * 9;
+    const size_t heap_growth = sim::heap_peak_bytes() - heap_before;
+    std::printf("Peak heap growth while streaming: %zu bytes (limit %zu): %s\n",
+                heap_growth, stream_heap_limit,
+                heap_growth <= stream_heap_limit ? "OK" : "FAILED");
+    ok = ok && heap_growth <= stream_heap_limit;
+    // The prefetch task reads the file, the timeline only parses
+    const uint64_t timer_reads = sim::fs_reads_in_timers() - timer_reads_before;
+    const uint32_t underruns = app.tannenbaum.mplayer.file_underruns();
+    std::printf("File reads in timer callbacks: %llu, prefetch underruns: %u: %s\n",
+                static_cast<unsigned long long>(timer_reads), underruns,
+                timer_reads == 0 && underruns == 0 ? "OK" : "FAILED");
+    ok = ok && timer_reads == 0 && underruns == 0;
+    ok = run_player_task_checks(app) && ok;
+
+    // Block render cost on the host, both voices sounding
+    Synth offline_synth{Tannenbaum::audio_gpio};
+    offline_synth.note_on(Tannenbaum::tune_voice, 4 * 12);
+    offline_synth.note_on(Tannenbaum::effects_voice, 5 * 12 + 7);
+    int16_t block[Synth::block_size];
+    constexpr int n_blocks = 10000;
+    const auto t_start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n_blocks; ++i) {
+        offline_synth.render_block(block);
+    }
+    const auto t_end = std::chrono::steady_clock::now();
+    std::printf("\n== Synth block render, %u voices, %u samples: %.0f ns host\n",
+                Synth::n_voices, static_cast<unsigned>(Synth::block_size),
+                std::chrono::duration<double, std::nano>(t_end - t_start).count()
+                / n_blocks);
+    return ok;
+}
+
+// 16-bit mono PCM from a WAV file, or raw PCM at the analyzer sample rate
+bool read_pcm(const char* path, std::vector<int16_t>& pcm, uint32_t& sample_rate) {
+    FILE* file = std::fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    size_t n_read;
+    while ((n_read = std::fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.insert(data.end(), chunk, chunk + n_read);
+    }
+    std::fclose(file);
+    const auto get_u16 = [&data](size_t pos) -> uint32_t {
+        return data[pos] | data[pos + 1] << 8;
+    };
+    const auto get_u32 = [get_u16](size_t pos) -> uint32_t {
+        return get_u16(pos) | get_u16(pos + 2) << 16;
+    };
+    size_t begin = 0;
+    size_t end = data.size();
+    sample_rate = AudioAnalyzer::sample_rate;
+    if (data.size() >= 12 && std::memcmp(data.data(), "RIFF", 4) == 0
+            && std::memcmp(data.data() + 8, "WAVE", 4) == 0) {
+        bool format_ok = false;
+        end = 0;
+        for (size_t pos = 12; pos + 8 <= data.size(); pos += 8 + get_u32(pos + 4)) {
+            const uint32_t chunk_size = get_u32(pos + 4);
+            if (std::memcmp(data.data() + pos, "fmt ", 4) == 0 && chunk_size >= 16) {
+                format_ok = get_u16(pos + 8) == 1 && get_u16(pos + 10) == 1
+                            && get_u16(pos + 22) == 16;
+                sample_rate = get_u32(pos + 12);
+            } else if (std::memcmp(data.data() + pos, "data", 4) == 0) {
+                begin = pos + 8;
+                end = std::min<size_t>(data.size(), begin + chunk_size);
+                break;
+            }
+        }
+        if (!format_ok || end == 0) {
+            return false;
+        }
+    }
+    pcm.resize((end - begin) / 2);
+    std::memcpy(pcm.data(), data.data() + begin, pcm.size() * 2);
+    return true;
+}
+
+// Audio-reactive mode: FFT accuracy and throughput on the host, and the
+// delay from a sound at the microphone to the LEDs on the virtual clock.
+// Returns false when a check fails.
+bool run_audio_input_scenarios(const char* pcm_path) {
+    bool ok = true;
+
+    // Fixed-point FFT against a floating-point DFT of the same input
+    int16_t samples[fft::size];
+    for (size_t i = 0; i < fft::size; ++i) {
+        samples[i] = static_cast<int16_t>(
+            12000 * std::sin(2 * M_PI * 5 * i / fft::size)
+            + 6000 * std::cos(2 * M_PI * 37.3 * i / fft::size)
+            + (static_cast<int>(i * 7919 % 2001) - 1000));
+    }
+    fft::Complex spectrum[fft::size];
+    fft::window(samples, spectrum);
+    std::vector<double> windowed_re(fft::size);
+    for (size_t i = 0; i < fft::size; ++i) {
+        windowed_re[i] = spectrum[i].re;
+    }
+    fft::forward(spectrum);
+    double error_max = 0;
+    for (size_t k = 0; k < fft::size; ++k) {
+        double re = 0;
+        double im = 0;
+        for (size_t i = 0; i < fft::size; ++i) {
+            re += windowed_re[i] * std::cos(2 * M_PI * k * i / fft::size);
+            im -= windowed_re[i] * std::sin(2 * M_PI * k * i / fft::size);
+        }
+        error_max = std::max(error_max, std::hypot(spectrum[k].re - re / fft::size,
+                                                   spectrum[k].im - im / fft::size));
+    }
+    constexpr double fft_error_limit = 4;
+    std::printf("\n== FFT %u points, Q15: %.2f LSB max error (limit %.0f): %s\n",
+                static_cast<unsigned>(fft::size), error_max, fft_error_limit,
+                error_max <= fft_error_limit ? "OK" : "FAILED");
+    ok = ok && error_max <= fft_error_limit;
+
+    // Microphone input: Recording, or one second of silence followed by
+    // synthesizer notes, the first one is A4 (band 2)
+    std::vector<int16_t> pcm;
+    uint32_t pcm_rate = AudioAnalyzer::sample_rate;
+    uint64_t onset_us = 0;
+    if (pcm_path) {
+        if (!read_pcm(pcm_path, pcm, pcm_rate)) {
+            std::printf("PCM input %s: FAILED\n", pcm_path);
+            return false;
+        }
+    } else {
+        Synth test_synth{Tannenbaum::audio_gpio};
+        test_synth.set_voice(0, Synth::SINE, Synth::Envelope{5, 50, UINT16_MAX / 2, 50}, 255);
+        pcm.resize(Synth::sample_rate);
+        onset_us = us_per_s;
+        const uint8_t pitches[] = {4 * 12 + 9, 2 * 12 + 9, 6 * 12 + 9, 3 * 12 + 4};
+        int16_t block[Synth::block_size];
+        for (int n = 0; n < 8; ++n) {
+            test_synth.note_on(0, pitches[n % 4]);
+            for (size_t i = 0; i < Synth::sample_rate / 4; i += Synth::block_size) {
+                test_synth.render_block(block);
+                pcm.insert(pcm.end(), block, block + Synth::block_size);
+            }
+        }
+    }
+    const double pcm_seconds = static_cast<double>(pcm.size()) / pcm_rate;
+
+    // Host throughput of the DSP, FFT alone and complete block analysis
+    AudioAnalyzer offline_analyzer{Tannenbaum::audio_adc_channel};
+    const size_t n_pcm_blocks = pcm.size() / AudioAnalyzer::block_size;
+    constexpr int n_ffts = 20000;
+    auto t_start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n_ffts; ++i) {
+        fft::forward(spectrum);
+    }
+    auto t_end = std::chrono::steady_clock::now();
+    const double fft_s = std::chrono::duration<double>(t_end - t_start).count() / n_ffts;
+    t_start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n_pcm_blocks; ++i) {
+        offline_analyzer.analyze(&pcm[i * AudioAnalyzer::block_size], 0);
+    }
+    t_end = std::chrono::steady_clock::now();
+    const double analyze_s = std::chrono::duration<double>(t_end - t_start).count()
+                             / (n_pcm_blocks ? n_pcm_blocks : 1);
+    std::printf("FFT: %.0f ns host, %.0f FFTs/s; block analysis: %.0f ns host, "
+                "%.0f blocks/s (%.0f needed for real time)\n",
+                fft_s * 1e9, 1 / fft_s, analyze_s * 1e9, 1 / analyze_s,
+                static_cast<double>(AudioAnalyzer::sample_rate) / AudioAnalyzer::block_size);
+
+    // The same input at the microphone pin in AUDIO mode
+    App app;
+    constexpr int i2s_port = 0;
+    constexpr int adc_gpio = 36;
+    constexpr uint8_t watched_channel = 2;
+    // A slow melody is still playing when AUDIO mode starts
+    app.tannenbaum.mplayer.play(scale_melody, 4 * 64);
+    sim::run_for(us_per_s / 2);
+    sim::adc_set_input(adc_gpio, pcm.data(), pcm.size(), pcm_rate);
+    const uint64_t start_us = sim::now_us();
+    app.cmd("/cmd?audio");
+    if (!pcm_path) {
+        // Poll the LED level of the first note's band
+        sim::run_for(onset_us - us_per_s / 10);
+        const uint32_t duty_before = sim::ledc_channel(watched_channel).duty;
+        uint64_t latency_us = 0;
+        while (sim::now_us() - start_us < onset_us + us_per_s / 2) {
+            sim::run_for(1000);
+            if (sim::ledc_channel(watched_channel).duty != duty_before) {
+                latency_us = sim::now_us() - start_us - onset_us;
+                break;
+            }
+        }
+        constexpr uint64_t latency_limit_us = 50000;
+        std::printf("Sound to LED latency: %.1f ms (limit %.0f ms): %s\n",
+                    latency_us / 1000.0, latency_limit_us / 1000.0,
+                    latency_us > 0 && latency_us <= latency_limit_us ? "OK" : "FAILED");
+        ok = ok && latency_us > 0 && latency_us <= latency_limit_us;
+    }
+    const double remaining_s = std::max(0.0, pcm_seconds - (sim::now_us() - start_us) / 1e6);
+    run_scenario(app, "audio input", remaining_s);
+    const AudioAnalyzer& analyzer = app.tannenbaum.analyzer;
+    std::printf("Audio analyzer: %u blocks, %llu samples lost\n",
+                analyzer.blocks_analyzed(),
+                static_cast<unsigned long long>(sim::i2s_rx_overflows(i2s_port)));
+    ok = ok && sim::i2s_rx_overflows(i2s_port) == 0;
+    // The melody players are muted while the synthesizer is stopped
+    press_button(Tannenbaum::touch_io_middle);
+    const bool muted_ok = !app.tannenbaum.synth.is_active();
+    std::printf("No notes in AUDIO mode: %s\n", muted_ok ? "OK" : "FAILED");
+    ok = ok && muted_ok;
+
+    // Leaving AUDIO mode hands I2S0 back to the synth. The DSP task
+    // finishes its block first.
+    const uint64_t stop_start_us = sim::now_us();
+    app.cmd("/cmd?larson");
+    const uint64_t stop_wait_us = sim::now_us() - stop_start_us;
+    const uint32_t blocks_stopped = analyzer.blocks_analyzed();
+    const uint64_t tx_before = sim::i2s_tx_bytes(i2s_port);
+    app.cmd("/cmd?plus");
+    sim::run_for(us_per_s);
+    const bool stop_ok = stop_wait_us <= AudioAnalyzer::read_timeout_ms * 1000
+                         && analyzer.blocks_analyzed() == blocks_stopped;
+    std::printf("DSP task stop: %llu us wait (limit %u): %s\n",
+                static_cast<unsigned long long>(stop_wait_us),
+                AudioAnalyzer::read_timeout_ms * 1000, stop_ok ? "OK" : "FAILED");
+    const bool synth_back = sim::i2s_tx_bytes(i2s_port) > tx_before;
+    std::printf("Synth output after AUDIO mode: %s\n", synth_back ? "OK" : "FAILED");
+    ok = ok && stop_ok && synth_back;
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool verbose = false;
+    const char* wav_path = nullptr;
+    const char* pcm_path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        } else if (std::strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            wav_path = argv[++i];
+        } else if (std::strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            pcm_path = argv[++i];
+        }
+    }
+    sim::serial_set_quiet(!verbose);
+    bool ok = run_pwm_scenarios();
+    ok = run_pixel_scenarios() && ok;
+    ok = run_audio_scenarios(wav_path) && ok;
+    ok = run_audio_input_scenarios(pcm_path) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,347 @@
+#include <algorithm>
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include "info_debug_error.h"
+#include "synth.hpp"
+
+namespace {
+
+constexpr double pi = 3.14159265358979323846;
+
+// Sine for -pi...pi, Taylor series after folding into -pi/2...pi/2
+constexpr double sine(double x) {
+    if (x > pi / 2) {
+        x = pi - x;
+    } else if (x < -pi / 2) {
+        x = -pi - x;
+    }
+    const double x2 = x * x;
+    return x * (1 - x2 / 6 * (1 - x2 / 20 * (1 - x2 / 42 * (1 - x2 / 72
+               * (1 - x2 / 110)))));
+}
+
+// One period of a waveform, full scale
+struct Wavetable
+{
+    int16_t samples[Synth::wavetable_size];
+
+    constexpr Wavetable(const enum Synth::WAVEFORMS waveform) : samples{} {
+        for (size_t i = 0; i < Synth::wavetable_size; ++i) {
+            // Position in the period, 0...1
+            const double p = static_cast<double>(i) / Synth::wavetable_size;
+            double value = 0;
+            switch (waveform) {
+                case Synth::SINE:
+                    value = sine(p < 0.5 ? 2 * pi * p : 2 * pi * (p - 1));
+                    break;
+                case Synth::TRIANGLE:
+                    value = p < 0.25 ? 4 * p : p < 0.75 ? 2 - 4 * p : 4 * p - 4;
+                    break;
+                case Synth::SQUARE:
+                    value = p < 0.5 ? 1 : -1;
+                    break;
+            }
+            value *= INT16_MAX;
+            samples[i] = static_cast<int16_t>(value < 0 ? value - 0.5 : value + 0.5);
+        }
+    }
+};
+
+// Same order as Synth::WAVEFORMS
+constexpr Wavetable wavetables[] = {
+    Wavetable{Synth::SINE}, Wavetable{Synth::TRIANGLE}, Wavetable{Synth::SQUARE}};
+
+// Phase increment per sample for every note of octaves 0...8, equal
+// temperament with A4 = 440 Hz. Also holds the worst-case pitch error
+// from rounding the increments to integers.
+struct PitchTable
+{
+    uint32_t increments[Synth::n_pitches];
+    double max_error_cents;
+
+    constexpr PitchTable() : increments{}, max_error_cents{0} {
+        constexpr double semitone_ratio = 1.05946309435929526456;
+        constexpr double a4_hz = 440.0;
+        constexpr uint8_t a4_pitch = 4 * 12 + 9;
+        constexpr double phase_range = 4294967296.0;
+        // C0, counting up from there
+        double hz = a4_hz;
+        for (int i = 0; i < a4_pitch; ++i) {
+            hz /= semitone_ratio;
+        }
+        for (uint8_t pitch = 0; pitch < Synth::n_pitches; ++pitch) {
+            const double exact = hz * phase_range / Synth::sample_rate;
+            increments[pitch] = static_cast<uint32_t>(exact + 0.5);
+            // 1200 / ln(2) cents per unit of relative error (small errors)
+            double error = (increments[pitch] - exact) / exact * 1731.234;
+            error = error < 0 ? -error : error;
+            max_error_cents = error > max_error_cents ? error : max_error_cents;
+            hz *= semitone_ratio;
+        }
+    }
+};
+
+constexpr PitchTable pitch_table{};
+static_assert(pitch_table.max_error_cents < 0.001, "Pitch table not exact");
+// B8 is the highest note below the Nyquist frequency
+static_assert(pitch_table.increments[Synth::n_pitches - 1] < (1UL << 31),
+              "Notes above half the sample rate");
+
+constexpr Synth::Envelope default_envelope{5, 50, UINT16_MAX / 2, 50};
+
+} // namespace
+
+Synth::Synth(uint8_t gpio, i2s_port_t i2s_port)
+    : gpio{gpio}
+    , i2s_port{i2s_port}
+    , voices{}
+    , mix{}
+    , block{}
+    , refill_timer{}
+{
+    for (uint8_t voice = 0; voice < n_voices; ++voice) {
+        set_voice(voice, SINE, default_envelope, 256 / n_voices);
+    }
+}
+
+Synth::~Synth() {
+    refill_timer.detach();
+    if (is_started) {
+        i2s_driver_uninstall(i2s_port);
+    }
+}
+
+// PDM output is only available on I2S0
+bool Synth::begin() {
+    std::lock_guard<std::mutex> lock{output_lock};
+    i2s_config_t i2s_config{};
+    i2s_config.mode = static_cast<i2s_mode_t>(
+        I2S_MODE_MASTER | I2S_MODE_TX | I2S_MODE_PDM);
+    i2s_config.sample_rate = sample_rate;
+    i2s_config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+    i2s_config.channel_format = I2S_CHANNEL_FMT_ONLY_LEFT;
+    i2s_config.communication_format = I2S_COMM_FORMAT_I2S;
+    i2s_config.dma_buf_count = dma_buf_count;
+    i2s_config.dma_buf_len = block_size;
+    // Output is silent when no block is queued
+    i2s_config.tx_desc_auto_clear = true;
+    if (i2s_driver_install(i2s_port, &i2s_config, 0, nullptr) != ESP_OK) {
+        error_print("Synth: I2S driver install failed");
+        return false;
+    }
+    i2s_pin_config_t pin_config{};
+    pin_config.bck_io_num = I2S_PIN_NO_CHANGE;
+    pin_config.ws_io_num = I2S_PIN_NO_CHANGE;
+    pin_config.data_out_num = gpio;
+    pin_config.data_in_num = I2S_PIN_NO_CHANGE;
+    i2s_set_pin(i2s_port, &pin_config);
+    is_started = true;
+    debug_print("Synth output started");
+    // Notes started while the output was stopped
+    if (is_active()) {
+        is_refilling = true;
+        refill_timer.attach_ms(refill_interval_ms, on_refill_timer, this);
+    }
+    return true;
+}
+
+void Synth::end() {
+    std::lock_guard<std::mutex> lock{output_lock};
+    refill_timer.detach();
+    is_refilling = false;
+    for (Voice& voice : voices) {
+        voice.stage = IDLE;
+        voice.level = 0;
+    }
+    block_bytes_pending = 0;
+    if (is_started) {
+        i2s_driver_uninstall(i2s_port);
+        is_started = false;
+        debug_print("Synth output stopped");
+    }
+}
+
+void Synth::set_voice(uint8_t voice, enum WAVEFORMS waveform,
+                      const Envelope& envelope, uint8_t volume) {
+    if (voice >= n_voices) {
+        return;
+    }
+    voices[voice].waveform = waveform;
+    voices[voice].envelope = envelope;
+    voices[voice].volume = volume;
+}
+
+void Synth::note_on(uint8_t voice, uint8_t pitch) {
+    if (voice >= n_voices || pitch >= n_pitches) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock{output_lock};
+    // Phase and level are kept, so a new note starts without a click
+    voices[voice].phase_increment = pitch_table.increments[pitch];
+    voices[voice].stage = ATTACK;
+    if (is_started && !is_refilling) {
+        is_refilling = true;
+        refill_timer.attach_ms(refill_interval_ms, on_refill_timer, this);
+    }
+}
+
+void Synth::note_off(uint8_t voice) {
+    if (voice >= n_voices) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock{output_lock};
+    if (voices[voice].stage == IDLE) {
+        return;
+    }
+    voices[voice].stage = RELEASE;
+}
+
+bool Synth::is_active() const {
+    return std::any_of(voices, voices + n_voices, [](const Voice& voice) {
+        return voice.stage != IDLE;
+    });
+}
+
+// Without the refill timer, the note is rendered on its first event
+uint32_t Synth::output_latency_us() const {
+    const int64_t now_us = esp_timer_get_time();
+    const int64_t render_us = is_refilling ? now_us
+                                           : now_us + refill_interval_ms * 1000;
+    return std::max(queued_until_us, render_us) + bytes_to_us(block_bytes_pending)
+           - now_us;
+}
+
+void Synth::render_block(int16_t* out) {
+    const unsigned long start_us = micros();
+    std::fill(mix, mix + block_size, 0);
+    for (Voice& voice : voices) {
+        if (voice.stage == IDLE) {
+            continue;
+        }
+        const int16_t* table = wavetables[voice.waveform].samples;
+        // Gain ramps from the last envelope level to the new one, Q16
+        const int32_t gain_start = voice.level * voice.volume >> 8;
+        const int32_t gain_end = next_level(voice) * voice.volume >> 8;
+        const int32_t gain_step = (gain_end - gain_start)
+                                  / static_cast<int32_t>(block_size);
+        int32_t gain = gain_start;
+        uint32_t phase = voice.phase;
+        const uint32_t phase_increment = voice.phase_increment;
+        for (size_t i = 0; i < block_size; ++i) {
+            mix[i] += table[phase >> (32 - wavetable_bits)] * gain >> 16;
+            phase += phase_increment;
+            gain += gain_step;
+        }
+        voice.phase = phase;
+    }
+    for (size_t i = 0; i < block_size; ++i) {
+        out[i] = static_cast<int16_t>(
+            std::min<int32_t>(INT16_MAX, std::max<int32_t>(INT16_MIN, mix[i])));
+    }
+    const unsigned long render_us = micros() - start_us;
+    render_us_max = std::max<uint32_t>(render_us_max, render_us);
+    render_us_sum += render_us;
+    ++n_blocks;
+}
+
+double Synth::max_pitch_error_cents() {
+    return pitch_table.max_error_cents;
+}
+
+uint32_t Synth::blocks_rendered() const {
+    return n_blocks;
+}
+
+uint32_t Synth::render_time_us_max() const {
+    return render_us_max;
+}
+
+uint32_t Synth::render_time_us_avg() const {
+    return n_blocks ? render_us_sum / n_blocks : 0;
+}
+
+///////////// private
+
+// Queue blocks until the DMA ring is full. A block which does not fit
+// completely is finished on the next timer event.
+void Synth::refill() {
+    for (;;) {
+        if (block_bytes_pending == 0) {
+            if (!is_active()) {
+                // The DMA sends silence once the queued blocks are done
+                refill_timer.detach();
+                is_refilling = false;
+                return;
+            }
+            render_block(block);
+            block_bytes_pending = sizeof(block);
+        }
+        const auto* data = reinterpret_cast<const uint8_t*>(block)
+                           + sizeof(block) - block_bytes_pending;
+        size_t bytes_written = 0;
+        i2s_write(i2s_port, data, block_bytes_pending, &bytes_written, 0);
+        block_bytes_pending -= bytes_written;
+        // The DMA plays the ring without gaps while it is refilled
+        queued_until_us = std::max(queued_until_us, esp_timer_get_time())
+                          + bytes_to_us(bytes_written);
+        if (block_bytes_pending > 0) {
+            return;
+        }
+    }
+}
+
+int64_t Synth::bytes_to_us(size_t n_bytes) {
+    return static_cast<int64_t>(n_bytes) * 1000000 / (sizeof(int16_t) * sample_rate);
+}
+
+int32_t Synth::next_level(Voice& voice) {
+    // Level change per block for a full range ramp of ramp_ms
+    const auto step = [](const uint16_t ramp_ms) -> int32_t {
+        return ramp_ms > 0
+               ? int64_t{level_max} * block_size * 1000 / (int64_t{sample_rate} * ramp_ms)
+               : level_max;
+    };
+    const int32_t sustain = voice.envelope.sustain;
+    int32_t level = voice.level;
+    switch (voice.stage) {
+        case ATTACK:
+            level += step(voice.envelope.attack_ms);
+            if (level >= level_max) {
+                level = level_max;
+                voice.stage = DECAY;
+            }
+            break;
+        case DECAY:
+            level -= step(voice.envelope.decay_ms);
+            if (level <= sustain) {
+                level = sustain;
+                voice.stage = SUSTAIN;
+            }
+            break;
+        case SUSTAIN:
+            level = sustain;
+            break;
+        case RELEASE:
+            level -= step(voice.envelope.release_ms);
+            if (level <= 0) {
+                level = 0;
+                voice.stage = IDLE;
+            }
+            break;
+        case IDLE:
+            level = 0;
+            break;
+    }
+    voice.level = level;
+    return level;
+}
+
+// A refill due while end() runs finds the output stopped
+void Synth::on_refill_timer(Synth* self) {
+    std::lock_guard<std::mutex> lock{self->output_lock};
+    if (self->is_started) {
+        self->refill();
+    }
+}
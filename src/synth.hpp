@@ -0,0 +1,137 @@
+/* Wavetable synthesizer with I2S DMA output
+ *
+ * A small number of voices are mixed in fixed-point arithmetic, each
+ * voice playing a wavetable under an ADSR envelope. Audio is rendered in
+ * blocks of block_size samples. The envelopes are evaluated once per
+ * block and ramped linearly over the block samples, so the cost of a
+ * block is fixed by the number of voices.
+ *
+ * Blocks are queued into the DMA ring of the I2S peripheral by a refill
+ * timer, which runs only while a voice is sounding. The ESP32 has the
+ * built-in DAC on GPIO 25/26 only, which are used for LEDs on this tree,
+ * so the I2S0 PDM modulator drives the audio pin instead. A PDM stream
+ * needs no more than the RC low-pass of the speaker circuit as a DAC.
+ */
+#ifndef SYNTH_HPP__
+#define SYNTH_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <driver/i2s.h>
+#include <Ticker.h>
+
+class Synth
+{
+public:
+    // Output sample rate, mono 16-bit
+    static constexpr int sample_rate = 16000;
+    // Samples per block; envelopes are updated once per block
+    static constexpr size_t block_size = 128;
+    // DMA ring size in blocks (32 ms of audio)
+    static constexpr int dma_buf_count = 4;
+    // Refill timer period, one block
+    static constexpr uint32_t refill_interval_ms = block_size * 1000 / sample_rate;
+    static constexpr uint8_t n_voices = 2;
+    // Wavetable length, phase accumulator top bits index the table
+    static constexpr size_t wavetable_bits = 8;
+    static constexpr size_t wavetable_size = 1 << wavetable_bits;
+    // Notes C0...B8
+    static constexpr uint8_t n_pitches = 9 * 12;
+
+    enum WAVEFORMS{SINE, TRIANGLE, SQUARE};
+
+    // ADSR envelope. Attack, decay and release times are for the full
+    // range, sustain is the level held after decay, 0...UINT16_MAX
+    struct Envelope
+    {
+        uint16_t attack_ms;
+        uint16_t decay_ms;
+        uint16_t sustain;
+        uint16_t release_ms;
+    };
+
+    Synth(uint8_t gpio, i2s_port_t i2s_port = I2S_NUM_0);
+    virtual ~Synth();
+
+    // Install the I2S driver in PDM mode
+    bool begin();
+    // Silence all voices and release the I2S peripheral. Waits for a
+    // running refill, so it can be called from another task.
+    void end();
+
+    // volume: 0...255, the sum of all voice volumes should not exceed 256
+    void set_voice(uint8_t voice, enum WAVEFORMS waveform,
+                   const Envelope& envelope, uint8_t volume);
+    // pitch: Semitones above C in octave 0, see NoteEvent
+    void note_on(uint8_t voice, uint8_t pitch);
+    void note_off(uint8_t voice);
+    // True while any voice is sounding, including the release phase
+    bool is_active() const;
+    // Time from now until a note started now is heard. The audio queued
+    // in the DMA ring and the pending block are played before it.
+    uint32_t output_latency_us() const;
+
+    // Render the next block of block_size samples with all voices mixed.
+    // Used by the DMA refill, and for offline rendering on the host.
+    void render_block(int16_t* out);
+
+    // Worst-case deviation of a note from equal temperament
+    static double max_pitch_error_cents();
+
+    // Statistics
+    uint32_t blocks_rendered() const;
+    uint32_t render_time_us_max() const;
+    uint32_t render_time_us_avg() const;
+
+private:
+    enum ENVELOPE_STAGES{IDLE, ATTACK, DECAY, SUSTAIN, RELEASE};
+    // Envelope level range, Q16
+    static constexpr int32_t level_max = 1 << 16;
+
+    struct Voice
+    {
+        enum WAVEFORMS waveform;
+        Envelope envelope;
+        uint8_t volume;
+        enum ENVELOPE_STAGES stage;
+        // Wavetable position and advance per sample, full turn is 2^32
+        uint32_t phase;
+        uint32_t phase_increment;
+        // Envelope level at the end of the last block
+        int32_t level;
+    };
+
+    const uint8_t gpio;
+    const i2s_port_t i2s_port;
+
+    // Taken by begin(), end(), the note changes and the refill, which
+    // runs in the esp_timer task
+    std::mutex output_lock;
+    bool is_started = false;
+    bool is_refilling = false;
+    Voice voices[n_voices];
+    // Mix accumulator and output block, the output block is kept until
+    // the DMA ring has taken all of it
+    int32_t mix[block_size];
+    int16_t block[block_size];
+    size_t block_bytes_pending = 0;
+    // End of the audio queued in the DMA ring, esp_timer clock
+    int64_t queued_until_us = 0;
+    // Refill timer, runs only while a voice is sounding
+    Ticker refill_timer;
+
+    uint32_t n_blocks = 0;
+    uint32_t render_us_max = 0;
+    uint64_t render_us_sum = 0;
+
+    void refill();
+    // Play time of output bytes
+    static int64_t bytes_to_us(size_t n_bytes);
+    // Advance the envelope by one block, returns the new level
+    static int32_t next_level(Voice& voice);
+
+    static void on_refill_timer(Synth* self);
+}; // class Synth
+
+#endif
@@ -1,173 +1,458 @@
+#include <algorithm>
+
 #include <Arduino.h>
-#include <Ticker.h>
+#include <driver/ledc.h>
+#include <soc/gpio_sig_map.h>
 
 #include "info_debug_error.h"
+#include "api_server_config.hpp"
 #include "tannenbaum.hpp"
 
-#define NELEMS(x)  (sizeof(x) / sizeof((x)[0]))
+namespace {
+
+// LED frame tables for all modes, generated at compile time
+constexpr uint16_t marker_pattern[] = {
+    Tannenbaum::led_dim, Tannenbaum::led_on, Tannenbaum::led_dim};
+constexpr size_t n_heights = led_map::by_height.n_channels;
+constexpr size_t n_ring = led_map::by_ring.n_channels;
+constexpr size_t n_single = led_map::single.n_channels;
+// The pixel strip is sized on its own, see write_pixels()
+static_assert(n_ring <= Tannenbaum::n_pwm_channels, "Not enough PWM channels");
+static_assert(AudioAnalyzer::n_bands == n_heights, "One audio band per LED level");
+// Scanning over the LED levels from bottom to top and back
+constexpr auto larson_frames =
+    led_patterns::bounce<n_heights>(marker_pattern, Tannenbaum::led_off);
+// Rotating around all LEDs of the tree outline
+constexpr auto spin_right_frames =
+    led_patterns::rotate<n_ring, n_ring>(marker_pattern, Tannenbaum::led_off, true);
+constexpr auto spin_left_frames =
+    led_patterns::rotate<n_ring, n_ring>(marker_pattern, Tannenbaum::led_off, false);
+// Moving over the LED levels, leaving the visible range before wrapping
+constexpr auto arrow_up_frames =
+    led_patterns::rotate<n_heights, n_heights + 3>(marker_pattern, Tannenbaum::led_off, true);
+constexpr auto arrow_down_frames =
+    led_patterns::rotate<n_heights, n_heights + 3>(marker_pattern, Tannenbaum::led_off, false);
+// All LEDs on one channel
+constexpr auto all_on_frames = led_patterns::constant<n_single>(Tannenbaum::led_on);
+constexpr auto all_off_frames = led_patterns::constant<n_single>(Tannenbaum::led_off);
+
+constexpr PatternTable larson_table = larson_frames.table();
+constexpr PatternTable spin_right_table = spin_right_frames.table();
+constexpr PatternTable spin_left_table = spin_left_frames.table();
+constexpr PatternTable arrow_up_table = arrow_up_frames.table();
+constexpr PatternTable arrow_down_table = arrow_down_frames.table();
+constexpr PatternTable all_on_table = all_on_frames.table();
+constexpr PatternTable all_off_table = all_off_frames.table();
+
+// Output mapping from brightness to inverted PWM duty cycle
+constexpr GammaLUT<Tannenbaum::pwm_resolution_bits, true> gamma_lut{};
+// Output mapping from brightness to 8-bit pixel value (0...256)
+constexpr GammaLUT<8, false> pixel_gamma_lut{};
+
+// Names of the operation modes in the state JSON, same as the commands
+constexpr const char* mode_names[] = {
+    "larson", "spin_right", "spin_left", "arrow_up", "arrow_down",
+    "on_off", "program", "audio", "live"};
+static_assert(sizeof(mode_names) / sizeof(*mode_names) == Tannenbaum::n_op_modes,
+              "One name per operation mode");
+
+// Synthesizer voice envelopes: Soft tune, short clicks for UI sounds
+constexpr Synth::Envelope tune_envelope{5, 80, UINT16_MAX / 2, 40};
+constexpr Synth::Envelope effects_envelope{2, 30, UINT16_MAX / 4, 20};
+
+// Start a hardware fade of an Arduino LEDC channel.
+// Channels 0...7 are in the high speed group, 8...15 in the low speed group.
+void start_hw_fade(const uint8_t channel, const uint32_t duty,
+                   const unsigned long fade_ms) {
+    const auto speed_mode = static_cast<ledc_mode_t>(channel / LEDC_CHANNEL_MAX);
+    const auto hw_channel = static_cast<ledc_channel_t>(channel % LEDC_CHANNEL_MAX);
+    ledc_set_fade_with_time(speed_mode, hw_channel, duty, fade_ms);
+    ledc_fade_start(speed_mode, hw_channel, LEDC_FADE_NO_WAIT);
+}
+
+// GPIO matrix output signal of an Arduino LEDC channel
+uint8_t ledc_signal(const uint8_t channel) {
+    return channel < LEDC_CHANNEL_MAX
+           ? LEDC_HS_SIG_OUT0_IDX + channel
+           : LEDC_LS_SIG_OUT0_IDX + channel - LEDC_CHANNEL_MAX;
+}
+
+} // namespace
 
 /////////// public
 
-Tannenbaum::Tannenbaum(APIServer& http_server, enum OP_MODES op_mode)
+Tannenbaum::Tannenbaum(APIServer& http_server, enum OP_MODES op_mode,
+                       enum OUTPUTS output, uint16_t n_pixels)
     // public
-    : mplayer{Tannenbaum::audio_gpio, Tannenbaum::audio_pwm_channel}
+    : timeline{}
+    , synth{Tannenbaum::audio_gpio}
+    , mplayer{synth, Tannenbaum::tune_voice, timeline, true}
+    , effects_player{synth, Tannenbaum::effects_voice, timeline}
+    , analyzer{Tannenbaum::audio_adc_channel}
     // private
     , http_server{http_server}
     , buttons{}
-    , pattern_timer{}
-    , tone_timer{}
+    , output{output}
+    , pixels{Tannenbaum::pixel_gpio, n_pixels}
+    , compositor{Tannenbaum::frame_clock_ms}
+    , vm{}
+    , program_table{vm.frame(), 1, 1}
+    , audio_frame{}
+    , audio_table{audio_frame, 1, AudioAnalyzer::n_bands}
+    , live_frame{}
+    , live_table{live_frame, 1, n_live_channels}
+    , live_mailbox{}
+    , n_live_received{0}
+    , n_live_shown{0}
+    , live_latency_max{0}
+    , live_latency_sum{0}
+    , frame_client{timeline.add_client(on_timer_event, this)}
+    , next_frame_us{0}
+    , beat_sync{false}
+    , onsets_seen{0}
+    , published_bpm{0}
     , op_mode{LARSON}
     , led_state_all_on{false}
-    , pattern_interval{100}
+    , phase_increment{phase_one_frame * frame_clock_ms / 100}
+    , pattern{&larson_table}
+    , pattern_phase{0}
+    , frame_index{0}
+    , frame_pending{true}
+    , routing{nullptr}
+    , pending_routing{&led_map::by_height}
+    , renderers{}
+    , brightness{UINT8_MAX}
+    , dimmed_frame{}
+    , pwm_shadow{}
+    , pwm_force_mask{0}
+    , pwm_writes_saved{0}
+    , pwm_writes_saved_last_s{0}
+    , pwm_stats_start_ms{0}
 {
     debug_print("Configuring Tannenbaum...");
-    init_pwm_gpios();
-    switch (op_mode) {
-        case LARSON: set_mode_larson(); break;
-        case SPIN_RIGHT: set_mode_spinning(true); break;
-        case SPIN_LEFT: set_mode_spinning(false); break;
-        case ARROW_UP: set_mode_arrow(true); break;
-        case ARROW_DOWN: set_mode_arrow(false); break;
-        case ALL_ON_OFF: set_mode_all_on_off(); break;
+    switch (output) {
+        case PWM_OUTPUT: init_pwm_gpios(); break;
+        case PIXEL_OUTPUT: pixels.begin(); break;
     }
+    set_mode(op_mode);
     // Remote control interface
     setup_http_interface();
     // Initial state
     http_server.set_template("ON_OFF_BTN_STATE", "btn_off");
     // Local touch buttons interface
     setup_touch_buttons();
-    // Start timer for LED pattern updading
-    pattern_timer.attach_ms(pattern_interval, on_timer_event, this);
-    // Configure melody player
+    // Start frame clock for LED pattern updating. It also runs on the
+    // note onsets of the tune, for flashing in beat sync mode.
+    next_frame_us = Timeline::now_us() + frame_clock_ms * 1000;
+    timeline.schedule(frame_client, next_frame_us);
+    timeline.set_onset_client(frame_client);
+    // Configure audio output and melody players
+    if (op_mode != AUDIO) {
+        synth.begin();
+    }
+    synth.set_voice(tune_voice, Synth::TRIANGLE, tune_envelope, 160);
+    synth.set_voice(effects_voice, Synth::SQUARE, effects_envelope, 96);
     mplayer.set_tempo(64);
+    effects_player.set_tempo(64);
 }
 
 Tannenbaum::~Tannenbaum() {
-    pattern_timer.detach();
+    timeline.cancel(frame_client);
 }
 
 void Tannenbaum::set_mode_larson() {
     debug_print("New Operation Mode: Scanning Larson");
-    op_mode = LARSON;
-    // Attach GPIO pins to PWM channels
-    ledcAttachPin(32, 0); // Links unten
-    ledcAttachPin(21, 0); // Rechts unten
-    ledcAttachPin(33, 1); // Links
-    ledcAttachPin(19, 1); // Rechts
-    ledcAttachPin(25, 2); // Links
-    ledcAttachPin(18, 2); // Rechts
-    ledcAttachPin(26, 3); // Links
-    ledcAttachPin(17, 3); // Rechts
-    ledcAttachPin(27, 4); // Links oberster
-    ledcAttachPin(16, 4); // Rechts oberster
-    ledcAttachPin(4, 5); // Rechteckige oben
-    ledcAttachPin(14, 6); // Baumkrone rund
+    enter_mode(LARSON);
+    set_pattern(larson_table);
+    set_routing(led_map::by_height);
 }
 
 void Tannenbaum::set_mode_spinning(bool direction) {
     if (direction) { 
         debug_print("New Operation Mode: Spinning right");
-        op_mode = SPIN_RIGHT;
+        enter_mode(SPIN_RIGHT);
+        set_pattern(spin_right_table);
     } else {
         debug_print("New Operation Mode: Spinning left");
-        op_mode = SPIN_LEFT;
+        enter_mode(SPIN_LEFT);
+        set_pattern(spin_left_table);
     }
-    // Attach GPIO pins to PWM channels
-    ledcAttachPin(32, 0); // Links unten
-    ledcAttachPin(33, 1); // Links
-    ledcAttachPin(25, 2); // Links
-    ledcAttachPin(26, 3); // Links
-    ledcAttachPin(27, 4); // Links oberster
-    ledcAttachPin(4, 5); // Rechteckige oben
-    ledcAttachPin(14, 6); // Baumkrone rund
-    ledcAttachPin(16, 7); // Rechts oberster
-    ledcAttachPin(17, 8); // Rechts
-    ledcAttachPin(18, 9); // Rechts
-    ledcAttachPin(19, 10); // Rechts
-    ledcAttachPin(21, 11); // Rechts unten
+    set_routing(led_map::by_ring);
 }
 
 void Tannenbaum::set_mode_arrow(bool direction) {
     if (direction) { 
         debug_print("New Operation Mode: Upwards pointing arrow");
-        op_mode = ARROW_UP;
+        enter_mode(ARROW_UP);
+        set_pattern(arrow_up_table);
     } else {
         debug_print("New Operation Mode: Downwards pointing arrow");
-        op_mode = ARROW_DOWN;
+        enter_mode(ARROW_DOWN);
+        set_pattern(arrow_down_table);
     }
-    // Attach GPIO pins to PWM channels
-    ledcAttachPin(32, 0); // Links unten
-    ledcAttachPin(21, 0); // Rechts unten
-    ledcAttachPin(33, 1); // Links
-    ledcAttachPin(19, 1); // Rechts
-    ledcAttachPin(25, 2); // Links
-    ledcAttachPin(18, 2); // Rechts
-    ledcAttachPin(26, 3); // Links
-    ledcAttachPin(17, 3); // Rechts
-    ledcAttachPin(27, 4); // Links oberster
-    ledcAttachPin(16, 4); // Rechts oberster
-    ledcAttachPin(4, 5); // Rechteckige oben
-    ledcAttachPin(14, 6); // Baumkrone rund
+    set_routing(led_map::by_height);
 }
 
 void Tannenbaum::set_mode_all_on_off() {
     debug_print("New Operation Mode: All on or all off");
-    op_mode = ALL_ON_OFF;
-    // Attach GPIO pins to PWM channels
-    ledcAttachPin(32, 0); // Links unten
-    ledcAttachPin(21, 0); // Rechts unten
-    ledcAttachPin(33, 0); // Links
-    ledcAttachPin(19, 0); // Rechts
-    ledcAttachPin(25, 0); // Links
-    ledcAttachPin(18, 0); // Rechts
-    ledcAttachPin(26, 0); // Links
-    ledcAttachPin(17, 0); // Rechts
-    ledcAttachPin(27, 0); // Links oberster
-    ledcAttachPin(16, 0); // Rechts oberster
-    ledcAttachPin(4, 0); // Rechteckige oben
-    ledcAttachPin(14, 0); // Baumkrone rund
+    enter_mode(ALL_ON_OFF);
+    set_pattern(led_state_all_on ? all_on_table : all_off_table);
+    set_routing(led_map::single);
+}
+
+void Tannenbaum::set_mode_program() {
+    if (!vm.is_loaded()) {
+        debug_print("No animation program loaded");
+        set_mode_larson();
+        return;
+    }
+    debug_print("New Operation Mode: Animation program");
+    enter_mode(PROGRAM);
+    // The frame clock starts the program on its next tick
+    vm.restart();
+    program_table.n_channels = vm.n_channels();
+    set_pattern(program_table);
+    switch (vm.grouping()) {
+        case led_map::BY_HEIGHT: set_routing(led_map::by_height); break;
+        case led_map::BY_RING: set_routing(led_map::by_ring); break;
+        case led_map::SINGLE: set_routing(led_map::single); break;
+    }
+}
+
+void Tannenbaum::set_mode_audio() {
+    debug_print("New Operation Mode: Audio spectrum");
+    enter_mode(AUDIO);
+    std::fill(audio_frame, audio_frame + AudioAnalyzer::n_bands, led_off);
+    set_pattern(audio_table);
+    set_routing(led_map::by_height);
+}
+
+void Tannenbaum::set_mode_live() {
+    debug_print("New Operation Mode: Live frames");
+    enter_mode(LIVE);
+    set_pattern(live_table);
+    set_routing(led_map::by_ring);
+}
+
+void Tannenbaum::set_mode(enum OP_MODES mode) {
+    switch (mode) {
+        case LARSON: set_mode_larson(); break;
+        case SPIN_RIGHT: set_mode_spinning(true); break;
+        case SPIN_LEFT: set_mode_spinning(false); break;
+        case ARROW_UP: set_mode_arrow(true); break;
+        case ARROW_DOWN: set_mode_arrow(false); break;
+        case ALL_ON_OFF: set_mode_all_on_off(); break;
+        case PROGRAM: set_mode_program(); break;
+        case AUDIO: set_mode_audio(); break;
+        case LIVE: set_mode_live(); break;
+    }
+}
+
+bool Tannenbaum::load_program(const uint8_t* code, size_t len) {
+    if (!vm.load(code, len)) {
+        error_print("Invalid animation program");
+        return false;
+    }
+    set_mode_program();
+    return true;
 }
 
 bool Tannenbaum::toggle_on_off_state() {
-    set_mode_all_on_off();
     led_state_all_on = !led_state_all_on;
-    update_all_on_off();
+    set_mode_all_on_off();
+    // Show new state immediately
+    show_frame();
     if(led_state_all_on) {
         http_server.set_template("ON_OFF_BTN_STATE", "");
         mplayer.play(
-            {G, G, L4,E, P, G, F, E,
+            MELODY(G, G, L4,E, P, G, F, E,
             L4,F, L4,E, L4,D, P, C, A, C, C, C, E, E, D, C, L4,D, L4,P, L2,P,
             F, A, L4,A, P, A, G, F, G, F, L4,E, L4,P, P, E, D, Fs, L4,A, P, D, D, B,
             L4,A, L4,G, L4,G, L4,P, C, C, A, G, L4,G, L4,F, E, G, G, A, L4,G, L2, P
-            },
+            ),
             196
         );
     } else {
         http_server.set_template("ON_OFF_BTN_STATE", "btn_off");
     }
+    http_server.notify_state_changed();
     debug_print_sv("Setting LED state to: ", led_state_all_on ? "ON" : "OFF");
     return led_state_all_on;
 }
 
 void Tannenbaum::increase_speed() {
     debug_print("Faster.");
-    if (pattern_interval >= 2) {
-        pattern_interval /= 2;
-    }
-    pattern_timer.attach_ms(pattern_interval, on_timer_event, this);
+    phase_increment = std::min(phase_increment * 2, phase_increment_max);
+    http_server.notify_state_changed();
 }
 
 void Tannenbaum::decrease_speed() {
     debug_print("Slower..");
-    if (pattern_interval < 4096) {
-        pattern_interval *= 2;
+    phase_increment = std::max(phase_increment / 2, phase_increment_min);
+    http_server.notify_state_changed();
+}
+
+void Tannenbaum::set_speed(uint32_t n_frames, uint32_t period_ms) {
+    if (period_ms == 0) {
+        return;
+    }
+    const uint64_t increment = static_cast<uint64_t>(n_frames)
+                               * phase_one_frame * frame_clock_ms / period_ms;
+    phase_increment = std::max<uint64_t>(
+        std::min<uint64_t>(increment, phase_increment_max), phase_increment_min);
+    http_server.notify_state_changed();
+}
+
+void Tannenbaum::set_brightness(uint8_t level) {
+    brightness = level;
+    frame_pending = true;
+    http_server.notify_state_changed();
+}
+
+void Tannenbaum::set_renderer(enum OP_MODES mode, enum RENDERERS renderer) {
+    renderers[mode] = renderer;
+    http_server.notify_state_changed();
+}
+
+void Tannenbaum::toggle_renderer() {
+    if (renderers[op_mode] == STEPPED) {
+        debug_print("Renderer: Crossfade");
+        set_renderer(op_mode, CROSSFADE);
+    } else {
+        debug_print("Renderer: Stepped");
+        set_renderer(op_mode, STEPPED);
+    }
+}
+
+bool Tannenbaum::toggle_layer(enum Compositor::LAYER_TYPES type) {
+    const bool enabled = compositor.toggle_layer(type);
+    debug_print_sv("Effect layer enabled: ", enabled ? "YES" : "NO");
+    return enabled;
+}
+
+bool Tannenbaum::toggle_beat_sync() {
+    beat_sync = !beat_sync;
+    onsets_seen = timeline.note_onsets();
+    http_server.notify_state_changed();
+    compositor.set_layer(Compositor::FLASH, beat_sync, Compositor::BLEND_MAX, 160);
+    debug_print_sv("Beat sync enabled: ", beat_sync ? "YES" : "NO");
+    return beat_sync;
+}
+
+uint32_t Tannenbaum::render_budget_overruns() const {
+    return compositor.budget_overruns();
+}
+
+uint32_t Tannenbaum::program_budget_exhaustions() const {
+    return vm.budget_exhaustions();
+}
+
+uint32_t Tannenbaum::pwm_writes_saved_per_s() const {
+    return pwm_writes_saved_last_s;
+}
+
+uint32_t Tannenbaum::pixel_frames_shown() const {
+    return pixels.frames_shown();
+}
+
+uint32_t Tannenbaum::pixel_frames_dropped() const {
+    return pixels.frames_dropped();
+}
+
+// Runs in the network task. Live frames only go through the mailbox,
+// the frame clock is woken up and takes the latest one.
+bool Tannenbaum::on_ws_message(const uint8_t* data, size_t len) {
+    if (len == 0) {
+        return false;
+    }
+    switch (data[0]) {
+        case WS_MODE:
+            if (len != 2 || data[1] >= n_op_modes) {
+                return false;
+            }
+            set_mode(static_cast<enum OP_MODES>(data[1]));
+            return true;
+        case WS_SPEED:
+            if (len != 5) {
+                return false;
+            }
+            set_speed(data[1] | data[2] << 8, data[3] | data[4] << 8);
+            return true;
+        case WS_BRIGHTNESS:
+            if (len != 2) {
+                return false;
+            }
+            set_brightness(data[1]);
+            return true;
+        case WS_FRAME: {
+            constexpr size_t sequence_offset = 1 + n_live_channels;
+            if (len != sequence_offset && len != sequence_offset + 4) {
+                return false;
+            }
+            LiveFrame& frame = live_mailbox.back();
+            frame.received_us = Timeline::now_us();
+            for (uint8_t channel = 0; channel < n_live_channels; ++channel) {
+                frame.levels[channel] = data[1 + channel] * 257;
+            }
+            frame.has_sequence = len > sequence_offset;
+            frame.sequence = 0;
+            for (uint8_t i = 0; frame.has_sequence && i < 4; ++i) {
+                frame.sequence |= static_cast<uint32_t>(data[sequence_offset + i]) << 8 * i;
+            }
+            live_mailbox.publish();
+            ++n_live_received;
+            if (op_mode != LIVE) {
+                set_mode_live();
+            }
+            timeline.wake(frame_client);
+            return true;
+        }
+        default:
+            return false;
     }
-    pattern_timer.attach_ms(pattern_interval, on_timer_event, this);
+}
+
+uint32_t Tannenbaum::live_frames_received() const {
+    return n_live_received;
+}
+
+uint32_t Tannenbaum::live_frames_shown() const {
+    return n_live_shown;
+}
+
+uint32_t Tannenbaum::live_latency_us_max() const {
+    return live_latency_max;
+}
+
+uint32_t Tannenbaum::live_latency_us_avg() const {
+    return n_live_shown > 0 ? live_latency_sum / n_live_shown : 0;
+}
+
+// Written directly into the buffer, without heap allocation
+size_t Tannenbaum::write_state(char* buffer, size_t size) const {
+    // Pattern frames per second, in tenths
+    const uint32_t frames_per_10s = static_cast<uint64_t>(phase_increment) * 10000
+                                    / (phase_one_frame * frame_clock_ms);
+    const int len = snprintf(
+        buffer, size,
+        "{\"mode\":\"%s\",\"on\":%s,\"frames_per_s\":%u.%u,"
+        "\"bpm\":%u,\"beat_sync\":%s,\"crossfade\":%s,\"brightness\":%u}",
+        mode_names[op_mode], led_state_all_on ? "true" : "false",
+        static_cast<unsigned>(frames_per_10s / 10),
+        static_cast<unsigned>(frames_per_10s % 10),
+        static_cast<unsigned>(timeline.beats_per_minute()),
+        beat_sync ? "true" : "false",
+        renderers[op_mode] == CROSSFADE ? "true" : "false",
+        static_cast<unsigned>(brightness));
+    return len < 0 ? 0 : len;
 }
 
 ///////////// private
 
 void Tannenbaum::setup_http_interface() {
+    http_server.register_state_cb([this](char* buffer, size_t size){
+        return write_state(buffer, size);
+    });
     http_server.register_api_cb("larson", [this](){set_mode_larson();});
     http_server.register_api_cb("spin_right", [this](){set_mode_spinning(true);});
     http_server.register_api_cb("spin_left", [this](){set_mode_spinning(false);});
@@ -175,15 +460,40 @@ void Tannenbaum::setup_http_interface() {
     http_server.register_api_cb("arrow_down", [this](){set_mode_arrow(false);});
     http_server.register_api_cb("on_off", [this](){
         toggle_on_off_state();
-        mplayer.play({C, D, E, P, C});
+        effects_player.play(MELODY(C, D, E, P, C));
     });
     http_server.register_api_cb("plus", [this](){
         increase_speed();
-        mplayer.play({C, D, L2, E});
+        effects_player.play(MELODY(C, D, L2, E));
     });
     http_server.register_api_cb("minus", [this](){
         decrease_speed();
-        mplayer.play({E, D, L2, C});
+        effects_player.play(MELODY(E, D, L2, C));
+    });
+    // Melody file from the upload directory, e.g. /cmd?play=song.rtttl
+    http_server.register_api_cb("play", [this](const String& filename){
+        mplayer.play_file((String(upload_dir) + filename).c_str());
+    });
+    http_server.register_api_cb("crossfade", [this](){toggle_renderer();});
+    http_server.register_api_cb("beat", [this](){toggle_beat_sync();});
+    http_server.register_api_cb("program", [this](){set_mode_program();});
+    http_server.register_api_cb("audio", [this](){set_mode_audio();});
+    http_server.register_body_cb("/program", [this](const uint8_t* data, size_t len){
+        return load_program(data, len);
+    });
+    http_server.register_api_cb("live", [this](){set_mode_live();});
+    http_server.register_api_cb("brightness", CbIntT{[this](const int level){
+        set_brightness(std::min(std::max(level, 0), 255));
+    }});
+    // Binary commands and live frames, see WS_COMMANDS
+    http_server.register_ws_cb([this](const uint8_t* data, size_t len){
+        return on_ws_message(data, len);
+    });
+    http_server.register_api_cb("breathe", [this](){
+        toggle_layer(Compositor::BREATHE);
+    });
+    http_server.register_api_cb("sparkle", [this](){
+        toggle_layer(Compositor::SPARKLE);
     });
 }
 
@@ -193,7 +503,7 @@ void Tannenbaum::setup_touch_buttons() {
             toggle_on_off_state();
         } else {
             decrease_speed();
-            mplayer.play({E, D, L2, C});
+            effects_player.play(MELODY(E, D, L2, C));
         }
     });
     buttons.configure_input(touch_io_middle, touch_threshold_percent, [this](){
@@ -201,7 +511,7 @@ void Tannenbaum::setup_touch_buttons() {
             toggle_on_off_state();
         } else {
             increase_speed();
-            mplayer.play({C, D, L2, E});
+            effects_player.play(MELODY(C, D, L2, E));
         }
     });
     buttons.configure_input(touch_io_right, touch_threshold_percent, [this](){
@@ -211,131 +521,264 @@ void Tannenbaum::setup_touch_buttons() {
             case SPIN_LEFT: set_mode_arrow(true); break;
             case ARROW_UP: set_mode_arrow(false); break;
             case ARROW_DOWN: set_mode_all_on_off(); break;
-            case ALL_ON_OFF: set_mode_larson(); break;
+            case ALL_ON_OFF: set_mode_program(); break;
+            case PROGRAM: set_mode_audio(); break;
+            case AUDIO: set_mode_larson(); break;
+            case LIVE: set_mode_larson(); break;
         }
-        mplayer.play({C, D, E, P, C});
+        effects_player.play(MELODY(C, D, E, P, C));
     });
     buttons.begin();
 }
 
 void Tannenbaum::init_pwm_gpios() {
     // Setup PWM channels for LEDs
-    ledcSetup(0, pwm_freq, 8);
-    ledcSetup(1, pwm_freq, 8);
-    ledcSetup(2, pwm_freq, 8);
-    ledcSetup(3, pwm_freq, 8);
-    ledcSetup(4, pwm_freq, 8);
-    ledcSetup(5, pwm_freq, 8);
-    ledcSetup(6, pwm_freq, 8);
-    ledcSetup(7, pwm_freq, 8);
-    ledcSetup(8, pwm_freq, 8);
-    ledcSetup(9, pwm_freq, 8);
-    ledcSetup(10, pwm_freq, 8);
-    ledcSetup(11, pwm_freq, 8);
-    ledcSetup(12, pwm_freq, 8);
-}
-
-
-void Tannenbaum::update_larson() {
-    constexpr int n_leds = 7;
-    // Pattern is one uint8 value for setting output PWM duty cycle.
-    constexpr uint16_t led_pattern[] = {led_dim, led_on, led_dim};
-    // Shift is allowed to be -1...5 for 7 LEDs and width-3 pattern
-    constexpr int shift_max = n_leds + 1 - NELEMS(led_pattern);
-    static int shift = -1;
-    // Current pattern shift direction (left or right)
-    static bool is_shifting_right = true;
-
-    // Write shifted pattern to LED PWM channels
-    for (int i = 0; i < n_leds; ++i) {
-        int pattern_index = i - shift;
-        if (pattern_index < 0|| pattern_index >= NELEMS(led_pattern)) {
-            ledcWrite(i, led_off);
-        } else {
-            ledcWrite(i, led_pattern[pattern_index]);
-        }
+    for (uint8_t channel = 0; channel < n_pwm_channels; ++channel) {
+        ledcSetup(channel, pwm_freq, pwm_resolution_bits);
+    }
+    // Hardware fade engine for the crossfade renderer
+    ledc_fade_func_install(0);
+    // Configure all LED GPIOs as PWM outputs, initially all on channel 0.
+    // Mode switches then only re-route the GPIO matrix.
+    for (const auto& led : led_map::leds) {
+        ledcAttachPin(led.gpio, 0);
     }
+    routing = &led_map::single;
+    // Write all channels on first update
+    pwm_force_mask = (1 << n_pwm_channels) - 1;
+}
 
-    // Update shift value
-    if (is_shifting_right) {
-        if (shift < shift_max) {
-            ++shift;
-        } else { // Change direction
-        is_shifting_right = false;
-            --shift;
-        }
-    } else { // Current shift direction left
-        if (shift > -1) {
-            --shift;
-        } else { // Change direction
-        is_shifting_right = true;
-            ++shift;
-        }
+// I2S0 is used by the synthesizer or, in AUDIO mode, by the microphone.
+// The melody players are muted meanwhile.
+void Tannenbaum::enter_mode(enum OP_MODES mode) {
+    if (mode == AUDIO && op_mode != AUDIO) {
+        mplayer.set_muted(true);
+        effects_player.set_muted(true);
+        synth.end();
+        analyzer.begin();
+    } else if (mode != AUDIO && op_mode == AUDIO) {
+        analyzer.end();
+        synth.begin();
+        mplayer.set_muted(false);
+        effects_player.set_muted(false);
     }
+    op_mode = mode;
+    http_server.notify_state_changed();
 }
 
-void Tannenbaum::update_spinning(bool direction) {
-    constexpr int n_leds = 12;
-    // Pattern is one uint8 value for setting output PWM duty cycle.
-    constexpr uint16_t led_pattern[] = {led_dim, led_on, led_dim};
-    // Wrap around a cycle of this many shift positions
-    constexpr uint8_t wrap_length = n_leds;
-    rotate_pattern(led_pattern, NELEMS(led_pattern), n_leds, wrap_length, direction);
+void Tannenbaum::set_pattern(const PatternTable& table) {
+    pattern = &table;
+    pattern_phase = 0;
+    frame_index = 0;
+    frame_pending = true;
 }
 
-void Tannenbaum::update_arrow(bool direction) {
-    constexpr int n_leds = 7;
-    // Pattern is one uint8 value for setting output PWM duty cycle.
-    constexpr uint16_t led_pattern[] = {led_dim, led_on, led_dim};
-    // Wrap around a cycle of this many shift positions
-    constexpr int wrap_length = n_leds + NELEMS(led_pattern);
-    rotate_pattern(led_pattern, NELEMS(led_pattern), n_leds, wrap_length, direction);
+void Tannenbaum::set_routing(const led_map::Routing& new_routing) {
+    pending_routing = &new_routing;
 }
 
-void Tannenbaum::update_all_on_off() {
-    uint16_t pwm_value = led_state_all_on ? led_on : led_off;
-    ledcWrite(0, pwm_value);
+// Connects the LED GPIOs to the PWM channels of the pending routing,
+// skipping all LEDs which stay on the same channel
+void Tannenbaum::apply_routing() {
+    for (size_t i = 0; i < led_map::n_leds; ++i) {
+        const uint8_t channel = pending_routing->channel[i];
+        if (channel != routing->channel[i]) {
+            pinMatrixOutAttach(led_map::leds[i].gpio, ledc_signal(channel), false, false);
+        }
+    }
+    routing = pending_routing;
 }
 
-void Tannenbaum::rotate_pattern(const uint16_t* pattern, const uint8_t l_pattern,
-                                const uint8_t n_leds, const uint8_t wrap_length,
-                                const bool direction) {
-    static int shift = 0;
-    // Write shifted pattern to LED PWM channels
-    for (int i = 0; i < n_leds; ++i) {
-        int pattern_index = (i - shift + wrap_length) % wrap_length;
-        if (pattern_index >= l_pattern) {
-            ledcWrite(i, led_off);
-        } else {
-            ledcWrite(i, pattern[pattern_index]);
+unsigned long Tannenbaum::frame_period_ms() const {
+    return phase_one_frame * frame_clock_ms / phase_increment;
+}
+
+// Writes the current frame, with all active effect layers composed on top.
+// For PWM output, a routing change requested by
+// a mode switch is applied right after, so the new mode starts with its
+// first frame. Pixels are mapped in software, no GPIO routing involved.
+void Tannenbaum::show_frame() {
+    const PatternTable& table = *pattern;
+    const uint16_t* frame = table.frame(frame_index);
+    if (compositor.has_active_layers()) {
+        frame = compositor.compose(frame, table.n_channels, render_budget_us);
+    }
+    if (brightness != UINT8_MAX) {
+        for (uint8_t channel = 0; channel < table.n_channels; ++channel) {
+            dimmed_frame[channel] = frame[channel] * (brightness + 1) >> 8;
         }
+        frame = dimmed_frame;
     }
-    // Update shift value
-    if (direction) {
-        if (shift < wrap_length - 1) {
-            ++shift;
-        } else {
-            shift = 0;
+    switch (output) {
+        case PWM_OUTPUT:
+            write_frame(frame, table.n_channels);
+            if (pending_routing != routing) {
+                apply_routing();
+            }
+            break;
+        case PIXEL_OUTPUT:
+            routing = pending_routing;
+            write_pixels(frame);
+            break;
+    }
+}
+
+// Frame values are brightness values which are mapped to PWM duty cycles
+// by the gamma lookup table.
+// Only the channels which differ from the shadow copy are written to the
+// LEDC peripheral. From one frame to the next, this is typically
+// 2...4 out of 7 or 12 channels.
+// With the crossfade renderer, the changed channels are instead faded
+// to their new values by the LEDC hardware. The fade ends a little before
+// the next frame is due so that a running fade is never re-programmed.
+// Frames only change on frame clock ticks, so the fade time is rounded
+// down to the clock.
+void Tannenbaum::write_frame(const uint16_t* frame, const uint8_t n_channels) {
+    static_assert(n_pwm_channels <= 16, "Dirty mask must hold all channels");
+    uint16_t dirty_mask = pwm_force_mask & ((1 << n_channels) - 1);
+    pwm_force_mask &= ~dirty_mask;
+    for (uint8_t channel = 0; channel < n_channels; ++channel) {
+        if (frame[channel] != pwm_shadow[channel]) {
+            dirty_mask |= 1 << channel;
         }
-    } else { // Current shift direction left
-        if (shift > 0) {
-            --shift;
+    }
+    pwm_writes_saved += n_channels - __builtin_popcount(dirty_mask);
+    const unsigned long period_ms = frame_period_ms() / frame_clock_ms
+                                    * frame_clock_ms;
+    // Effect layers change the frame on every tick, no time for fades
+    const bool crossfade = renderers[op_mode] == CROSSFADE
+                           && period_ms >= crossfade_min_interval_ms
+                           && !compositor.has_active_layers();
+    const unsigned long fade_ms = period_ms - period_ms / 8;
+    while (dirty_mask) {
+        const uint8_t channel = __builtin_ctz(dirty_mask);
+        dirty_mask &= dirty_mask - 1;
+        const uint16_t duty = gamma_lut(frame[channel]);
+        if (crossfade) {
+            start_hw_fade(channel, duty, fade_ms);
         } else {
-            shift = wrap_length - 1;
+            ledcWrite(channel, duty);
         }
+        pwm_shadow[channel] = frame[channel];
+    }
+    const unsigned long now_ms = millis();
+    if (now_ms - pwm_stats_start_ms >= 1000) {
+        pwm_writes_saved_last_s = pwm_writes_saved;
+        pwm_writes_saved = 0;
+        pwm_stats_start_ms = now_ms;
     }
 }
 
+// Renders a frame into the pixel buffer. The strip runs along the tree
+// outline from bottom left to bottom right. Each pixel is interpolated
+// between the two LEDs of the map next to its position, which show the
+// value of the channel they would be routed to. So the strip can have any
+// number of pixels, and the cost per pixel is the same for all modes.
+void Tannenbaum::write_pixels(const uint16_t* frame) {
+    const uint16_t n_pixels = pixels.size();
+    // Outline position of the pixels, Q16.16 LEDs
+    const uint32_t step = n_pixels > 1
+                          ? ((led_map::n_leds - 1) << 16) / (n_pixels - 1) : 0;
+    uint32_t position = 0;
+    for (uint16_t i = 0; i < n_pixels; ++i, position += step) {
+        const size_t index = position >> 16;
+        const size_t next = std::min(index + 1, led_map::n_leds - 1);
+        const int32_t level = frame[routing->channel[led_map::ring_order.led[index]]];
+        const int32_t level_next = frame[routing->channel[led_map::ring_order.led[next]]];
+        const int32_t fraction = (position & 0xFFFF) >> 8;
+        const uint8_t value = std::min<uint16_t>(
+            pixel_gamma_lut(level + ((level_next - level) * fraction >> 8)),
+            UINT8_MAX);
+        pixels.set_pixel(i, value, value, value);
+    }
+    pixels.show();
+}
 
 // Static function
+// Frame clock: Advances the animation phase by the speed increment and
+// writes the LED pattern frame at the new phase when it has changed.
+// With effect layers active, a frame is composed on every tick.
+// In PROGRAM mode, the animation program is run for each new frame.
+// In AUDIO mode, the frame shows the latest band levels of the analyzer.
+// In LIVE mode, the frame shows the latest frame from the mailbox, also
+// in between ticks when a frame arrives.
+// In beat sync mode, the phase follows the beat position of the tune
+// instead, and note onsets in between ticks show a flash right away.
 void Tannenbaum::on_timer_event(Tannenbaum* self) {
-    // Call LED PWM pattern update
-    switch (self->op_mode) {
-        case LARSON: self->update_larson(); break;
-        case SPIN_RIGHT: self->update_spinning(true); break;
-        case SPIN_LEFT: self->update_spinning(false); break;
-        case ARROW_UP: self->update_arrow(true); break;
-        case ARROW_DOWN: self->update_arrow(false); break;
-        case ALL_ON_OFF: self->update_all_on_off(); break;
+    const int64_t now_us = Timeline::now_us();
+    const bool tick = now_us >= self->next_frame_us;
+    bool next_frame = false;
+    // Live frame taken on this run
+    const LiveFrame* live = nullptr;
+    if (tick) {
+        // Drift-free ticks, but no burst of ticks after a stall
+        self->next_frame_us += frame_clock_ms * 1000;
+        if (self->next_frame_us <= now_us) {
+            self->next_frame_us = now_us + frame_clock_ms * 1000;
+        }
+        const uint32_t cycle = static_cast<uint32_t>(self->pattern->n_frames)
+                               * phase_one_frame;
+        bool wrapped = false;
+        if (self->beat_sync && self->timeline.has_tempo()) {
+            const uint32_t phase = static_cast<uint64_t>(
+                self->timeline.beat_position(now_us)) * beat_sync_frames_per_beat
+                * phase_one_frame / Timeline::beat_one % cycle;
+            wrapped = phase < self->pattern_phase;
+            self->pattern_phase = phase;
+        } else {
+            self->pattern_phase += self->phase_increment;
+            if (self->pattern_phase >= cycle) {
+                self->pattern_phase -= cycle;
+                wrapped = true;
+            }
+        }
+        const uint8_t index = self->pattern_phase / phase_one_frame;
+        next_frame = index != self->frame_index || wrapped;
+        if (self->op_mode == PROGRAM && (next_frame || self->vm.restart_pending())) {
+            self->vm.run_frame();
+        }
+        AudioAnalyzer::BandLevels bands;
+        if (self->op_mode == AUDIO && self->analyzer.read_levels(bands)) {
+            std::copy(bands.levels, bands.levels + AudioAnalyzer::n_bands,
+                      self->audio_frame);
+            self->frame_pending = true;
+        }
+        self->frame_index = index;
+        // Tempo changes come from the melody player
+        const uint32_t bpm = self->timeline.beats_per_minute();
+        if (bpm != self->published_bpm) {
+            self->published_bpm = bpm;
+            self->http_server.notify_state_changed();
+        }
+    }
+    if (self->op_mode == LIVE && self->live_mailbox.take()) {
+        live = &self->live_mailbox.front();
+        std::copy(live->levels, live->levels + n_live_channels, self->live_frame);
+        self->frame_pending = true;
+    }
+    const uint32_t onsets = self->timeline.note_onsets();
+    if (self->beat_sync && onsets != self->onsets_seen) {
+        self->compositor.flash();
+        self->frame_pending = true;
+    }
+    self->onsets_seen = onsets;
+    if (next_frame || self->frame_pending
+            || (tick && self->compositor.has_active_layers())) {
+        self->frame_pending = false;
+        self->show_frame();
+        if (live != nullptr) {
+            const uint32_t latency_us = Timeline::now_us() - live->received_us;
+            self->live_latency_max = std::max(self->live_latency_max, latency_us);
+            self->live_latency_sum += latency_us;
+            ++self->n_live_shown;
+            if (live->has_sequence) {
+                uint8_t echo[5] = {WS_FRAME};
+                for (uint8_t i = 0; i < 4; ++i) {
+                    echo[1 + i] = live->sequence >> 8 * i;
+                }
+                self->http_server.send_ws(echo, sizeof(echo));
+            }
+        }
     }
+    self->timeline.schedule(self->frame_client, self->next_frame_us);
 }
\ No newline at end of file
@@ -3,21 +3,44 @@
 
 #include "api_server.hpp"
 #include "touch_buttons.hpp"
+#include "synth.hpp"
+#include "audio_analyzer.hpp"
 #include "melody.hpp"
+#include "led_patterns.hpp"
+#include "led_map.hpp"
+#include "gamma_lut.hpp"
+#include "pixel_output.hpp"
+#include "compositor.hpp"
+#include "pattern_vm.hpp"
+#include "timeline.hpp"
+#include "triple_buffer.hpp"
 
 class Tannenbaum
 {
 public:
     // LED PWM frequency
     static constexpr double pwm_freq = 1000;
-    // Pre-Defined LED brightness levels with 8-Bit + 1 Digit resolution (?!)
-    // Pins are inverted - 256 => 0%; 0 => 100%
-    static constexpr uint16_t led_on = 0;
-    static constexpr uint16_t led_dim = 220;
-    static constexpr uint16_t led_off = 256;
-    // Audio output
+    // LED PWM resolution, duty cycle range is 0...2^13 (at 1 kHz)
+    static constexpr uint8_t pwm_resolution_bits = 13;
+    // Number of LEDC channels used for the LEDs (0...12)
+    static constexpr uint8_t n_pwm_channels = 13;
+    // Pre-Defined LED brightness levels, perceptually linear 16-bit values.
+    // These are gamma corrected and inverted (pins are active low) by the
+    // output lookup table, see gamma_lut.hpp
+    static constexpr uint16_t led_on = UINT16_MAX;
+    // Approx. 14% on-time after gamma correction
+    static constexpr uint16_t led_dim = 29100;
+    static constexpr uint16_t led_off = 0;
+    // Addressable LED strip output, laid along the tree outline,
+    // see write_pixels()
+    static constexpr uint8_t pixel_gpio = 22;
+    // Audio output, see synth.hpp
     static constexpr uint8_t audio_gpio = 23;
-    static constexpr uint8_t audio_pwm_channel = 15;
+    // Microphone input for AUDIO mode, see audio_analyzer.hpp
+    static constexpr adc1_channel_t audio_adc_channel = ADC1_CHANNEL_0; // GPIO 36
+    // Synthesizer voices for background tunes and for UI sounds
+    static constexpr uint8_t tune_voice = 0;
+    static constexpr uint8_t effects_voice = 1;
 
     // Touch button touch detection threshold
     static constexpr uint8_t touch_threshold_percent = 94;
@@ -26,18 +49,88 @@ class Tannenbaum
     static constexpr int touch_io_middle = 5; // GPIO 12
     static constexpr int touch_io_left = 4; // GPIO 13
 
-    // Operation modes for the application
-    enum OP_MODES{LARSON, SPIN_RIGHT, SPIN_LEFT, ARROW_UP, ARROW_DOWN, ALL_ON_OFF};
+    // Operation modes for the application.
+    // PROGRAM: Animation uploaded as bytecode, see pattern_vm.hpp
+    // AUDIO: Spectrum of the microphone input, bass at the bottom
+    // LIVE: Frames streamed over the WebSocket, see on_ws_message()
+    enum OP_MODES{LARSON, SPIN_RIGHT, SPIN_LEFT, ARROW_UP, ARROW_DOWN, ALL_ON_OFF,
+                  PROGRAM, AUDIO, LIVE};
+    static constexpr int n_op_modes = LIVE + 1;
 
+    // Binary WebSocket messages, the first byte is the command:
+    // WS_MODE, mode: Operation mode, see OP_MODES
+    // WS_SPEED, n_frames (16 bit), period_ms (16 bit): See set_speed()
+    // WS_BRIGHTNESS, level: See set_brightness()
+    // WS_FRAME, n_live_channels levels: LED levels 0...255 in tree outline
+    //           order (led_map::BY_RING), switches to LIVE mode.
+    //           Optionally followed by a sequence (32 bit), which is sent
+    //           back to the clients as WS_FRAME, sequence when the frame
+    //           is on the LEDs. The client can put a sequence number or
+    //           its own timestamp there to measure the round trip.
+    // 16-bit values are little endian.
+    enum WS_COMMANDS{WS_MODE = 1, WS_SPEED, WS_BRIGHTNESS, WS_FRAME};
+    static constexpr uint8_t n_live_channels = led_map::by_ring.n_channels;
+
+    // LED output backends:
+    // PWM_OUTPUT: Discrete LEDs on LEDC PWM channels, routed by GPIO matrix
+    // PIXEL_OUTPUT: WS2812 style pixel strip on pixel_gpio, see pixel_output.hpp
+    enum OUTPUTS{PWM_OUTPUT, PIXEL_OUTPUT};
+
+    // LED frame renderers:
+    // STEPPED: Frames are written to the PWM channels as hard steps.
+    // CROSSFADE: The LEDC hardware fade engine ramps each channel from one
+    //            frame (keyframe) to the next during the frame interval.
+    enum RENDERERS{STEPPED, CROSSFADE};
+    // Shortest frame interval for which hardware fades are started,
+    // below this, CROSSFADE falls back to stepped output.
+    static constexpr unsigned long crossfade_min_interval_ms = 16;
+
+    // LED pattern frame clock. The pattern timer runs at this fixed rate
+    // regardless of the animation speed.
+    static constexpr unsigned long frame_clock_ms = 10;
+    // Animation phase is a Q16.16 fixed-point frame position
+    static constexpr uint32_t phase_one_frame = 1UL << 16;
+    // Animation speed limits: One frame per clock tick (fastest)
+    // and one frame in 4096 ms (slowest)
+    static constexpr uint32_t phase_increment_max = phase_one_frame;
+    static constexpr uint32_t phase_increment_min =
+        phase_one_frame * frame_clock_ms / 4096;
+    // Time per frame clock tick available for composing effect layers
+    static constexpr unsigned long render_budget_us = frame_clock_ms * 1000 / 4;
+    // Pattern frames per beat of the music in beat sync mode
+    static constexpr uint32_t beat_sync_frames_per_beat = 2;
+
+    // Shared clock of LED frames and music, see timeline.hpp
+    Timeline timeline;
+
+    Synth synth;
+    // Background tunes
     MelodyPlayer mplayer;
+    // UI sounds, played on top of a tune
+    MelodyPlayer effects_player;
+    // Microphone spectrum for AUDIO mode, takes turns with the synth
+    AudioAnalyzer analyzer;
 
-    Tannenbaum(APIServer& http_server, enum OP_MODES op_mode);
+    // n_pixels: Length of the strip for PIXEL_OUTPUT
+    Tannenbaum(APIServer& http_server, enum OP_MODES op_mode,
+               enum OUTPUTS output = PWM_OUTPUT,
+               uint16_t n_pixels = led_map::n_leds);
     ~Tannenbaum();
 
     void set_mode_larson();
     void set_mode_spinning(bool direction);
     void set_mode_arrow(bool direction);
     void set_mode_all_on_off();
+    // Falls back to LARSON when no program is loaded
+    void set_mode_program();
+    // The synth is silent in this mode, it needs the I2S peripheral
+    void set_mode_audio();
+    // Shows the latest streamed frame
+    void set_mode_live();
+    void set_mode(enum OP_MODES mode);
+
+    // Load a bytecode animation program and switch to PROGRAM mode
+    bool load_program(const uint8_t* code, size_t len);
 
     void set_next_mode();
 
@@ -45,10 +138,54 @@ class Tannenbaum
 
     void increase_speed();
     void decrease_speed();
+    // Set animation speed to n_frames pattern frames per period_ms.
+    // The current animation phase is kept, so there is no visible jump.
+    void set_speed(uint32_t n_frames, uint32_t period_ms);
+    // Master brightness applied to all modes, 255 => unscaled
+    void set_brightness(uint8_t level);
+
+    // Select the LED frame renderer used for an operation mode
+    void set_renderer(enum OP_MODES mode, enum RENDERERS renderer);
+    // Toggle between stepped and crossfade renderer for the current mode
+    void toggle_renderer();
+
+    // Switch an effect layer on top of the mode pattern on or off
+    bool toggle_layer(enum Compositor::LAYER_TYPES type);
+    // Beat sync: While a tune plays, the pattern steps with its beats
+    // and all LEDs flash up on each note
+    bool toggle_beat_sync();
+    // Number of effect layer renders skipped for the render budget
+    uint32_t render_budget_overruns() const;
+    // Number of frames where an animation program ran out of instructions
+    uint32_t program_budget_exhaustions() const;
 
     void play(note_t note, uint32_t duration, uint8_t octave=4);
     static void play_stop();
 
+    // Number of PWM writes per second skipped because the duty cycle
+    // was unchanged, updated once per second
+    uint32_t pwm_writes_saved_per_s() const;
+    // Pixel strip frames queued for output, and frames replaced before
+    // they were sent, see PixelOutput
+    uint32_t pixel_frames_shown() const;
+    uint32_t pixel_frames_dropped() const;
+
+    // Handle a binary WebSocket message, see WS_COMMANDS.
+    // Returns false for an invalid message.
+    bool on_ws_message(const uint8_t* data, size_t len);
+    // Live frame statistics. The latency is the time from receiving a
+    // frame in the network task to writing it to the LEDs, a frame is
+    // shown right away. For the latency seen by the client, use the
+    // sequence echo of WS_FRAME.
+    uint32_t live_frames_received() const;
+    uint32_t live_frames_shown() const;
+    uint32_t live_latency_us_max() const;
+    uint32_t live_latency_us_avg() const;
+
+    // Write mode, on/off state, speed, tempo and brightness as JSON text.
+    // Returns the length, which is >= size when the buffer is too small.
+    size_t write_state(char* buffer, size_t size) const;
+
 private:
     // HTTP API server
     APIServer& http_server;
@@ -56,29 +193,89 @@ class Tannenbaum
     // Touch button interface
     ReactiveTouch buttons;
 
-    // Async event timers
-    Ticker pattern_timer;
-    Ticker tone_timer;
+    // LED output backend
+    const enum OUTPUTS output;
+    PixelOutput pixels;
+
+    // Effect layers on top of the mode pattern
+    Compositor compositor;
+    // Interpreter for PROGRAM mode, its frame buffer is the single frame
+    // of program_table
+    PatternVM vm;
+    PatternTable program_table;
+    // Single frame of AUDIO mode, one channel per band
+    uint16_t audio_frame[AudioAnalyzer::n_bands];
+    PatternTable audio_table;
+    // Single frame of LIVE mode, and the mailbox from the network task
+    struct LiveFrame
+    {
+        uint16_t levels[n_live_channels];
+        int64_t received_us;
+        uint32_t sequence;
+        bool has_sequence;
+    };
+    uint16_t live_frame[n_live_channels];
+    PatternTable live_table;
+    TripleBuffer<LiveFrame> live_mailbox;
+    uint32_t n_live_received;
+    uint32_t n_live_shown;
+    uint32_t live_latency_max;
+    uint64_t live_latency_sum;
+
+    // Frame clock on the timeline, next frame clock tick
+    uint8_t frame_client;
+    int64_t next_frame_us;
+    // Beat sync mode, and number of note onsets already flashed
+    bool beat_sync;
+    uint32_t onsets_seen;
+    // Tempo in the last state change notification
+    uint32_t published_bpm;
 
     // Operation mode
     enum OP_MODES op_mode;
     // LED state for static on/off; true => ON
     bool led_state_all_on;
-    // Time interval in ms for updating LED pattern state
-    unsigned long pattern_interval;
+    // Animation phase advance per frame clock tick, Q16.16 frames
+    uint32_t phase_increment;
+    // Frame table of the current mode and position in its cycle
+    const PatternTable* pattern;
+    uint32_t pattern_phase;
+    // Frame currently shown, and flag for showing it on the next tick
+    uint8_t frame_index;
+    bool frame_pending;
+    // GPIO to PWM channel routing in effect, and the one for the current
+    // mode, which is applied on the next frame
+    const led_map::Routing* routing;
+    const led_map::Routing* pending_routing;
+    // LED frame renderer for each operation mode
+    enum RENDERERS renderers[n_op_modes];
+    // Master brightness, and the frame scaled by it
+    uint8_t brightness;
+    uint16_t dimmed_frame[Compositor::max_channels];
+    // Shadow copy of the last brightness value written to each PWM channel
+    uint16_t pwm_shadow[n_pwm_channels];
+    // Channels which are written on the next frame regardless of the shadow
+    uint16_t pwm_force_mask;
+    // Statistics: Skipped PWM writes counted since pwm_stats_start_ms
+    uint32_t pwm_writes_saved;
+    uint32_t pwm_writes_saved_last_s;
+    unsigned long pwm_stats_start_ms;
 
     void setup_http_interface();
     void setup_touch_buttons();
     void init_pwm_gpios();
 
-    void update_larson();
-    void update_spinning(bool direction);
-    void update_arrow(bool direction);
-    void update_all_on_off();
-
-    void rotate_pattern(const uint16_t* pattern, const uint8_t l_pattern,
-                        const uint8_t n_leds, const uint8_t wrap_length,
-                        const bool direction);
+    // Switches the I2S peripheral between synth and analyzer when
+    // entering or leaving AUDIO mode
+    void enter_mode(enum OP_MODES mode);
+    void set_pattern(const PatternTable& table);
+    void set_routing(const led_map::Routing& new_routing);
+    void apply_routing();
+    // Time in ms between two frames at the current speed
+    unsigned long frame_period_ms() const;
+    void show_frame();
+    void write_frame(const uint16_t* frame, const uint8_t n_channels);
+    void write_pixels(const uint16_t* frame);
 
     static void on_timer_event(Tannenbaum* self);
 
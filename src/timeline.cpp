@@ -0,0 +1,214 @@
+#include <algorithm>
+
+#include "info_debug_error.h"
+#include "timeline.hpp"
+
+Timeline::Timeline()
+    : timer{nullptr}
+    , wake_timer{nullptr}
+    , wake_requests{0}
+    , clients{}
+    , n_clients{0}
+    , dispatching{false}
+    , beat_us{0}
+    , origin_us{0}
+    , n_onsets{0}
+    , onset_client{no_client}
+    , pending_onsets{}
+    , first_pending_onset{0}
+    , n_pending_onsets{0}
+{
+    esp_timer_create_args_t timer_config{};
+    timer_config.callback = reinterpret_cast<esp_timer_cb_t>(on_timer_event);
+    timer_config.arg = this;
+    timer_config.dispatch_method = ESP_TIMER_TASK;
+    timer_config.name = "timeline";
+    if (esp_timer_create(&timer_config, &timer) != ESP_OK) {
+        error_print("Timeline: esp_timer_create failed");
+        timer = nullptr;
+    }
+    timer_config.callback = reinterpret_cast<esp_timer_cb_t>(on_wake_event);
+    timer_config.name = "timeline_wake";
+    if (esp_timer_create(&timer_config, &wake_timer) != ESP_OK) {
+        error_print("Timeline: esp_timer_create failed");
+        wake_timer = nullptr;
+    }
+}
+
+Timeline::~Timeline() {
+    if (timer) {
+        esp_timer_stop(timer);
+        esp_timer_delete(timer);
+    }
+    if (wake_timer) {
+        esp_timer_stop(wake_timer);
+        esp_timer_delete(wake_timer);
+    }
+}
+
+uint8_t Timeline::add_client(esp_timer_cb_t callback, void* arg) {
+    if (n_clients >= max_clients) {
+        error_print("Timeline: No client slot left");
+        return no_client;
+    }
+    clients[n_clients] = Client{callback, arg, 0, false};
+    return n_clients++;
+}
+
+void Timeline::schedule(uint8_t client, int64_t due_us) {
+    if (client >= n_clients) {
+        return;
+    }
+    clients[client].due_us = due_us;
+    clients[client].scheduled = true;
+    rearm();
+}
+
+void Timeline::cancel(uint8_t client) {
+    if (client >= n_clients) {
+        return;
+    }
+    clients[client].scheduled = false;
+    rearm();
+}
+
+// The wake timer is already armed when a wakeup is pending, the request
+// is then taken by that wakeup
+void Timeline::wake(uint8_t client) {
+    if (client >= max_clients || wake_timer == nullptr) {
+        return;
+    }
+    wake_requests.fetch_or(1UL << client);
+    esp_timer_start_once(wake_timer, 0);
+}
+
+int64_t Timeline::now_us() {
+    return esp_timer_get_time();
+}
+
+void Timeline::start_tempo(uint32_t beat_us, int64_t origin_us) {
+    this->origin_us = origin_us;
+    this->beat_us = beat_us;
+}
+
+void Timeline::stop_tempo() {
+    beat_us = 0;
+}
+
+bool Timeline::has_tempo() const {
+    return beat_us > 0;
+}
+
+uint32_t Timeline::beats_per_minute() const {
+    return beat_us > 0 ? (60000000UL + beat_us / 2) / beat_us : 0;
+}
+
+uint32_t Timeline::beat_position(int64_t t_us) const {
+    if (beat_us == 0 || t_us < origin_us) {
+        return 0;
+    }
+    return static_cast<uint32_t>((t_us - origin_us) * beat_one / beat_us);
+}
+
+void Timeline::note_onset(int64_t t_us) {
+    if (n_pending_onsets == max_pending_onsets) {
+        publish_first_onset();
+    }
+    pending_onsets[(first_pending_onset + n_pending_onsets) % max_pending_onsets] = t_us;
+    ++n_pending_onsets;
+    publish_onsets(now_us());
+    rearm();
+}
+
+uint32_t Timeline::note_onsets() const {
+    return n_onsets;
+}
+
+void Timeline::set_onset_client(uint8_t client) {
+    onset_client = client;
+}
+
+///////////// private
+
+// Clients run in order of their due times, so a note onset comes before
+// a frame which is due at the same time or later.
+void Timeline::dispatch() {
+    dispatching = true;
+    for (uint8_t run = 0; run < max_runs_per_wakeup; ++run) {
+        const int64_t now = now_us();
+        publish_onsets(now);
+        Client* next = nullptr;
+        for (uint8_t i = 0; i < n_clients; ++i) {
+            Client& client = clients[i];
+            if (client.scheduled && client.due_us <= now
+                    && (next == nullptr || client.due_us < next->due_us)) {
+                next = &client;
+            }
+        }
+        if (next == nullptr) {
+            break;
+        }
+        next->scheduled = false;
+        next->callback(next->arg);
+    }
+    dispatching = false;
+    rearm();
+}
+
+void Timeline::rearm() {
+    if (dispatching || timer == nullptr) {
+        return;
+    }
+    bool is_due = n_pending_onsets > 0;
+    int64_t due_us = is_due ? pending_onsets[first_pending_onset] : 0;
+    for (uint8_t i = 0; i < n_clients; ++i) {
+        const Client& client = clients[i];
+        if (client.scheduled && (!is_due || client.due_us < due_us)) {
+            due_us = client.due_us;
+            is_due = true;
+        }
+    }
+    esp_timer_stop(timer);
+    if (is_due) {
+        const int64_t timeout_us = std::max<int64_t>(0, due_us - now_us());
+        esp_timer_start_once(timer, timeout_us);
+    }
+}
+
+void Timeline::publish_onsets(int64_t now) {
+    while (n_pending_onsets > 0 && pending_onsets[first_pending_onset] <= now) {
+        publish_first_onset();
+    }
+}
+
+// The onset client runs at the onset time, or earlier if it is
+// scheduled earlier anyway
+void Timeline::publish_first_onset() {
+    const int64_t t_us = pending_onsets[first_pending_onset];
+    first_pending_onset = (first_pending_onset + 1) % max_pending_onsets;
+    --n_pending_onsets;
+    ++n_onsets;
+    if (onset_client != no_client) {
+        Client& client = clients[onset_client];
+        if (!client.scheduled || client.due_us > t_us) {
+            client.due_us = t_us;
+            client.scheduled = true;
+        }
+    }
+}
+
+void Timeline::on_timer_event(Timeline* self) {
+    self->dispatch();
+}
+
+void Timeline::on_wake_event(Timeline* self) {
+    const uint32_t requests = self->wake_requests.exchange(0);
+    const int64_t now = now_us();
+    for (uint8_t i = 0; i < self->n_clients; ++i) {
+        if (requests & 1UL << i) {
+            self->clients[i].due_us = now;
+            self->clients[i].scheduled = true;
+        }
+    }
+    self->dispatch();
+}
@@ -0,0 +1,112 @@
+/* Shared timeline for the light show and the music
+ *
+ * All time-driven parts of the application (LED frame clock, melody
+ * players) are clients of one timeline. Each client schedules its next
+ * run at an absolute time of the monotonic esp_timer clock. A single
+ * one-shot esp_timer wakes up for the earliest client, and all clients
+ * which are due run in order of their due times during that wakeup.
+ *
+ * The melody player conducting the music publishes its tempo and note
+ * onsets here, so the LED patterns can follow beats and notes.
+ *
+ * The timeline is not locked. Except for wake(), it is only used by the
+ * clients in the esp_timer task, and during setup before they run.
+ */
+#ifndef TIMELINE_HPP__
+#define TIMELINE_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <esp_timer.h>
+
+class Timeline
+{
+public:
+    static constexpr uint8_t max_clients = 4;
+    static constexpr uint8_t no_client = UINT8_MAX;
+    // Beat position fixed-point format, Q16.16 beats
+    static constexpr uint32_t beat_one = 1UL << 16;
+    static constexpr uint8_t beats_per_bar = 4;
+
+    Timeline();
+    virtual ~Timeline();
+
+    // Register a client callback, returns the client id
+    // or no_client when all client slots are taken.
+    template<typename TArg>
+    uint8_t add_client(void (*callback)(TArg*), TArg* arg) {
+        return add_client(reinterpret_cast<esp_timer_cb_t>(callback),
+                          static_cast<void*>(arg));
+    }
+    uint8_t add_client(esp_timer_cb_t callback, void* arg);
+    // Run the client at due_us, replaces an earlier schedule.
+    // A client in the past runs on the next wakeup.
+    void schedule(uint8_t client, int64_t due_us);
+    void cancel(uint8_t client);
+    // Run the client as soon as possible. Unlike schedule(), this can be
+    // called from other tasks, the client runs in the esp_timer task.
+    void wake(uint8_t client);
+
+    // Monotonic clock, microseconds since boot
+    static int64_t now_us();
+
+    // Musical time: Beat 0 starts at origin_us
+    void start_tempo(uint32_t beat_us, int64_t origin_us);
+    void stop_tempo();
+    bool has_tempo() const;
+    // 0 without tempo
+    uint32_t beats_per_minute() const;
+    // Beats since the origin at time t_us, Q16.16
+    uint32_t beat_position(int64_t t_us) const;
+
+    // Note onset of the conducting melody, t_us is the time when the note
+    // is heard. The onset is counted at that time and the onset client,
+    // if set, runs then at the latest.
+    void note_onset(int64_t t_us);
+    uint32_t note_onsets() const;
+    void set_onset_client(uint8_t client);
+
+private:
+    // A client scheduling itself into the past can not stall a wakeup
+    static constexpr uint8_t max_runs_per_wakeup = 4 * max_clients;
+    // Onsets within the audio output latency, the oldest is counted
+    // early when more notes start within that time
+    static constexpr uint8_t max_pending_onsets = 4;
+
+    struct Client
+    {
+        esp_timer_cb_t callback;
+        void* arg;
+        int64_t due_us;
+        bool scheduled;
+    };
+
+    esp_timer_handle_t timer;
+    // Runs the clients requested by wake(), one bit per client
+    esp_timer_handle_t wake_timer;
+    std::atomic<uint32_t> wake_requests;
+    Client clients[max_clients];
+    uint8_t n_clients;
+    bool dispatching;
+
+    uint32_t beat_us;
+    int64_t origin_us;
+    uint32_t n_onsets;
+    uint8_t onset_client;
+    // Queue of onsets not yet counted, in order of time
+    int64_t pending_onsets[max_pending_onsets];
+    uint8_t first_pending_onset;
+    uint8_t n_pending_onsets;
+
+    void dispatch();
+    // Count all onsets due at now
+    void publish_onsets(int64_t now);
+    void publish_first_onset();
+    // Program the esp_timer for the earliest scheduled client
+    void rearm();
+
+    static void on_timer_event(Timeline* self);
+    static void on_wake_event(Timeline* self);
+}; // class Timeline
+
+#endif
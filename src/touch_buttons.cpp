@@ -46,7 +46,7 @@ void ReactiveTouch::configure_input(const int input_number,
                                     const uint8_t threshold_percent,
                                     CallbackT callback) {
     debug_print_sv("Registering callback for touch button no.: ", input_number);
-    debug_print_hex("Callback address: ", (int)&callback);
+    debug_print_hex("Callback address: ", reinterpret_cast<uintptr_t>(&callback));
     s_pad_enabled[input_number] = true;
     s_pad_threshold_percent[input_number] = threshold_percent;
     s_pad_callback[input_number] = callback;
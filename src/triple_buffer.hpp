@@ -0,0 +1,52 @@
+/* Lock-free handoff of the latest value from one producer to one consumer
+ *
+ * Three buffers rotate between the producer (back), the consumer (front)
+ * and the handoff slot (middle). Publishing and taking are one atomic
+ * exchange each, so neither side ever waits for the other, e.g. a task
+ * on one core and a timer callback on the other. Values which are
+ * published faster than they are taken are skipped.
+ */
+#ifndef TRIPLE_BUFFER_HPP__
+#define TRIPLE_BUFFER_HPP__
+
+#include <atomic>
+#include <cstdint>
+
+template<typename T>
+class TripleBuffer
+{
+public:
+    // Producer: Fill in the back buffer, then publish it
+    T& back() {
+        return buffers[back_index];
+    }
+    void publish() {
+        back_index = middle.exchange(back_index | fresh_flag,
+                                     std::memory_order_acq_rel) & index_mask;
+    }
+
+    // Consumer: Take the latest published value, if there is a new one.
+    // The front buffer stays valid until the next take().
+    bool take() {
+        if (!(middle.load(std::memory_order_relaxed) & fresh_flag)) {
+            return false;
+        }
+        front_index = middle.exchange(front_index,
+                                      std::memory_order_acq_rel) & index_mask;
+        return true;
+    }
+    const T& front() const {
+        return buffers[front_index];
+    }
+
+private:
+    static constexpr uint8_t index_mask = 0x03;
+    static constexpr uint8_t fresh_flag = 0x04;
+
+    T buffers[3]{};
+    uint8_t back_index = 0;
+    std::atomic<uint8_t> middle{1};
+    uint8_t front_index = 2;
+}; // class TripleBuffer
+
+#endif
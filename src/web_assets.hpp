@@ -0,0 +1,89 @@
+// Generated by embed_web_assets.py from web/, do not edit
+#ifndef WEB_ASSETS_HPP__
+#define WEB_ASSETS_HPP__
+
+#include <cstddef>
+#include <cstdint>
+
+namespace web_assets {
+
+struct Asset
+{
+    const char* url;
+    const char* content_type;
+    const uint8_t* gz;
+    size_t gz_size;
+};
+
+// app.js: 1219 bytes, 629 gzipped
+#define WEB_ASSET_APP_JS_URL "/static/app.b91a112f.js"
+constexpr uint8_t app_js_gz[] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x85, 0x54, 0x51, 0x6f, 0xd3, 0x30,
+    0x10, 0x7e, 0xef, 0xaf, 0xb8, 0xf9, 0x65, 0x89, 0x56, 0x39, 0x08, 0xf1, 0xb4, 0xa9, 0x4c, 0x14,
+    0xfa, 0x00, 0x82, 0x6d, 0xd2, 0x90, 0x78, 0x40, 0x30, 0xb9, 0xce, 0xa5, 0xc9, 0x96, 0xd8, 0x91,
+    0x7d, 0x59, 0xa9, 0xa6, 0xfe, 0xf7, 0x9d, 0xed, 0x34, 0x74, 0x20, 0x84, 0xa5, 0x36, 0x8e, 0xef,
+    0xbe, 0xef, 0xce, 0x77, 0xdf, 0xa5, 0x28, 0x60, 0x39, 0x10, 0x59, 0xe3, 0xc1, 0xa3, 0x29, 0x81,
+    0x6a, 0x6c, 0x1c, 0x68, 0xdb, 0x75, 0x8a, 0xdf, 0xb6, 0x0d, 0xd5, 0x50, 0x21, 0xe9, 0x3a, 0xcb,
+    0xe7, 0xc1, 0x06, 0x25, 0x3e, 0x36, 0x1a, 0x41, 0x19, 0xbf, 0x45, 0xe7, 0x67, 0x45, 0x01, 0xaf,
+    0x5f, 0xbd, 0x81, 0x2b, 0x0b, 0xef, 0xad, 0x21, 0x34, 0x04, 0x2a, 0x91, 0x40, 0xaf, 0x36, 0x08,
+    0x9e, 0xd4, 0xce, 0x4b, 0xf8, 0x5a, 0xc7, 0x2d, 0x31, 0xce, 0xb9, 0xe6, 0x11, 0x3d, 0x28, 0x0f,
+    0x9f, 0x6e, 0xaf, 0xaf, 0xc0, 0x9a, 0xe0, 0x1c, 0x68, 0xf0, 0x31, 0xa0, 0x3d, 0x39, 0x54, 0x5d,
+    0x0a, 0xc5, 0x49, 0xf4, 0x2d, 0xd2, 0x01, 0x5a, 0x35, 0xce, 0x53, 0xb4, 0x18, 0x86, 0xb5, 0xbb,
+    0xe4, 0x53, 0x2b, 0xb3, 0x41, 0x2f, 0x67, 0x62, 0xf0, 0xc1, 0xd1, 0x35, 0x9a, 0xc4, 0xc5, 0x6c,
+    0xa6, 0xf9, 0x42, 0x34, 0x02, 0x17, 0xf0, 0xb4, 0xbf, 0x18, 0x4f, 0x62, 0x14, 0xcf, 0x47, 0x06,
+    0xb7, 0xb0, 0x0a, 0x2f, 0xb7, 0x76, 0x70, 0x1a, 0x33, 0x51, 0x24, 0x93, 0xc8, 0x19, 0x5d, 0x0d,
+    0x46, 0x53, 0xc3, 0xb9, 0xf9, 0xda, 0x6e, 0xb3, 0x31, 0x46, 0x0e, 0x4f, 0x33, 0xe0, 0x75, 0xbd,
+    0xbe, 0x47, 0x4d, 0x52, 0x79, 0xdf, 0x6c, 0x4c, 0x16, 0x43, 0xcc, 0x0f, 0x79, 0x30, 0x38, 0xb8,
+    0x94, 0x56, 0x0f, 0x1d, 0xb3, 0xc9, 0x0d, 0xd2, 0xaa, 0xc5, 0xb0, 0x5d, 0xee, 0x3e, 0x96, 0x99,
+    0xb0, 0xe6, 0xce, 0x56, 0x95, 0xc8, 0xa5, 0x6e, 0x19, 0xff, 0xb9, 0xf1, 0x24, 0xc9, 0x6e, 0x36,
+    0x2d, 0xc7, 0x5f, 0x53, 0xb2, 0xcd, 0xe1, 0x24, 0x72, 0x4a, 0x6b, 0xfe, 0xc7, 0x16, 0xfd, 0x98,
+    0x8c, 0xf0, 0x17, 0x1d, 0xca, 0xbf, 0x88, 0x90, 0xb0, 0x12, 0x4b, 0x67, 0x4b, 0x84, 0x33, 0x60,
+    0x5a, 0xc1, 0x8f, 0x74, 0x56, 0x39, 0xd5, 0xa1, 0xbf, 0xeb, 0xd1, 0xdd, 0xf9, 0x60, 0x83, 0x65,
+    0xd3, 0x96, 0xe8, 0x0a, 0x2f, 0x26, 0xf0, 0x19, 0xa4, 0x9b, 0xc9, 0x75, 0xdf, 0xc1, 0xe5, 0x4b,
+    0x78, 0x38, 0x8a, 0xa8, 0x9b, 0x2f, 0x02, 0xce, 0x41, 0x84, 0x92, 0xed, 0x8f, 0x8a, 0xe6, 0xb0,
+    0x72, 0xe8, 0x59, 0x31, 0x63, 0xc1, 0x1c, 0xd2, 0xe0, 0xcc, 0x28, 0x23, 0x51, 0x8c, 0x59, 0x4f,
+    0xa1, 0x64, 0xe8, 0x68, 0xc6, 0x88, 0x9e, 0x3b, 0xc4, 0xdd, 0x7a, 0x0b, 0x87, 0xbd, 0xbc, 0xf7,
+    0xd6, 0x64, 0xf9, 0x9f, 0xae, 0xa1, 0x29, 0x29, 0x64, 0x6a, 0x99, 0x54, 0x65, 0x19, 0x5b, 0x19,
+    0xea, 0x89, 0x06, 0xdd, 0xa1, 0x32, 0xf3, 0x51, 0x54, 0x4c, 0x19, 0x1b, 0x19, 0x14, 0x27, 0x7b,
+    0xe5, 0x3c, 0x66, 0xd1, 0x20, 0x4b, 0x45, 0x2a, 0xcf, 0x99, 0xeb, 0x9f, 0x44, 0xe8, 0x9c, 0x75,
+    0x4c, 0x34, 0xde, 0x69, 0x0e, 0x4f, 0xd6, 0x68, 0x3c, 0x07, 0x72, 0x03, 0xee, 0x83, 0x54, 0xa6,
+    0xe6, 0xfc, 0x8d, 0xd5, 0x6d, 0xa3, 0x1f, 0x8e, 0x93, 0x48, 0xe5, 0x48, 0x42, 0x6c, 0x1b, 0xf3,
+    0xc0, 0x32, 0x4c, 0x79, 0x90, 0x72, 0xdc, 0x5b, 0x16, 0x85, 0xf5, 0xe8, 0x29, 0x13, 0xea, 0x7b,
+    0xcd, 0x01, 0x7f, 0x2e, 0x4e, 0x0b, 0xdd, 0x95, 0x97, 0xa7, 0x3f, 0xc4, 0xa8, 0x84, 0xa6, 0x82,
+    0xec, 0x24, 0x20, 0x0f, 0xa5, 0xfd, 0x5d, 0xde, 0xe4, 0xb0, 0x8f, 0xff, 0x89, 0xb4, 0x77, 0xf1,
+    0xf9, 0x01, 0x2b, 0x35, 0xb4, 0x94, 0x8d, 0x14, 0xa9, 0x0b, 0x81, 0x23, 0xc8, 0xe9, 0x1d, 0xf1,
+    0xc4, 0xac, 0x07, 0x62, 0xfd, 0x85, 0x88, 0x22, 0xcf, 0x53, 0x89, 0xb9, 0x77, 0x53, 0xbe, 0x61,
+    0xf1, 0x7c, 0x7e, 0xe3, 0x4f, 0x81, 0x1d, 0x28, 0x4e, 0xdd, 0xcb, 0x59, 0x55, 0xfe, 0x01, 0x2a,
+    0xeb, 0xa2, 0x25, 0x8c, 0x55, 0x2c, 0xfe, 0x04, 0x0d, 0x39, 0x8f, 0xe5, 0x65, 0xf7, 0x72, 0x77,
+    0x1b, 0x67, 0xf2, 0x64, 0xb1, 0x38, 0x1e, 0x3f, 0x79, 0x7d, 0xb3, 0xba, 0x3a, 0xbe, 0xd4, 0x91,
+    0x6e, 0x26, 0x39, 0x5d, 0x4c, 0xd6, 0x74, 0xcd, 0x50, 0xff, 0xf0, 0x7b, 0x06, 0xf4, 0xcf, 0x59,
+    0x40, 0xc3, 0x04, 0x00, 0x00,
+};
+
+// style.css: 286 bytes, 214 gzipped
+#define WEB_ASSET_STYLE_CSS_URL "/static/style.f19319e5.css"
+constexpr uint8_t style_css_gz[] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x6d, 0x4f, 0x41, 0x6e, 0xc2, 0x40,
+    0x0c, 0xbc, 0xf3, 0x0a, 0x4b, 0x3d, 0x07, 0x51, 0x68, 0x7a, 0xd8, 0x3d, 0x55, 0x95, 0xaa, 0xfe,
+    0x02, 0x79, 0x77, 0x9d, 0x60, 0xb1, 0xb1, 0xa3, 0x8d, 0xd3, 0xd2, 0x22, 0xfe, 0xce, 0x12, 0x41,
+    0x4f, 0xf5, 0x6d, 0xc6, 0xe3, 0x99, 0xf1, 0xc1, 0x86, 0x0c, 0x67, 0xe8, 0x54, 0xac, 0xe9, 0x70,
+    0xe0, 0xfc, 0xe3, 0xe0, 0x93, 0xf2, 0x17, 0x19, 0x47, 0xf4, 0x90, 0x78, 0x1a, 0x33, 0x56, 0x8e,
+    0x25, 0xb3, 0x50, 0x13, 0xb2, 0xc6, 0xa3, 0x87, 0x01, 0x4b, 0xcf, 0xe2, 0x60, 0x33, 0x9e, 0x00,
+    0x67, 0x53, 0x0f, 0x46, 0x27, 0x6b, 0x30, 0x73, 0x5f, 0xd9, 0x48, 0x62, 0x54, 0xfc, 0x65, 0x15,
+    0x66, 0x33, 0x95, 0x6a, 0x1f, 0x30, 0x1e, 0xfb, 0xa2, 0xb3, 0xa4, 0x26, 0x6a, 0xd6, 0xe2, 0xe0,
+    0xe9, 0xe5, 0xfd, 0xed, 0xa3, 0xdd, 0x78, 0x08, 0x5a, 0x12, 0x55, 0x42, 0x54, 0xc8, 0xc3, 0x7d,
+    0xfb, 0x7d, 0x60, 0xab, 0x68, 0xc4, 0x94, 0x58, 0x7a, 0x07, 0xcf, 0xaf, 0x35, 0x68, 0x57, 0xd3,
+    0xfc, 0x6a, 0x09, 0x4a, 0x14, 0xb5, 0xa0, 0xb1, 0xca, 0xe3, 0x70, 0x79, 0x60, 0xe2, 0x5f, 0x72,
+    0xb0, 0x6d, 0xab, 0xee, 0xaf, 0xe2, 0xf6, 0x06, 0xe2, 0x5c, 0xa6, 0x9b, 0xef, 0xa8, 0x7c, 0xaf,
+    0xb6, 0x0e, 0x26, 0x7b, 0xed, 0x3a, 0x38, 0xff, 0xd3, 0xad, 0x5d, 0xa6, 0xaa, 0xae, 0x37, 0xe7,
+    0x27, 0xcd, 0x1e, 0x01, 0x00, 0x00,
+};
+
+constexpr Asset assets[] = {
+    {WEB_ASSET_APP_JS_URL, "application/javascript", app_js_gz, sizeof(app_js_gz)},
+    {WEB_ASSET_STYLE_CSS_URL, "text/css", style_css_gz, sizeof(style_css_gz)},
+};
+
+} // namespace web_assets
+
+#endif
@@ -0,0 +1,38 @@
+// Buttons send their command with fetch(), the device answers
+// 204 No Content and the page stays. The state arrives as JSON on the
+// event stream, the complete state first, then only the changes.
+"use strict";
+
+const state = {};
+const events = new EventSource("/events");
+
+function show(changes) {
+    Object.assign(state, changes);
+    document.getElementById("on_off").classList.toggle("btn_off", !state.on);
+    document.getElementById("state").textContent =
+        state.mode + ", " + state.frames_per_s + " Bilder/s"
+        + (state.bpm ? ", " + state.bpm + " BPM" : "");
+}
+
+function refresh() {
+    return fetch("/state")
+        .then(response => response.json())
+        .then(show);
+}
+
+events.addEventListener("state", event => show(JSON.parse(event.data)));
+events.addEventListener("error", refresh, {once: true});
+
+document.addEventListener("click", event => {
+    const link = event.target.closest("a[href^='/cmd?']");
+    if (!link) {
+        return;
+    }
+    event.preventDefault();
+    fetch(link.getAttribute("href")).then(() => {
+        // Without the event stream, ask for the new state
+        if (events.readyState !== EventSource.OPEN) {
+            return refresh();
+        }
+    });
+});